@@ -0,0 +1,261 @@
+/*
+ * access_log.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include "access_log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "format.h"
+
+namespace userver {
+
+std::size_t AccessLog::ringSize = 256*1024;
+unsigned int AccessLog::flushInterval = 20;
+
+namespace {
+
+enum class RecordType: std::uint16_t {
+	access,
+	message
+};
+
+///Header of the record, followed by strings
+/** Records are stored unaligned, they are always accessed through memcpy */
+struct Record {
+	RecordType type;
+	std::uint16_t lenA;
+	std::uint16_t lenB;
+	std::uint16_t lenC;
+	std::uint32_t duration;
+	std::uint32_t status;
+	std::int64_t size;
+};
+
+static constexpr std::size_t maxMethod = 32;
+static constexpr std::size_t maxHost = 255;
+static constexpr std::size_t maxPath = 2048;
+static constexpr std::size_t maxMessage = 4096;
+static constexpr std::size_t maxRecord = sizeof(Record) + std::max(maxMethod + maxHost + maxPath, maxMessage);
+
+}
+
+///Single producer single consumer ring buffer
+struct AccessLog::Ring {
+	std::unique_ptr<char[]> data;
+	std::size_t mask;
+	///position of the producer, written by the producer only
+	alignas(64) std::atomic<std::uint64_t> tail = 0;
+	///position of the consumer, written by the consumer only
+	alignas(64) std::atomic<std::uint64_t> head = 0;
+	///the log was destroyed, the ring is no longer used
+	std::atomic<bool> orphaned = false;
+
+	Ring(std::size_t size) {
+		std::size_t sz = 1;
+		while (sz < size || sz < 4*maxRecord) sz <<= 1;
+		data = std::make_unique<char[]>(sz);
+		mask = sz - 1;
+	}
+
+	void write(std::uint64_t pos, const void *d, std::size_t sz) {
+		std::size_t ofs = pos & mask;
+		std::size_t part = std::min(sz, mask + 1 - ofs);
+		std::memcpy(data.get() + ofs, d, part);
+		std::memcpy(data.get(), static_cast<const char *>(d) + part, sz - part);
+	}
+
+	void read(std::uint64_t pos, void *d, std::size_t sz) const {
+		std::size_t ofs = pos & mask;
+		std::size_t part = std::min(sz, mask + 1 - ofs);
+		std::memcpy(d, data.get() + ofs, part);
+		std::memcpy(static_cast<char *>(d) + part, data.get(), sz - part);
+	}
+};
+
+thread_local std::vector<std::pair<std::uint64_t, AccessLog::PRing> > AccessLog::threadRings;
+
+static std::atomic<std::uint64_t> nextLogId = 1;
+
+AccessLog::AccessLog(Writer &&writer)
+	:writer(std::move(writer))
+	,id(nextLogId.fetch_add(1, std::memory_order_relaxed)) {
+	thr = std::thread([this]{worker();});
+}
+
+AccessLog::~AccessLog() {
+	std::unique_lock lk(lock);
+	stopped = true;
+	cond.notify_all();
+	lk.unlock();
+	thr.join();
+	for (const auto &r: rings) r->orphaned.store(true, std::memory_order_relaxed);
+}
+
+AccessLog::Ring *AccessLog::getRing() noexcept {
+	for (const auto &x: threadRings) {
+		if (x.first == id) return x.second.get();
+	}
+	try {
+		threadRings.erase(std::remove_if(threadRings.begin(), threadRings.end(), [](const auto &x) {
+			return x.second->orphaned.load(std::memory_order_relaxed);
+		}), threadRings.end());
+		PRing r = std::make_shared<Ring>(ringSize);
+		std::lock_guard _(lock);
+		rings.push_back(r);
+		threadRings.emplace_back(id, r);
+		return r.get();
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+bool AccessLog::push(const void *hdr, std::size_t hdrSize, std::string_view a, std::string_view b, std::string_view c) noexcept {
+	Ring *r = getRing();
+	std::size_t total = hdrSize + a.size() + b.size() + c.size();
+	if (r != nullptr) {
+		std::uint64_t tail = r->tail.load(std::memory_order_relaxed);
+		std::uint64_t head = r->head.load(std::memory_order_acquire);
+		if (total <= r->mask + 1 - (tail - head)) {
+			r->write(tail, hdr, hdrSize);
+			tail += hdrSize;
+			r->write(tail, a.data(), a.size());
+			tail += a.size();
+			r->write(tail, b.data(), b.size());
+			tail += b.size();
+			r->write(tail, c.data(), c.size());
+			tail += c.size();
+			r->tail.store(tail, std::memory_order_release);
+			return true;
+		}
+	}
+	dropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void AccessLog::access(std::uint32_t duration, std::intptr_t size, unsigned int status,
+		std::string_view method, std::string_view host, std::string_view path) noexcept {
+	method = method.substr(0, maxMethod);
+	host = host.substr(0, maxHost);
+	path = path.substr(0, maxPath);
+	Record rec{RecordType::access,
+		static_cast<std::uint16_t>(method.size()),
+		static_cast<std::uint16_t>(host.size()),
+		static_cast<std::uint16_t>(path.size()),
+		duration, status, size};
+	push(&rec, sizeof(rec), method, host, path);
+}
+
+void AccessLog::message(std::string_view msg) noexcept {
+	msg = msg.substr(0, maxMessage);
+	Record rec{RecordType::message, static_cast<std::uint16_t>(msg.size()), 0, 0, 0, 0, 0};
+	push(&rec, sizeof(rec), msg, std::string_view(), std::string_view());
+}
+
+void AccessLog::flush() {
+	std::unique_lock lk(lock);
+	std::uint64_t req = ++flushReq;
+	cond.notify_all();
+	cond.wait(lk, [&]{return flushDone >= req || stopped;});
+}
+
+void AccessLog::worker() {
+	std::string buff;
+	std::unique_lock lk(lock);
+	for(;;) {
+		bool stop = stopped;
+		std::uint64_t req = flushReq;
+		lk.unlock();
+		buff.clear();
+		collect(buff);
+		if (!buff.empty()) {
+			try {
+				writer(buff);
+			} catch (...) {
+				//nothing to do with the error, records are lost
+			}
+		}
+		lk.lock();
+		flushDone = req;
+		cond.notify_all();
+		if (stop) break;
+		cond.wait_for(lk, std::chrono::milliseconds(flushInterval), [&]{
+			return stopped || flushReq != flushDone;
+		});
+	}
+}
+
+bool AccessLog::collect(std::string &out) {
+	std::vector<PRing> cur;
+	{
+		std::lock_guard _(lock);
+		//rings of finished threads are removed once they are empty
+		rings.erase(std::remove_if(rings.begin(), rings.end(), [](const PRing &r) {
+			return r.use_count() == 1
+				&& r->head.load(std::memory_order_relaxed) == r->tail.load(std::memory_order_acquire);
+		}), rings.end());
+		cur = rings;
+	}
+	char rec[maxRecord];
+	for (const auto &r: cur) {
+		std::uint64_t head = r->head.load(std::memory_order_relaxed);
+		std::uint64_t tail = r->tail.load(std::memory_order_acquire);
+		while (head < tail) {
+			Record hdr;
+			r->read(head, &hdr, sizeof(hdr));
+			std::size_t sz = sizeof(hdr) + hdr.lenA + hdr.lenB + hdr.lenC;
+			r->read(head, rec, sz);
+			formatRecord(rec, out);
+			head += sz;
+		}
+		r->head.store(head, std::memory_order_release);
+	}
+	std::size_t d = dropped.load(std::memory_order_relaxed);
+	if (d != droppedReported) {
+		char buff[maxIntegerChars];
+		out.append("AccessLog: dropped records: ");
+		out.append(buff, formatUnsigned(buff, std::end(buff), d - droppedReported));
+		out.push_back('\n');
+		droppedReported = d;
+	}
+	return !out.empty();
+}
+
+void AccessLog::formatRecord(const char *rec, std::string &out) {
+	Record hdr;
+	std::memcpy(&hdr, rec, sizeof(hdr));
+	const char *a = rec + sizeof(hdr);
+	const char *b = a + hdr.lenA;
+	const char *c = b + hdr.lenB;
+	if (hdr.type == RecordType::message) {
+		out.append(a, hdr.lenA);
+		out.push_back('\n');
+		return;
+	}
+	char buff[maxIntegerChars];
+	auto padded = [&](std::string_view s, std::size_t width) {
+		if (s.size() < width) out.append(width - s.size(), ' ');
+		out.append(s);
+	};
+	auto number = [&](auto v) {
+		return std::string_view(buff, formatSigned(buff, std::end(buff), v) - buff);
+	};
+	padded(number(hdr.duration), 8);
+	out.push_back(' ');
+	padded(hdr.size == -1?std::string_view("n/a"):number(hdr.size), 8);
+	out.push_back(' ');
+	padded(number(hdr.status), 3);
+	out.push_back(' ');
+	padded(std::string_view(a, hdr.lenA), 8);
+	out.push_back(' ');
+	out.append(b, hdr.lenB);
+	out.append(c, hdr.lenC);
+	out.push_back('\n');
+}
+
+}
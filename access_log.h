@@ -0,0 +1,117 @@
+/*
+ * access_log.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_USERVER_ACCESS_LOG_H_
+#define SRC_USERVER_ACCESS_LOG_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "callback.h"
+
+namespace userver {
+
+///Asynchronous log of requests
+/**
+ * Threads which log records write compact binary records to their own ring buffer, without
+ * locking and without formatting. A background thread collects records from all rings,
+ * formats them and passes them to the writer in large batches.
+ *
+ * When a ring buffer is full, the record is dropped and counted. Count of dropped records
+ * is reported to the log and it is available by getDropped()
+ *
+ * @note order of records is kept for each thread, records of different threads can be mixed
+ */
+class AccessLog {
+public:
+
+	///Function which writes formatted lines
+	using Writer = CallbackT<void(const std::string_view &)>;
+
+	///Create log and start the background thread
+	/**
+	 * @param writer function called from the background thread with batch of formatted
+	 * lines. Each line is terminated by new line character
+	 */
+	AccessLog(Writer &&writer);
+	///Stops the background thread, pending records are written
+	~AccessLog();
+
+	AccessLog(const AccessLog &) = delete;
+	AccessLog &operator=(const AccessLog &) = delete;
+
+	///Log finished request
+	/**
+	 * @param duration duration of the request in milliseconds
+	 * @param size size of the response, -1 if unknown
+	 * @param status status code
+	 * @param method method
+	 * @param host host
+	 * @param path path
+	 */
+	void access(std::uint32_t duration, std::intptr_t size, unsigned int status,
+			std::string_view method, std::string_view host, std::string_view path) noexcept;
+
+	///Log text message
+	void message(std::string_view msg) noexcept;
+
+	///Write all records logged before this call
+	/** Function blocks until the records are passed to the writer */
+	void flush();
+
+	///Count of records dropped, because ring buffer of the thread was full
+	std::size_t getDropped() const {return dropped.load(std::memory_order_relaxed);}
+
+	///Size of the ring buffer of each thread in bytes (rounded up to power of two)
+	static std::size_t ringSize;
+	///Interval in milliseconds, how often the background thread collects records
+	static unsigned int flushInterval;
+
+protected:
+
+	struct Ring;
+	using PRing = std::shared_ptr<Ring>;
+
+	Writer writer;
+	///Unique id of the instance, used to find ring of the thread
+	std::uint64_t id;
+
+	///Protects rings, stop flag and flush counters
+	std::mutex lock;
+	std::condition_variable cond;
+	std::vector<PRing> rings;
+	bool stopped = false;
+	std::uint64_t flushReq = 0;
+	std::uint64_t flushDone = 0;
+	std::atomic<std::size_t> dropped = 0;
+	std::size_t droppedReported = 0;
+	std::thread thr;
+
+	///Rings of the current thread, for each log by its id
+	static thread_local std::vector<std::pair<std::uint64_t, PRing> > threadRings;
+
+	Ring *getRing() noexcept;
+	bool push(const void *hdr, std::size_t hdrSize, std::string_view a, std::string_view b, std::string_view c) noexcept;
+	void worker();
+	bool collect(std::string &out);
+	static void formatRecord(const char *rec, std::string &out);
+
+};
+
+}
+
+
+
+#endif /* SRC_USERVER_ACCESS_LOG_H_ */
@@ -15,6 +15,7 @@
 #include "dispatcher_epoll.h"
 #include "async_provider.h"
 #include "scheduler.h"
+#include "stream.h"
 #include <thread>
 
 namespace userver {
@@ -55,6 +56,8 @@ protected:
 	std::condition_variable wt;
 	bool _stopped = false;
 	std::queue<Action> actions;
+	///count of threads waiting for a dispatcher or an action
+	std::size_t idleThreads = 0;
 	std::queue<std::exception_ptr> stored_exceptions;
 
     void handleException();
@@ -149,10 +152,13 @@ inline bool AsyncProviderImpl::worker() {
 	    stored_exceptions.pop();
 	    std::rethrow_exception(e);
 	}
+	//idle threads also pick actions, so actions queued at once are processed in parallel
+	++idleThreads;
+	wt.wait(_,[&]{
+		return !dispqueue.empty() || !actions.empty();
+	});
+	--idleThreads;
 	if (actions.empty()) {
-        wt.wait(_,[&]{
-            return !dispqueue.empty();
-        });
         selDisp = dispqueue.front();
         dispqueue.pop();
         _.unlock();
@@ -163,6 +169,7 @@ inline bool AsyncProviderImpl::worker() {
             wt.notify_one();
             _.unlock();
             if (task.valid()) {
+                SocketStream::AutoCork cork;
                 task.cb(task.success);
             }
         } catch (...) {
@@ -176,6 +183,7 @@ inline bool AsyncProviderImpl::worker() {
         actions.pop();
         _.unlock();
         try {
+            SocketStream::AutoCork cork;
             a();
 	    } catch (...) {
 	        _.lock();
@@ -191,7 +199,9 @@ inline AsyncProviderImpl::AsyncProviderImpl() {}
 inline void AsyncProviderImpl::runAsync(IAsyncProvider::Action &&cb) {
 	std::unique_lock _(lock);
 	actions.push(std::move(cb));
-	dispatchers.front()->interrupt();
+	//wake idle thread for each queued action, otherwise interrupt the dispatcher
+	if (idleThreads >= actions.size()) wt.notify_one();
+	else dispatchers.front()->interrupt();
 }
 
 static std::mutex asyncLock;
@@ -0,0 +1,494 @@
+/*
+ * compress_stream.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include "compress_stream.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "header_value.h"
+
+#ifndef USERVER_NO_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USERVER_HAS_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef USERVER_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace userver {
+
+std::size_t CompressStream::bufferSize = 16384;
+int CompressStream::deflateLevel = 6;
+int CompressStream::brotliQuality = 4;
+int CompressStream::zstdLevel = 3;
+std::size_t CompressStream::poolSize = 4;
+
+///Compressor context
+class CompressStream::Encoder {
+public:
+	enum class Op {
+		///compress, output can be retained
+		none,
+		///output all data written so far
+		flush,
+		///finish the compressed stream
+		finish
+	};
+
+	virtual ~Encoder() {}
+	virtual ContentEncoding getEncoding() const = 0;
+	///Compress data, compressed data are appended to the buffer
+	virtual bool process(std::string_view data, Op op, std::vector<char> &out) = 0;
+	///Prepare context for new stream
+	virtual bool reset() = 0;
+
+	///Buffer of compressed data, capacity is reused by following streams
+	std::vector<char> buffer;
+
+protected:
+	static constexpr std::size_t step = 16384;
+
+	///Extends the buffer for output of the compressor
+	/**
+	 * @param out buffer
+	 * @param pos receives position of the space
+	 * @return size of the space
+	 */
+	static std::size_t extend(std::vector<char> &out, std::size_t &pos) {
+		pos = out.size();
+		std::size_t sz = std::max(step, out.capacity() - pos);
+		out.resize(pos + sz);
+		return sz;
+	}
+};
+
+namespace {
+
+#ifndef USERVER_NO_ZLIB
+class DeflateEncoder: public CompressStream::Encoder {
+public:
+	DeflateEncoder(bool gzip):gzip(gzip) {
+		if (deflateInit2(&z, CompressStream::deflateLevel, Z_DEFLATED, gzip?15+16:15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw std::bad_alloc();
+		}
+	}
+	~DeflateEncoder() {
+		deflateEnd(&z);
+	}
+	virtual ContentEncoding getEncoding() const override {
+		return gzip?ContentEncoding::gzip:ContentEncoding::deflate;
+	}
+	virtual bool reset() override {
+		return deflateReset(&z) == Z_OK;
+	}
+	virtual bool process(std::string_view data, Op op, std::vector<char> &out) override {
+		int flush = op == Op::finish?Z_FINISH:op == Op::flush?Z_SYNC_FLUSH:Z_NO_FLUSH;
+		z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+		z.avail_in = static_cast<uInt>(data.size());
+		for(;;) {
+			std::size_t pos;
+			std::size_t sz = extend(out, pos);
+			z.next_out = reinterpret_cast<Bytef *>(out.data() + pos);
+			z.avail_out = static_cast<uInt>(sz);
+			int r = deflate(&z, flush);
+			out.resize(out.size() - z.avail_out);
+			if (r == Z_STREAM_END) return true;
+			if (r != Z_OK && r != Z_BUF_ERROR) return false;
+			//output space left - all input consumed and all requested output produced
+			if (z.avail_out != 0 && op != Op::finish) return true;
+		}
+	}
+protected:
+	z_stream z = {};
+	bool gzip;
+};
+#endif
+
+#ifdef USERVER_HAS_BROTLI
+class BrotliEncoder: public CompressStream::Encoder {
+public:
+	BrotliEncoder() {
+		create();
+	}
+	~BrotliEncoder() {
+		BrotliEncoderDestroyInstance(st);
+	}
+	virtual ContentEncoding getEncoding() const override {
+		return ContentEncoding::br;
+	}
+	virtual bool reset() override {
+		//brotli has no reset, the instance must be recreated
+		BrotliEncoderDestroyInstance(st);
+		create();
+		return true;
+	}
+	virtual bool process(std::string_view data, Op op, std::vector<char> &out) override {
+		BrotliEncoderOperation bop = op == Op::finish?BROTLI_OPERATION_FINISH
+				:op == Op::flush?BROTLI_OPERATION_FLUSH:BROTLI_OPERATION_PROCESS;
+		std::size_t avail_in = data.size();
+		const std::uint8_t *next_in = reinterpret_cast<const std::uint8_t *>(data.data());
+		for(;;) {
+			std::size_t pos;
+			std::size_t avail_out = extend(out, pos);
+			std::uint8_t *next_out = reinterpret_cast<std::uint8_t *>(out.data() + pos);
+			if (!BrotliEncoderCompressStream(st, bop, &avail_in, &next_in, &avail_out, &next_out, nullptr)) {
+				out.resize(out.size() - avail_out);
+				return false;
+			}
+			out.resize(out.size() - avail_out);
+			if (avail_in == 0 && !BrotliEncoderHasMoreOutput(st)
+					&& (op != Op::finish || BrotliEncoderIsFinished(st))) return true;
+		}
+	}
+protected:
+	BrotliEncoderState *st;
+
+	void create() {
+		st = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+		if (st == nullptr) throw std::bad_alloc();
+		BrotliEncoderSetParameter(st, BROTLI_PARAM_QUALITY, CompressStream::brotliQuality);
+	}
+};
+#endif
+
+#ifdef USERVER_HAS_ZSTD
+class ZstdEncoder: public CompressStream::Encoder {
+public:
+	ZstdEncoder() {
+		ctx = ZSTD_createCCtx();
+		if (ctx == nullptr) throw std::bad_alloc();
+		ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, CompressStream::zstdLevel);
+	}
+	~ZstdEncoder() {
+		ZSTD_freeCCtx(ctx);
+	}
+	virtual ContentEncoding getEncoding() const override {
+		return ContentEncoding::zstd;
+	}
+	virtual bool reset() override {
+		return !ZSTD_isError(ZSTD_CCtx_reset(ctx, ZSTD_reset_session_only));
+	}
+	virtual bool process(std::string_view data, Op op, std::vector<char> &out) override {
+		ZSTD_EndDirective mode = op == Op::finish?ZSTD_e_end:op == Op::flush?ZSTD_e_flush:ZSTD_e_continue;
+		ZSTD_inBuffer in{data.data(), data.size(), 0};
+		for(;;) {
+			std::size_t pos;
+			std::size_t sz = extend(out, pos);
+			ZSTD_outBuffer ob{out.data() + pos, sz, 0};
+			std::size_t r = ZSTD_compressStream2(ctx, &ob, &in, mode);
+			out.resize(pos + ob.pos);
+			if (ZSTD_isError(r)) return false;
+			if (mode == ZSTD_e_continue?in.pos == in.size:r == 0) return true;
+		}
+	}
+protected:
+	ZSTD_CCtx *ctx;
+};
+#endif
+
+///Unused contexts of the current thread
+struct EncoderPool {
+	std::vector<std::unique_ptr<CompressStream::Encoder> > encoders;
+	~EncoderPool();
+};
+
+thread_local EncoderPool encoderPool;
+///Set when pool of the thread is destroyed, contexts are no longer returned to it
+thread_local bool encoderPoolClosed = false;
+
+EncoderPool::~EncoderPool() {
+	encoderPoolClosed = true;
+}
+
+std::unique_ptr<CompressStream::Encoder> createEncoder(ContentEncoding encoding) {
+	switch (encoding) {
+#ifndef USERVER_NO_ZLIB
+	case ContentEncoding::deflate: return std::make_unique<DeflateEncoder>(false);
+	case ContentEncoding::gzip: return std::make_unique<DeflateEncoder>(true);
+#endif
+#ifdef USERVER_HAS_BROTLI
+	case ContentEncoding::br: return std::make_unique<BrotliEncoder>();
+#endif
+#ifdef USERVER_HAS_ZSTD
+	case ContentEncoding::zstd: return std::make_unique<ZstdEncoder>();
+#endif
+	default: throw std::invalid_argument("CompressStream: unsupported encoding");
+	}
+}
+
+CompressStream::Encoder *acquireEncoder(ContentEncoding encoding) {
+	if (!encoderPoolClosed) {
+		auto &encs = encoderPool.encoders;
+		for (auto iter = encs.rbegin(); iter != encs.rend(); ++iter) {
+			if ((*iter)->getEncoding() == encoding) {
+				CompressStream::Encoder *e = iter->release();
+				encs.erase(std::next(iter).base());
+				return e;
+			}
+		}
+	}
+	return createEncoder(encoding).release();
+}
+
+void releaseEncoder(CompressStream::Encoder *e) {
+	std::unique_ptr<CompressStream::Encoder> ptr(e);
+	if (encoderPoolClosed) return;
+	auto &encs = encoderPool.encoders;
+	std::size_t cnt = std::count_if(encs.begin(), encs.end(), [&](const auto &x) {
+		return x->getEncoding() == e->getEncoding();
+	});
+	if (cnt >= CompressStream::poolSize) return;
+	//large buffers are not kept
+	if (e->buffer.capacity() > 4 * CompressStream::bufferSize) {
+		std::vector<char>().swap(e->buffer);
+	}
+	if (!e->reset()) return;
+	try {
+		encs.push_back(std::move(ptr));
+	} catch (...) {
+		//context is destroyed
+	}
+}
+
+}
+
+CompressStream::CompressStream(Stream &&target, ContentEncoding encoding)
+	:target(std::move(target))
+	,encoder(acquireEncoder(encoding)) {
+	encoder->buffer.clear();
+}
+
+CompressStream::~CompressStream() {
+	try {
+		closeOutput();
+	} catch (...) {
+
+	}
+	releaseEncoder(encoder);
+}
+
+std::string_view CompressStream::read() {
+	return target.readSync();
+}
+
+void CompressStream::readAsync(CallbackT<void(const std::string_view &data)> &&fn) {
+	target.read() >> std::move(fn);
+}
+
+void CompressStream::putBack(const std::string_view &pb) {
+	target.putBack(pb);
+}
+
+void CompressStream::writeOut() {
+	if (!encoder->buffer.empty()) {
+		target.writeNB(std::string_view(encoder->buffer.data(), encoder->buffer.size()));
+		encoder->buffer.clear();
+	}
+}
+
+void CompressStream::write(const std::string_view &data) {
+	if (writeNB(data)) target.flush();
+}
+
+bool CompressStream::writeNB(const std::string_view &data) {
+	if (closed) return false;
+	if (!encoder->process(data, Encoder::Op::none, encoder->buffer)) {
+		throw std::runtime_error("CompressStream: compression failed");
+	}
+	if (encoder->buffer.size() >= bufferSize) {
+		bool r = target.writeNB(std::string_view(encoder->buffer.data(), encoder->buffer.size()));
+		encoder->buffer.clear();
+		return r;
+	}
+	return false;
+}
+
+void CompressStream::closeOutput() {
+	if (!closed) {
+		closed = true;
+		bool ok = encoder->process(std::string_view(), Encoder::Op::finish, encoder->buffer);
+		writeOut();
+		target.closeOutput();
+		if (!ok) throw std::runtime_error("CompressStream: compression failed");
+	}
+}
+
+void CompressStream::closeInput() {
+	target.closeInput();
+}
+
+void CompressStream::flush() {
+	if (!closed) {
+		encoder->process(std::string_view(), Encoder::Op::flush, encoder->buffer);
+		writeOut();
+	}
+	target.flush();
+}
+
+void CompressStream::flushAsync(CallbackT<void(bool)> &&fn) {
+	if (!closed) {
+		encoder->process(std::string_view(), Encoder::Op::flush, encoder->buffer);
+		writeOut();
+	}
+	target.flush() >> std::move(fn);
+}
+
+bool CompressStream::timeouted() const {
+	return target.timeouted();
+}
+
+void CompressStream::clearTimeout() {
+	target.clearTimeout();
+}
+
+std::size_t CompressStream::getOutputBufferSize() const {
+	return target.getOutputBufferSize();
+}
+
+bool CompressStream::isWritable() const {
+	return target.isWritable();
+}
+
+void CompressStream::waitWritableAsync(CallbackT<void(bool)> &&fn) {
+	writeOut();
+	target.waitWritable(std::move(fn));
+}
+
+std::size_t CompressStream::getSendCount() const {
+	return target.getSendCount();
+}
+
+bool CompressStream::isSupported(ContentEncoding encoding) {
+	switch (encoding) {
+	case ContentEncoding::identity: return true;
+#ifndef USERVER_NO_ZLIB
+	case ContentEncoding::deflate:
+	case ContentEncoding::gzip: return true;
+#endif
+#ifdef USERVER_HAS_BROTLI
+	case ContentEncoding::br: return true;
+#endif
+#ifdef USERVER_HAS_ZSTD
+	case ContentEncoding::zstd: return true;
+#endif
+	default: return false;
+	}
+}
+
+std::string_view CompressStream::getName(ContentEncoding encoding) {
+	switch (encoding) {
+	case ContentEncoding::deflate: return "deflate";
+	case ContentEncoding::gzip: return "gzip";
+	case ContentEncoding::br: return "br";
+	case ContentEncoding::zstd: return "zstd";
+	default: return "identity";
+	}
+}
+
+///Parses quality value, returns value in thousandths
+static int parseQuality(std::string_view q) {
+	int r = 0;
+	int digits = -1;
+	for (char c: q) {
+		if (c == '.') {
+			if (digits >= 0) break;
+			digits = 0;
+		} else if (c >= '0' && c <= '9') {
+			if (digits < 0) r = r * 10 + (c - '0');
+			else if (digits < 3) {r = r * 10 + (c - '0'); digits++;}
+		} else {
+			break;
+		}
+	}
+	if (digits < 0) digits = 0;
+	while (digits < 3) {r = r * 10; digits++;}
+	return std::min(r, 1000);
+}
+
+ContentEncoding CompressStream::negotiate(std::string_view acceptEncoding) {
+	//order of preference when qualities are equal
+	static constexpr ContentEncoding order[] = {
+			ContentEncoding::br, ContentEncoding::zstd, ContentEncoding::gzip, ContentEncoding::deflate
+	};
+	static constexpr int unset = -1;
+	int quality[std::size(order)] = {unset, unset, unset, unset};
+	int wildcard = unset;
+	HeaderValue(acceptEncoding).enumValues([&](std::string_view item) {
+		std::string_view name = HeaderValue::splitAt(";", item);
+		HeaderValue::trim(name);
+		int q = 1000;
+		while (!item.empty()) {
+			std::string_view param = HeaderValue::splitAt(";", item);
+			HeaderValue::trim(param);
+			if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+				q = parseQuality(param.substr(2));
+			}
+		}
+		if (name == "*") {
+			wildcard = q;
+		} else {
+			for (std::size_t i = 0; i < std::size(order); i++) {
+				if (HeaderValue::iequal(name, getName(order[i])) || (order[i] == ContentEncoding::gzip && HeaderValue::iequal(name, "x-gzip"))) {
+					quality[i] = q;
+				}
+			}
+		}
+	});
+	ContentEncoding best = ContentEncoding::identity;
+	int bestq = 0;
+	for (std::size_t i = 0; i < std::size(order); i++) {
+		int q = quality[i] == unset?wildcard:quality[i];
+		if (q > bestq && isSupported(order[i])) {
+			best = order[i];
+			bestq = q;
+		}
+	}
+	return best;
+}
+
+bool CompressStream::isCompressible(std::string_view contentType) {
+	contentType = HeaderValue::splitAt(";", contentType);
+	HeaderValue::trim(contentType);
+	auto startsWith = [&](std::string_view prefix) {
+		return contentType.size() >= prefix.size() && HeaderValue::iequal(contentType.substr(0, prefix.size()), prefix);
+	};
+	if (startsWith("text/")) return true;
+	if (startsWith("image/")) return HeaderValue::iequal(contentType, "image/svg+xml")
+									|| HeaderValue::iequal(contentType, "image/x-icon")
+									|| HeaderValue::iequal(contentType, "image/bmp");
+	if (startsWith("audio/") || startsWith("video/") || startsWith("font/woff")) return false;
+	static constexpr std::string_view compressed[] = {
+			"application/octet-stream",
+			"application/zip",
+			"application/gzip",
+			"application/x-gzip",
+			"application/zstd",
+			"application/x-bzip2",
+			"application/x-xz",
+			"application/x-7z-compressed",
+			"application/x-rar-compressed",
+			"application/pdf"
+	};
+	for (const auto &x: compressed) {
+		if (HeaderValue::iequal(contentType, x)) return false;
+	}
+	return true;
+}
+
+bool CompressStream::compress(ContentEncoding encoding, std::string_view data, std::vector<char> &out) {
+	Encoder *e = acquireEncoder(encoding);
+	out.clear();
+	bool ok = e->process(data, Encoder::Op::finish, out);
+	releaseEncoder(e);
+	return ok;
+}
+
+}
@@ -0,0 +1,123 @@
+/*
+ * compress_stream.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_USERVER_COMPRESS_STREAM_H_
+#define SRC_USERVER_COMPRESS_STREAM_H_
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "stream.h"
+
+namespace userver {
+
+///Content codings of HTTP (Content-Encoding)
+enum class ContentEncoding {
+	identity,
+	deflate,
+	gzip,
+	br,
+	zstd
+};
+
+///Stream which compresses written data and writes them to the target stream
+/**
+ * Stream is intended to wrap the stream of the response. Data are compressed to the internal
+ * buffer, which is written to the target stream when it exceeds bufferSize, or when
+ * the stream is flushed. Flush of the stream also flushes the compressor, so the data written
+ * so far can be decompressed by the peer.
+ *
+ * Compressor contexts are allocated once for each thread and they are reused by following
+ * streams created in the same thread.
+ *
+ * Encodings gzip and deflate require zlib, br requires brotli and zstd requires zstd. Support
+ * is selected during build, use isSupported() to check availability.
+ *
+ * Reading operations are passed to the target stream
+ */
+class CompressStream: public AbstractStream {
+public:
+
+	///Construct the stream
+	/**
+	 * @param target target stream, ownership is transfered to this stream
+	 * @param encoding encoding. It must be supported
+	 *
+	 * @exception std::invalid_argument encoding is not supported
+	 */
+	CompressStream(Stream &&target, ContentEncoding encoding);
+	///Destructor closes the output, so the compressed data are finished
+	~CompressStream();
+
+	virtual std::string_view read() override;
+	virtual void readAsync(CallbackT<void(const std::string_view &data)> &&fn) override;
+	virtual void putBack(const std::string_view &pb) override;
+	virtual void write(const std::string_view &data) override;
+	virtual bool writeNB(const std::string_view &data) override;
+	virtual void closeOutput() override;
+	virtual void closeInput() override;
+	virtual void flush() override;
+	virtual void flushAsync(CallbackT<void(bool)> &&fn) override;
+	virtual bool timeouted() const override;
+	virtual void clearTimeout() override;
+	virtual std::size_t getOutputBufferSize() const override;
+	virtual bool isWritable() const override;
+	virtual void waitWritableAsync(CallbackT<void(bool)> &&fn) override;
+	virtual std::size_t getSendCount() const override;
+
+	///Determines whether the encoding is supported by this build
+	static bool isSupported(ContentEncoding encoding);
+	///Returns name of the encoding as used in the Content-Encoding header
+	static std::string_view getName(ContentEncoding encoding);
+	///Selects the best supported encoding accepted by the client
+	/**
+	 * @param acceptEncoding value of the Accept-Encoding header
+	 * @return selected encoding. Encodings with equal quality are preferred in order
+	 * br, zstd, gzip, deflate. Returns identity if no supported encoding is accepted
+	 */
+	static ContentEncoding negotiate(std::string_view acceptEncoding);
+	///Determines whether content of given type is worth to compress
+	/** Returns false for images, audio, video, fonts and archives, which are usually already compressed */
+	static bool isCompressible(std::string_view contentType);
+	///Compress whole content at once
+	/**
+	 * @param encoding encoding. It must be supported
+	 * @param data data to compress
+	 * @param out buffer receives compressed data. Previous content is cleared
+	 * @retval true success
+	 * @retval false compression failed
+	 */
+	static bool compress(ContentEncoding encoding, std::string_view data, std::vector<char> &out);
+
+	///Size of compressed data collected before they are written to the target stream
+	static std::size_t bufferSize;
+	///Compression level of gzip and deflate (1-9)
+	static int deflateLevel;
+	///Quality of brotli (0-11)
+	static int brotliQuality;
+	///Compression level of zstd
+	static int zstdLevel;
+	///Maximum count of unused compressor contexts kept by each thread for each encoding
+	static std::size_t poolSize;
+
+	class Encoder;
+
+protected:
+
+	Stream target;
+	Encoder *encoder;
+	bool closed = false;
+
+	void writeOut();
+};
+
+}
+
+
+
+#endif /* SRC_USERVER_COMPRESS_STREAM_H_ */
@@ -10,11 +10,130 @@
 #include "netaddr.h"
 #include "dgramsocket.h"
 
+#include <algorithm>
+#include <cstring>
 #include <system_error>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 
 #include "socketresource.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP IPPROTO_UDP
+#endif
+
 namespace userver {
 
+unsigned int DGramSocket::maxQueuedDGrams = 64;
+
+///Ring of buffers for recvmmsg
+struct DGramSocket::RecvBatch {
+	///Single received datagram. Buffers coalesced by GRO contain more datagrams
+	struct Packet {
+		const char *data;
+		std::size_t size;
+		unsigned int msg;
+	};
+
+	std::size_t size;
+	bool gro;
+	std::size_t ctrlSize;
+	std::vector<char> buffer;
+	std::vector<mmsghdr> msgs;
+	std::vector<iovec> iov;
+	std::vector<sockaddr_storage> addrs;
+	std::vector<char> ctrl;
+	std::vector<Packet> packets;
+
+	RecvBatch(unsigned int count, std::size_t size, bool gro)
+		:size(size),gro(gro),ctrlSize(CMSG_SPACE(sizeof(int)))
+		,buffer(count * size),msgs(count),iov(count),addrs(count),ctrl(count * ctrlSize) {
+		packets.reserve(count);
+		for (unsigned int i = 0; i < count; i++) {
+			iov[i].iov_base = buffer.data() + i * size;
+			iov[i].iov_len = size;
+		}
+	}
+
+	void prepare() {
+		for (std::size_t i = 0, cnt = msgs.size(); i < cnt; i++) {
+			msghdr &h = msgs[i].msg_hdr;
+			h.msg_name = &addrs[i];
+			h.msg_namelen = sizeof(sockaddr_storage);
+			h.msg_iov = &iov[i];
+			h.msg_iovlen = 1;
+			h.msg_control = gro?ctrl.data() + i * ctrlSize:nullptr;
+			h.msg_controllen = gro?ctrlSize:0;
+			h.msg_flags = 0;
+			msgs[i].msg_len = 0;
+		}
+		packets.clear();
+	}
+
+	void split(unsigned int count) {
+		for (unsigned int i = 0; i < count; i++) {
+			const msghdr &h = msgs[i].msg_hdr;
+			const char *d = buffer.data() + i * size;
+			std::size_t len = msgs[i].msg_len;
+			if (h.msg_flags & MSG_TRUNC) {
+				packets.push_back({d, 0, i});
+				continue;
+			}
+			std::size_t seg = len;
+#ifdef UDP_GRO
+			if (gro) {
+				for (cmsghdr *c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(const_cast<msghdr *>(&h), c)) {
+					if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+						int v;
+						std::memcpy(&v, CMSG_DATA(c), sizeof(v));
+						if (v > 0) seg = v;
+					}
+				}
+			}
+#endif
+			std::size_t pos = 0;
+			do {
+				std::size_t sz = std::min(seg, len - pos);
+				packets.push_back({d + pos, sz, i});
+				pos += sz;
+			} while (pos < len);
+		}
+	}
+};
+
+///Datagrams waiting for sendmmsg
+struct DGramSocket::SendQueue {
+	struct Item {
+		std::size_t offset;
+		std::size_t size;
+		sockaddr_storage addr;
+		socklen_t addrlen;
+	};
+	std::vector<char> data;
+	std::vector<Item> items;
+	std::vector<mmsghdr> msgs;
+	std::vector<iovec> iov;
+	std::vector<char> ctrl;
+	///index of the first item of each message
+	std::vector<std::size_t> firstItem;
+	///count of datagrams in each message
+	std::vector<std::size_t> segments;
+
+	///Prepares messages for sendmmsg
+	/**
+	 * @param msg index of the first message to prepare
+	 * @param item index of the first item to send
+	 * @param gso enable segmentation
+	 * @param noGSO items before this index are sent without segmentation
+	 * @return count of messages
+	 */
+	std::size_t prepare(std::size_t msg, std::size_t item, bool gso, std::size_t noGSO);
+
+	static bool sameTarget(const Item &a, const Item &b) {
+		return a.addrlen == b.addrlen && std::memcmp(&a.addr, &b.addr, a.addrlen) == 0;
+	}
+};
+
 DGramSocket::DGramSocket(int i):s(i) {
 	inputBuffer.resize(4096);
 	addrBuffer.resize(sizeof (sockaddr_storage));
@@ -66,30 +185,40 @@ NetAddr DGramSocket::getPeerAddr() const {
 
 }
 
+///Waits until the socket is writable
+/**
+ * @param s socket
+ * @param tm timeout in milliseconds, -1 is infinity
+ * @retval true writable
+ * @retval false timeout
+ */
+static bool waitWritable(SocketHandle s, int tm) {
+	pollfd pfd;
+	pfd.fd = s;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	int r = poll(&pfd, 1, tm);
+	if (r < 0) {
+		if (errno == EINTR) return true;
+		throw std::system_error(errno, std::generic_category());
+	}
+	return r > 0;
+}
+
 void DGramSocket::send(const std::string_view &data, const NetAddr &target) {
 	const sockaddr *sin = target.getAddr();
 	socklen_t slen = target.getAddrLen();
 	int r = ::sendto(s, data.data(), data.size(), 0, sin, slen);
-	if (r < 0) {
+	while (r < 0) {
 		int err = errno;
 		if (err == EWOULDBLOCK) {
-			pollfd pfd;
-			pfd.fd = s;
-			pfd.events = POLLOUT;
-			pfd.revents = 0;
-			r = poll(&pfd, 1, -1);
-			if (r < 0) {
-				if (err == EINTR) {
-				    send(data, target);
-				    return;
-				}
-				throw std::system_error(errno, std::generic_category());
-			} else {
-				send(data,target);
-				return;
+			if (!waitWritable(s, writetm)) {
+				throw std::system_error(ETIMEDOUT, std::generic_category(), "DGramSocket::send()");
 			}
-
+		} else if (err != EINTR) {
+			throw std::system_error(err, std::generic_category(), "DGramSocket::send()");
 		}
+		r = ::sendto(s, data.data(), data.size(), 0, sin, slen);
 	}
 
 	if (r != static_cast<int>(data.size())) {
@@ -102,6 +231,11 @@ DGramSocket::DGramSocket(DGramSocket &&other)
 ,inputBuffer(std::move(other.inputBuffer))
 ,addrBuffer(std::move(other.addrBuffer))
 ,rcvsize(other.rcvsize)
+,rcvBatch(std::move(other.rcvBatch))
+,sndQueue(std::move(other.sndQueue))
+,gso(other.gso)
+,writetm(other.writetm)
+,lastError(other.lastError)
 {
 	other.s = -1;
 }
@@ -115,6 +249,11 @@ DGramSocket& DGramSocket::operator =(DGramSocket &&other) {
 	inputBuffer = std::move(other.inputBuffer);
 	addrBuffer = std::move(other.addrBuffer);
 	rcvsize = other.rcvsize;
+	rcvBatch = std::move(other.rcvBatch);
+	sndQueue = std::move(other.sndQueue);
+	gso = other.gso;
+	writetm = other.writetm;
+	lastError = other.lastError;
 	other.s = -1;
 	return *this;
 
@@ -125,5 +264,177 @@ const SocketResource &DGramSocket::getReadAsync()  {
 	return *a;
 }
 
+void DGramSocket::setRecvBatch(unsigned int count, std::size_t size, bool gro) {
+#ifdef UDP_GRO
+	bool curgro = rcvBatch != nullptr && rcvBatch->gro;
+	if (gro != curgro) {
+		int v = gro?1:0;
+		if (setsockopt(s, SOL_UDP, UDP_GRO, &v, sizeof(v))) gro = false;
+	}
+#else
+	gro = false;
+#endif
+	if (gro) size = std::max<std::size_t>(size, 65536);
+	rcvBatch = std::make_unique<RecvBatch>(std::max(count, 1U), std::max<std::size_t>(size, 1), gro);
 }
 
+unsigned int DGramSocket::recvBatch(int timeout) {
+	if (rcvBatch == nullptr) setRecvBatch(64);
+	RecvBatch &b = *rcvBatch;
+	b.prepare();
+	int r = ::recvmmsg(s, b.msgs.data(), static_cast<unsigned int>(b.msgs.size()), MSG_DONTWAIT, nullptr);
+	if (r < 0) {
+		int err = errno;
+		if (err == EWOULDBLOCK || err == EINTR) {
+			pollfd pfd;
+			pfd.fd = s;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			r = poll(&pfd, 1, timeout);
+			if (r < 0) {
+				if (errno == EINTR) return recvBatch(timeout);
+				throw std::system_error(errno, std::generic_category());
+			} else if (r == 0) {
+				return 0;
+			} else {
+				return recvBatch(timeout);
+			}
+		} else {
+			throw std::system_error(err, std::generic_category());
+		}
+	}
+	b.split(r);
+	return static_cast<unsigned int>(b.packets.size());
+}
+
+std::string_view DGramSocket::getData(unsigned int idx) const {
+	if (rcvBatch == nullptr || idx >= rcvBatch->packets.size()) return std::string_view();
+	const auto &p = rcvBatch->packets[idx];
+	return std::string_view(p.data, p.size);
+}
+
+NetAddr DGramSocket::getPeerAddr(unsigned int idx) const {
+	const auto &p = rcvBatch->packets.at(idx);
+	return NetAddr::fromSockAddr(*reinterpret_cast<const sockaddr *>(&rcvBatch->addrs[p.msg]));
+}
+
+bool DGramSocket::enableGSO(bool enable) {
+#ifdef UDP_SEGMENT
+	gso = enable;
+	return true;
+#else
+	gso = false;
+	return !enable;
+#endif
+}
+
+bool DGramSocket::queue(const std::string_view &data, const NetAddr &target) {
+	if (sndQueue == nullptr) sndQueue = std::make_unique<SendQueue>();
+	SendQueue &q = *sndQueue;
+	SendQueue::Item itm;
+	itm.offset = q.data.size();
+	itm.size = data.size();
+	itm.addrlen = std::min<socklen_t>(target.getAddrLen(), sizeof(sockaddr_storage));
+	std::memcpy(&itm.addr, target.getAddr(), itm.addrlen);
+	q.data.insert(q.data.end(), data.begin(), data.end());
+	q.items.push_back(itm);
+	return q.items.size() >= maxQueuedDGrams;
+}
+
+std::size_t DGramSocket::SendQueue::prepare(std::size_t msg, std::size_t item, bool gso, std::size_t noGSO) {
+	//limits of the kernel for single GSO buffer
+	constexpr std::size_t maxSegments = 64;
+	constexpr std::size_t maxGSOSize = 65000;
+	const std::size_t ctrlSize = CMSG_SPACE(sizeof(std::uint16_t));
+	std::size_t cnt = items.size();
+	for (std::size_t i = item; i < cnt;) {
+		const Item &first = items[i];
+		std::size_t j = i+1;
+		std::size_t total = first.size;
+		if (gso && i >= noGSO && first.size) {
+			//datagrams of the same size to the same target. The last one can be shorter
+			while (j < cnt && j - i < maxSegments
+					&& sameTarget(first, items[j])
+					&& items[j].size && items[j].size <= first.size
+					&& total + items[j].size <= maxGSOSize) {
+				total += items[j].size;
+				if (items[j++].size < first.size) break;
+			}
+		}
+		mmsghdr &m = msgs[msg];
+		msghdr &h = m.msg_hdr;
+		iov[msg].iov_base = data.data() + first.offset;
+		iov[msg].iov_len = total;
+		h.msg_name = const_cast<sockaddr_storage *>(&first.addr);
+		h.msg_namelen = first.addrlen;
+		h.msg_iov = &iov[msg];
+		h.msg_iovlen = 1;
+		h.msg_control = nullptr;
+		h.msg_controllen = 0;
+		h.msg_flags = 0;
+		m.msg_len = 0;
+#ifdef UDP_SEGMENT
+		if (j - i > 1) {
+			h.msg_control = ctrl.data() + msg * ctrlSize;
+			h.msg_controllen = ctrlSize;
+			cmsghdr *c = CMSG_FIRSTHDR(&h);
+			c->cmsg_level = SOL_UDP;
+			c->cmsg_type = UDP_SEGMENT;
+			c->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+			std::uint16_t segsz = static_cast<std::uint16_t>(first.size);
+			std::memcpy(CMSG_DATA(c), &segsz, sizeof(segsz));
+		}
+#endif
+		firstItem[msg] = i;
+		segments[msg] = j - i;
+		++msg;
+		i = j;
+	}
+	return msg;
+}
+
+std::size_t DGramSocket::flushQueue() {
+	lastError = 0;
+	if (sndQueue == nullptr || sndQueue->items.empty()) return 0;
+	SendQueue &q = *sndQueue;
+	std::size_t cnt = q.items.size();
+	q.msgs.resize(cnt);
+	q.iov.resize(cnt);
+	q.firstItem.resize(cnt);
+	q.segments.resize(cnt);
+	q.ctrl.resize(gso?cnt * CMSG_SPACE(sizeof(std::uint16_t)):0);
+	std::size_t nmsgs = q.prepare(0, 0, gso, 0);
+	std::size_t pos = 0;
+	std::size_t sent = 0;
+	while (pos < nmsgs) {
+		int r = ::sendmmsg(s, q.msgs.data() + pos, static_cast<unsigned int>(nmsgs - pos), 0);
+		if (r < 0) {
+			int err = errno;
+			if (err == EWOULDBLOCK) {
+				if (!waitWritable(s, writetm)) {
+					lastError = ETIMEDOUT;
+					break;
+				}
+			} else if (err == EINTR) {
+				continue;
+			} else if (q.segments[pos] > 1 && (err == EMSGSIZE || err == EIO || err == EINVAL)) {
+				//segment doesn't fit to the path MTU or the device can't segment it,
+				//send the batch and following datagrams again without segmentation
+				std::size_t item = q.firstItem[pos];
+				nmsgs = q.prepare(pos, item, gso, item + q.segments[pos]);
+			} else {
+				//datagram rejected, skip it
+				lastError = err;
+				pos++;
+			}
+		} else {
+			for (std::size_t i = pos, e = pos + r; i < e; i++) sent += q.segments[i];
+			pos += r;
+		}
+	}
+	q.items.clear();
+	q.data.clear();
+	return sent;
+}
+
+}
@@ -12,6 +12,7 @@
 #include <type_traits>
 #include <vector>
 #include <chrono>
+#include <memory>
 #include "async_provider.h"
 #include "platform_def.h"
 
@@ -90,9 +91,108 @@ public:
 	 *
 	 * @param data data to send
 	 * @param target target
+	 *
+	 * @exception std::system_error failed to send, or socket was not writable within write
+	 * timeout (ETIMEDOUT)
 	 */
 	void send(const std::string_view &data, const NetAddr &target);
 
+	///Prepares the socket to receive datagrams in batches
+	/**
+	 * Allocates a ring of buffers, which is filled by single system call (recvmmsg).
+	 *
+	 * @param count maximum count of datagrams received by single call
+	 * @param size size of buffer for single datagram. Larger datagrams are discarded
+	 * @param gro enable generic receive offload (UDP_GRO). The kernel can coalesce
+	 * datagrams from the same peer into single buffer, which is split to original
+	 * datagrams by recvBatch(). The buffer size is extended to 64KB. If the
+	 * platform doesn't support the feature, the argument is ignored
+	 */
+	void setRecvBatch(unsigned int count, std::size_t size = 2048, bool gro = false);
+
+	///Receives a batch of datagrams
+	/**
+	 * @param timeout timeout to wait on data (default is infinity)
+	 * @return count of received datagrams, 0 when timeout ellapsed. Datagrams are
+	 * retrieved by getData(idx) and getPeerAddr(idx)
+	 *
+	 * @note if the batch is not prepared by setRecvBatch(), the function prepares batch of 64 datagrams
+	 */
+	unsigned int recvBatch(int timeout = -1);
+
+	///Retrieves a datagram received by the last recvBatch()
+	/**
+	 * @param idx index of datagram
+	 * @return data of the datagram. Returns empty buffer for discarded datagram
+	 */
+	std::string_view getData(unsigned int idx) const;
+
+	///Retrieves peer address of a datagram received by the last recvBatch()
+	NetAddr getPeerAddr(unsigned int idx) const;
+
+	///Reads a batch asynchronously
+	/**
+	 * @param aprovider async provider
+	 * @param cb callback function. It receives count of datagrams in the batch, or 0 in
+	 * case of timeout. Use getData(idx) and getPeerAddr(idx) to retrieve datagrams
+	 * @param timeout timeout
+	 */
+	template<typename Fn, typename = decltype(std::declval<Fn>()(std::declval<unsigned int>()))>
+	void readBatchAsync(AsyncProvider aprovider, Fn &&cb, int timeout = -1);
+
+	///Reads a batch asynchronously
+	/** @copydetails readBatchAsync(AsyncProvider, Fn &&, int) */
+	template<typename Fn, typename = decltype(std::declval<Fn>()(std::declval<unsigned int>()))>
+	void readBatchAsync(Fn &&cb, int timeout = -1);
+
+	///Enables generic segmentation offload (UDP_SEGMENT) for queued datagrams
+	/**
+	 * When enabled, consecutive queued datagrams for the same target having the same size
+	 * are passed to the kernel as single buffer, which is split to datagrams by
+	 * the kernel or by the network card
+	 *
+	 * @retval true enabled
+	 * @retval false not supported by the platform
+	 */
+	bool enableGSO(bool enable = true);
+
+	///Queues datagram to be sent by flushQueue()
+	/**
+	 * Data are copied to the send queue.
+	 * @param data data to send
+	 * @param target target
+	 * @retval true queue is full, call flushQueue()
+	 * @retval false datagram queued
+	 */
+	bool queue(const std::string_view &data, const NetAddr &target);
+
+	///Sends all queued datagrams
+	/** Datagrams are sent by as few system calls as possible (sendmmsg). A datagram
+	 * rejected by the kernel is skipped and the rest of the queue is sent. A batch
+	 * rejected with EMSGSIZE or EIO when GSO is enabled is sent again without segmentation.
+	 * When the socket is not writable within the write timeout, remaining datagrams are
+	 * dropped. The queue is always empty after return
+	 *
+	 * @return count of datagrams sent. Use getLastError() to retrieve reason, why
+	 * some datagrams were not sent
+	 */
+	std::size_t flushQueue();
+
+	///Retrieves error of the last flushQueue()
+	/**
+	 * @return error code (errno) of the last datagram which was not sent, ETIMEDOUT when
+	 * write timeout ellapsed, or 0 when all datagrams were sent
+	 */
+	int getLastError() const {return lastError;}
+
+	///Sets timeout to wait for the socket to be writable, in milliseconds. -1 is infinity
+	/** Default value is 30 seconds. Used by send() and flushQueue() */
+	void setWrTimeout(int tm) {writetm = tm;}
+	///Retrieves write timeout
+	int getWrTimeout() const {return writetm;}
+
+	///Maximum count of datagrams in the send queue (default 64)
+	static unsigned int maxQueuedDGrams;
 
 protected:
 	SocketHandle s;
@@ -100,6 +200,14 @@ protected:
 	std::vector<char> addrBuffer;
 	int rcvsize = 0;
 
+	struct RecvBatch;
+	struct SendQueue;
+	std::unique_ptr<RecvBatch> rcvBatch;
+	std::unique_ptr<SendQueue> sndQueue;
+	bool gso = false;
+	int writetm = 30000;
+	int lastError = 0;
+
 	const SocketResource &getReadAsync() ;
 
 };
@@ -124,6 +232,25 @@ void DGramSocket::readAsync(Fn &&cb, int timeout) {
 	readAsync(getCurrentAsyncProvider(), std::move(cb), timeout);
 }
 
+template<typename Fn, typename>
+void DGramSocket::readBatchAsync(AsyncProvider aprovider, Fn &&cb, int timeout) {
+	aprovider.runAsync(getReadAsync(), [this,aprovider,timeout,fn = std::move(cb)](bool succ){
+		if (!succ) fn(0U);
+		else {
+			unsigned int cnt = recvBatch(0);
+			if (cnt) fn(cnt);
+			else readBatchAsync(aprovider, std::move(fn), timeout);
+		}
+	},  timeout < 0?
+			 std::chrono::system_clock::time_point::max():
+			 std::chrono::system_clock::now() + std::chrono::milliseconds(timeout));
+}
+
+template<typename Fn, typename>
+void DGramSocket::readBatchAsync(Fn &&cb, int timeout) {
+	readBatchAsync(getCurrentAsyncProvider(), std::move(cb), timeout);
+}
+
 }
 
 
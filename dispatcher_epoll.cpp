@@ -24,6 +24,7 @@ namespace userver {
 
 Dispatcher_EPoll::Dispatcher_EPoll() {
 	stopped.store(false);
+	intr.store(false);
 	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 	if (epoll_fd < 0) {
 		int e = errno;
@@ -196,6 +197,9 @@ Dispatcher_EPoll::Task Dispatcher_EPoll::getTask() {
 					rearm_fd(false, fd, regs);
 					return tsk;
 				}
+			} else {
+				//interrupt has been delivered, allow next one
+				intr.store(false);
 			}
 		}
 	}
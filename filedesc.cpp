@@ -8,24 +8,111 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <userver/async_provider.h>
 #include "filedesc.h"
+#include <atomic>
 #include <cerrno>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
 #include <system_error>
 #include <sstream>
+#include <thread>
+#include <vector>
 #include "socketresource.h"
 
 namespace userver  {
 
+unsigned int FileDesc::ioThreads = 2;
+std::size_t FileDesc::readAhead = 256*1024;
+
+///Thread pool which performs blocking operations on regular files
+class FileIOPool {
+public:
+	using Action = CallbackT<void()>;
+
+	static FileIOPool &getInstance() {
+		static FileIOPool inst;
+		return inst;
+	}
+
+	void run(Action &&action) {
+		std::unique_lock _(lock);
+		if (threads.empty()) {
+			unsigned int cnt = std::max(FileDesc::ioThreads, 1U);
+			for (unsigned int i = 0; i < cnt; i++) threads.emplace_back([this]{worker();});
+		}
+		queue.push(std::move(action));
+		cond.notify_one();
+	}
+
+	~FileIOPool() {
+		{
+			std::unique_lock _(lock);
+			exit = true;
+			cond.notify_all();
+		}
+		for (auto &t: threads) t.join();
+	}
+
+protected:
+	std::mutex lock;
+	std::condition_variable cond;
+	std::queue<Action> queue;
+	std::vector<std::thread> threads;
+	bool exit = false;
+
+	void worker() {
+		std::unique_lock _(lock);
+		while (true) {
+			cond.wait(_, [&]{return exit || !queue.empty();});
+			if (queue.empty()) break;
+			Action a = std::move(queue.front());
+			queue.pop();
+			_.unlock();
+			a();
+			_.lock();
+		}
+	}
+};
+
+struct FileDesc::PoolState {
+	///duplicated descriptor, shares file position with the original descriptor
+	int fd;
+	///asynchronous operation failed
+	std::atomic<bool> error = false;
+
+	PoolState(int fd):fd(::dup(fd)) {
+		if (this->fd < 0) throw std::system_error(errno, std::generic_category(), "Can't duplicate file descriptor");
+	}
+	~PoolState() {
+		::close(fd);
+	}
+	PoolState(const PoolState &) = delete;
+	PoolState &operator=(const PoolState &) = delete;
+};
+
 FileDesc::FileDesc() {
 }
 
 FileDesc::FileDesc(int fd):fd(fd) {
-	int flags = fcntl(fd, F_GETFL, 0);
-	if (fcntl(fd, F_SETFL, flags | O_NONBLOCK)) throw std::system_error(errno, std::generic_category(), "Can't set non-blocking mode");
+	struct stat st;
+	regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+	if (regular) {
+		//nonblocking mode has no effect on regular files, only announce sequential access
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	} else {
+		int flags = fcntl(fd, F_GETFL, 0);
+		if (fcntl(fd, F_SETFL, flags | O_NONBLOCK)) throw std::system_error(errno, std::generic_category(), "Can't set non-blocking mode");
+	}
 }
 
-FileDesc::FileDesc(FileDesc &&other):fd(other.fd) {
+FileDesc::FileDesc(FileDesc &&other)
+	:fd(other.fd),readtm(other.readtm),writetm(other.writetm),regular(other.regular)
+	,poolState(std::move(other.poolState)) {
 	other.fd = -1;
 }
 
@@ -39,6 +126,8 @@ void FileDesc::waitConnect(int , CallbackT<void(bool)> &&cb) {
 
 void FileDesc::close() {
 	if (fd != -1) ::close(fd);
+	//pending operations keep their own descriptor
+	poolState.reset();
 }
 
 FileDesc::~FileDesc() {
@@ -49,7 +138,11 @@ FileDesc::~FileDesc() {
 FileDesc& FileDesc::operator =(FileDesc &&other) {
 	close();
 	fd = other.fd;
-	other.fd = 0;
+	readtm = other.readtm;
+	writetm = other.writetm;
+	regular = other.regular;
+	poolState = std::move(other.poolState);
+	other.fd = -1;
 	return *this;
 }
 
@@ -128,11 +221,42 @@ int FileDesc::getWrTimeout() const {
 
 
 bool FileDesc::timeouted() const {
-	return tm;
+	return tm || (poolState != nullptr && poolState->error.load(std::memory_order_relaxed));
 }
 
 
+FileDesc::PoolState &FileDesc::getPoolState() {
+	if (poolState == nullptr) poolState = std::make_shared<PoolState>(fd);
+	return *poolState;
+}
+
+void FileDesc::adviseReadAhead(int fd) {
+#ifdef POSIX_FADV_WILLNEED
+	if (readAhead) {
+		off_t pos = lseek(fd, 0, SEEK_CUR);
+		if (pos >= 0) posix_fadvise(fd, pos, readAhead, POSIX_FADV_WILLNEED);
+	}
+#endif
+}
+
 void FileDesc::read(void *buffer, std::size_t size, CallbackT<void(int)> &&fn) {
+	if (regular) {
+		getPoolState();
+		FileIOPool::getInstance().run([st = poolState, buffer, size, fn = std::move(fn), prov = getCurrentAsyncProvider()]() mutable {
+			int r = ::read(st->fd, buffer, size);
+			if (r < 0) {
+				//reported as timeout, so the error is not confused with end of file
+				st->error.store(true, std::memory_order_relaxed);
+				r = 0;
+			} else {
+				adviseReadAhead(st->fd);
+			}
+			prov.runAsync([fn = std::move(fn), r]{
+				fn(r);
+			});
+		});
+		return;
+	}
 	int r = ::read(fd, buffer,size);
 	if (r < 0) {
 		int err = errno;
@@ -157,6 +281,20 @@ void FileDesc::read(void *buffer, std::size_t size, CallbackT<void(int)> &&fn) {
 }
 
 void FileDesc::write(const void *buffer, std::size_t size, CallbackT<void(int)> &&fn) {
+	if (regular) {
+		getPoolState();
+		FileIOPool::getInstance().run([st = poolState, buffer, size, fn = std::move(fn), prov = getCurrentAsyncProvider()]() mutable {
+			int r = ::write(st->fd, buffer, size);
+			if (r < 0) {
+				st->error.store(true, std::memory_order_relaxed);
+				r = 0;
+			}
+			prov.runAsync([fn = std::move(fn), r]{
+				fn(r);
+			});
+		});
+		return;
+	}
 	int r = ::write(fd, buffer, size);
 	if (r < 0) {
 		int err = errno;
@@ -183,6 +321,15 @@ void FileDesc::write(const void *buffer, std::size_t size, CallbackT<void(int)>
 	}
 }
 
+bool FileDesc::cancelAsyncRead(bool set_timeouted) {
+	if (regular) return false;
+	return getCurrentAsyncProvider()->stopWait(SocketResource(SocketResource::read, fd), set_timeouted);
+}
+
+bool FileDesc::cancelAsyncWrite(bool set_timeouted) {
+	if (regular) return false;
+	return getCurrentAsyncProvider()->stopWait(SocketResource(SocketResource::write, fd), set_timeouted);
+}
 
 bool FileDesc::waitForRead(int tm) const {
 	pollfd pfd = {fd, POLLIN, 0};
@@ -207,6 +354,7 @@ bool FileDesc::waitForWrite(int tm) const {
 
 void FileDesc::clearTimeout() {
 	tm = false;
+	if (poolState != nullptr) poolState->error.store(false, std::memory_order_relaxed);
 }
 
 
@@ -7,13 +7,31 @@
 
 #ifndef SRC_USERVER_FILEDESC_H_
 #define SRC_USERVER_FILEDESC_H_
+#include <memory>
 #include "isocket.h"
 
 
 namespace userver {
 
+///File descriptor as ISocket
+/**
+ * Pipes and character devices are handled through the dispatcher. Regular files are always
+ * ready, so asynchronous operations on them are performed by a small dedicated thread pool,
+ * which is started on first use. Sequential access is announced to the kernel, so the
+ * file is read ahead while the data are being sent.
+ *
+ * When an asynchronous operation on a regular file fails, the callback receives 0 and
+ * timeouted() returns true, so the failure can be distinguished from end of file. Pending
+ * operations keep the file open even if the object is destroyed
+ */
 class FileDesc: public ISocket {
 public:
+	///Count of threads performing asynchronous I/O on regular files
+	/** Must be set before the first asynchronous operation */
+	static unsigned int ioThreads;
+	///Size of the readahead hint issued after each asynchronous read of a regular file. Set 0 to disable
+	static std::size_t readAhead;
+
 	FileDesc();
 	FileDesc(int fd);
 	virtual ~FileDesc() override;
@@ -25,6 +43,10 @@ public:
 	int write(const void *buffer, std::size_t size) override;
 	void read(void *buffer, std::size_t size, CallbackT<void(int)> &&fn) override;
 	void write(const void *buffer, std::size_t size, CallbackT<void(int)> &&fn) override;
+	///Cancels asynchronous read. Operations on regular files can't be canceled
+	bool cancelAsyncRead(bool set_timeouted = true) override;
+	///Cancels asynchronous write. Operations on regular files can't be canceled
+	bool cancelAsyncWrite(bool set_timeouted = true) override;
 
 	void closeOutput() override;
 	void closeInput() override;
@@ -45,16 +67,28 @@ public:
 	bool waitForWrite(int tm) const;
 
 	int getHandle() const {return fd;}
+	///Returns true, if the descriptor refers to a regular file
+	bool isRegular() const {return regular;}
 
 	virtual void clearTimeout() override;
 
 
 	void close();
 protected:
+	///State of a regular file shared with operations running in the thread pool
+	struct PoolState;
+
 	int fd=-1;
 	int readtm=-1;
 	int writetm=-1;
 	bool tm = false;
+	bool regular = false;
+	///created by first asynchronous operation on a regular file
+	std::shared_ptr<PoolState> poolState;
+
+	PoolState &getPoolState();
+
+	static void adviseReadAhead(int fd);
 };
 
 
@@ -0,0 +1,253 @@
+/*
+ * format.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_USERVER_FORMAT_H_
+#define SRC_USERVER_FORMAT_H_
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+#ifdef __cpp_consteval
+#define USERVER_CONSTEVAL consteval
+#else
+#define USERVER_CONSTEVAL constexpr
+#endif
+
+namespace userver {
+
+///Size of buffer which is always enough to format any integer by formatUnsigned or formatSigned (without padding)
+static constexpr std::size_t maxIntegerChars = 8*sizeof(unsigned long long)+1;
+///Size of buffer which is always enough to format a double by formatDouble
+static constexpr std::size_t maxDoubleChars = 64;
+
+///Format unsigned number to the buffer
+/**
+ * @param beg begin of the buffer
+ * @param end end of the buffer
+ * @param x number to format
+ * @param base base (2-62). Digits above 9 are A-Z and then a-z
+ * @param digits minimal count of digits, number is padded by zeroes
+ * @param upper set false to use lowercase letters for bases up to 36
+ * @return pointer after last written character. If the buffer is too small, the number is not written
+ */
+template<typename T>
+inline char *formatUnsigned(char *beg, char *end, T x, unsigned int base = 10, unsigned int digits = 1, bool upper = true) {
+	using U = std::make_unsigned_t<T>;
+	U v = static_cast<U>(x);
+	char *p;
+	if (base >= 2 && base <= 36) {
+		auto r = std::to_chars(beg, end, v, base);
+		if (r.ec != std::errc()) return beg;
+		p = r.ptr;
+		if (upper && base > 10) {
+			for (char *c = beg; c != p; ++c) if (*c >= 'a') *c -= 'a' - 'A';
+		}
+	} else if (base > 36 && base <= 62) {
+		char tmp[maxIntegerChars];
+		char *c = std::end(tmp);
+		do {
+			unsigned int s = static_cast<unsigned int>(v % base);
+			v /= base;
+			*--c = static_cast<char>(s < 10?s+'0':s < 36?s+'A'-10:s+'a'-36);
+		} while (v);
+		if (std::end(tmp) - c > end - beg) return beg;
+		p = std::copy(c, std::end(tmp), beg);
+	} else {
+		return beg;
+	}
+	std::size_t len = p - beg;
+	if (len < digits) {
+		std::size_t w = std::min<std::size_t>(digits, end - beg);
+		std::move_backward(beg, p, beg + w);
+		std::fill(beg, beg + w - len, '0');
+		p = beg + w;
+	}
+	return p;
+}
+
+///Format signed number to the buffer
+/**
+ * @copydetails formatUnsigned
+ */
+template<typename T>
+inline char *formatSigned(char *beg, char *end, T x, unsigned int base = 10, unsigned int digits = 1, bool upper = true) {
+	using U = std::make_unsigned_t<T>;
+	if (std::is_signed_v<T> && x < T(0)) {
+		if (beg == end) return beg;
+		*beg = '-';
+		char *p = formatUnsigned(beg+1, end, static_cast<U>(U(0) - static_cast<U>(x)), base, digits, upper);
+		return p == beg+1?beg:p;
+	} else {
+		return formatUnsigned(beg, end, static_cast<U>(x), base, digits, upper);
+	}
+}
+
+///Format floating point number to the buffer
+/**
+ * @param beg begin of the buffer
+ * @param end end of the buffer
+ * @param x number to format
+ * @param precision count of decimal places. Negative value selects shortest representation
+ * which reads back to the same number.
+ * @return pointer after last written character
+ *
+ * @note Number, which doesn't fit to the buffer in fixed notation, is written in exponential notation
+ */
+inline char *formatDouble(char *beg, char *end, double x, int precision = -1) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	std::to_chars_result r;
+	if (precision < 0) r = std::to_chars(beg, end, x);
+	else {
+		r = std::to_chars(beg, end, x, std::chars_format::fixed, precision);
+		if (r.ec != std::errc()) r = std::to_chars(beg, end, x, std::chars_format::general, precision);
+	}
+	return r.ec == std::errc()?r.ptr:beg;
+#else
+	std::size_t sz = end - beg;
+	int r = precision < 0?std::snprintf(beg, sz, "%.17g", x):std::snprintf(beg, sz, "%.*f", precision, x);
+	if (r >= 0 && static_cast<std::size_t>(r) >= sz) r = std::snprintf(beg, sz, "%.*g", precision < 0?17:precision, x);
+	if (r < 0 || static_cast<std::size_t>(r) >= sz) return beg;
+	return beg + r;
+#endif
+}
+
+///Escape string
+/**
+ * Escapes quotes, backslashes and control characters, so result can be used as content of
+ * JSON string. Characters above 0x7F are not modified.
+ *
+ * @param text text to escape
+ * @param out function which receives result as sequence of std::string_view. Parts of the
+ * text which don't need escaping are passed directly without copying
+ */
+template<typename Fn>
+inline void escapeString(const std::string_view &text, Fn &&out) {
+	static const char hexChars[] = "0123456789ABCDEF";
+	std::size_t b = 0, cnt = text.length();
+	for (std::size_t i = 0; i < cnt; i++) {
+		unsigned char c = static_cast<unsigned char>(text[i]);
+		if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7F) continue;
+		if (i > b) out(text.substr(b, i-b));
+		b = i+1;
+		switch (c) {
+			case '"': out("\\\""); break;
+			case '\\': out("\\\\"); break;
+			case '\n': out("\\n"); break;
+			case '\r': out("\\r"); break;
+			case '\t': out("\\t"); break;
+			case '\b': out("\\b"); break;
+			case '\f': out("\\f"); break;
+			default: {
+				char buff[6] = {'\\','u','0','0',hexChars[c >> 4],hexChars[c & 0xF]};
+				out(std::string_view(buff, sizeof(buff)));
+			}
+		}
+	}
+	if (cnt > b) out(text.substr(b));
+}
+
+///Classifies argument of format function
+/**
+ * @retval 'b' boolean
+ * @retval 'c' character
+ * @retval 'i' integer
+ * @retval 'f' floating point
+ * @retval 's' string
+ * @retval 0 not supported
+ */
+template<typename T>
+constexpr char formatArgClass() {
+	using U = std::decay_t<T>;
+	if constexpr(std::is_same_v<U, bool>) return 'b';
+	else if constexpr(std::is_same_v<U, char>) return 'c';
+	else if constexpr(std::is_integral_v<U>) return 'i';
+	else if constexpr(std::is_floating_point_v<U>) return 'f';
+	else if constexpr(std::is_convertible_v<const U &, std::string_view>) return 's';
+	else return 0;
+}
+
+///Determines whether format specifier accepts argument of given class
+constexpr bool formatSpecAccepts(char spec, char cls) {
+	switch (spec) {
+		case 's': return cls != 0;
+		case 'd':
+		case 'x':
+		case 'X': return cls == 'i';
+		case 'f': return cls == 'f' || cls == 'i';
+		case 'q': return cls == 's' || cls == 'c';
+		case 'c': return cls == 'c';
+		default: return false;
+	}
+}
+
+inline void invalidFormatString() {
+	throw std::invalid_argument("Format string doesn't match arguments");
+}
+
+///Format string for Stream::format()
+/**
+ * Format string contains text and placeholders. Each placeholder is replaced by
+ * an argument in order of appearance
+ *
+ * - %s - any argument, default representation
+ * - %d - integer, decimal
+ * - %x, %X - integer, hexadecimal (lowercase, uppercase)
+ * - %f - number, floating point
+ * - %q - string or character, escaped (see escapeString())
+ * - %c - character
+ * - %% - character '%'
+ *
+ * Placeholder can contain a decimal number after the '%'. For integers, it specifies
+ * minimal count of digits (padded by zeroes). For floating point numbers, it specifies count
+ * of decimal places.
+ *
+ * Format string is checked against types of arguments. When compiled as C++20, the check is
+ * performed during compilation. Otherwise the check is done during construction in debug
+ * builds only and std::invalid_argument is thrown when check fails. Release builds (NDEBUG)
+ * don't parse the format string twice, mismatched placeholders are formatted using default
+ * representation of the argument and placeholders without an argument are written
+ * as they are. You can force compile time check by declaring the format
+ * string as constexpr variable.
+ *
+ * @tparam Args types of arguments
+ */
+template<typename ... Args>
+class FormatString {
+public:
+	template<std::size_t N>
+	USERVER_CONSTEVAL FormatString(const char (&str)[N]):str(str, N-1) {
+#if defined(__cpp_consteval) || !defined(NDEBUG)
+		if (!check(this->str)) invalidFormatString();
+#endif
+	}
+
+	const std::string_view str;
+
+	static constexpr bool check(const std::string_view &str) {
+		constexpr char classes[] = {formatArgClass<Args>()..., 0};
+		std::size_t idx = 0, pos = 0, len = str.length();
+		while (pos < len) {
+			if (str[pos++] != '%') continue;
+			if (pos < len && str[pos] == '%') {
+				++pos;
+				continue;
+			}
+			while (pos < len && str[pos] >= '0' && str[pos] <= '9') ++pos;
+			if (pos == len || idx == sizeof...(Args)) return false;
+			if (!formatSpecAccepts(str[pos++], classes[idx++])) return false;
+		}
+		return idx == sizeof...(Args);
+	}
+};
+
+}
+
+#endif /* SRC_USERVER_FORMAT_H_ */
@@ -10,6 +10,55 @@
 
 namespace userver {
 
+///Well known headers
+/** These headers are indexed during parsing of the request, so they can be retrieved
+ * in constant time. Response headers in the list are recognized without string comparisons */
+enum class KnownHeader: unsigned char {
+	accept,
+	accept_encoding,
+	accept_language,
+	authorization,
+	cache_control,
+	connection,
+	content_encoding,
+	content_length,
+	content_type,
+	cookie,
+	date,
+	etag,
+	expect,
+	forwarded,
+	host,
+	if_match,
+	if_modified_since,
+	if_none_match,
+	keep_alive,
+	last_modified,
+	origin,
+	pragma,
+	range,
+	referer,
+	sec_websocket_key,
+	sec_websocket_protocol,
+	sec_websocket_version,
+	server,
+	te,
+	trailer,
+	transfer_encoding,
+	upgrade,
+	user_agent,
+	via,
+	x_forwarded_for,
+	x_forwarded_host,
+	x_forwarded_proto,
+	x_real_ip,
+	x_request_id,
+	///count of well known headers
+	count,
+	///header is not well known
+	unknown = count
+};
+
 class HeaderValue: public std::string_view {
 public:
 	HeaderValue(const std::string_view &s):std::string_view(s) {}
@@ -35,6 +84,21 @@ public:
 	static bool lessHeader(const std::pair<std::string_view, std::string_view> &a,
 			const std::pair<std::string_view, std::string_view> &b);
 	static bool iequal(const std::string_view &a, const std::string_view &b);
+	///Classifies header name
+	/**
+	 * @param name name of header (case insensitive)
+	 * @return well known header, or KnownHeader::unknown
+	 */
+	static KnownHeader classify(const std::string_view &name);
+	///Retrieves name of well known header
+	static std::string_view getName(KnownHeader h);
+	///Retrieves separator used to join values of repeated well known header
+	/**
+	 * @param h well known header
+	 * @return ", " for headers defined as list, "; " for Cookie. Returns empty string for
+	 * headers, which can't be repeated, only the first occurrence of such header is used
+	 */
+	static std::string_view getListSeparator(KnownHeader h);
 };
 
 
@@ -13,6 +13,7 @@
 #include <string_view>
 #include <stdexcept>
 #include <cctype>
+#include <cstring>
 #include <ctime>
 #include "callback.h"
 #include <mutex>
@@ -37,6 +38,31 @@ T splitAt(const U &search, T &object) {
 }
 
 
+///Search for a separator in a buffer
+/**
+ * Uses memchr() for single byte separators and memmem() for longer separators where it is
+ * available. Both are vectorized in common C libraries, so this is faster than std::string_view::find
+ *
+ * @param data searched data
+ * @param sep separator
+ * @param pos starting position
+ * @return position of the separator or std::string_view::npos
+ */
+inline std::size_t findSeparator(const std::string_view &data, const std::string_view &sep, std::size_t pos = 0) {
+	if (pos > data.length()) return data.npos;
+	if (sep.length() == 1) {
+		const void *p = std::memchr(data.data()+pos, sep[0], data.length()-pos);
+		return p?static_cast<const char *>(p) - data.data():data.npos;
+	}
+#ifdef _WIN32
+	return data.find(sep, pos);
+#else
+	if (sep.empty()) return pos;
+	const void *p = memmem(data.data()+pos, data.length()-pos, sep.data(), sep.length());
+	return p?static_cast<const char *>(p) - data.data():data.npos;
+#endif
+}
+
 template<typename T>
 T splitAtIndex(std::size_t index, T &object) {
 	auto l = object.size();
@@ -0,0 +1,322 @@
+/*
+ * hpack.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include "hpack.h"
+
+namespace userver {
+
+namespace {
+
+constexpr std::pair<std::string_view, std::string_view> staticTable[] = {
+	{":authority",""},
+	{":method","GET"},
+	{":method","POST"},
+	{":path","/"},
+	{":path","/index.html"},
+	{":scheme","http"},
+	{":scheme","https"},
+	{":status","200"},
+	{":status","204"},
+	{":status","206"},
+	{":status","304"},
+	{":status","400"},
+	{":status","404"},
+	{":status","500"},
+	{"accept-charset",""},
+	{"accept-encoding","gzip, deflate"},
+	{"accept-language",""},
+	{"accept-ranges",""},
+	{"accept",""},
+	{"access-control-allow-origin",""},
+	{"age",""},
+	{"allow",""},
+	{"authorization",""},
+	{"cache-control",""},
+	{"content-disposition",""},
+	{"content-encoding",""},
+	{"content-language",""},
+	{"content-length",""},
+	{"content-location",""},
+	{"content-range",""},
+	{"content-type",""},
+	{"cookie",""},
+	{"date",""},
+	{"etag",""},
+	{"expect",""},
+	{"expires",""},
+	{"from",""},
+	{"host",""},
+	{"if-match",""},
+	{"if-modified-since",""},
+	{"if-none-match",""},
+	{"if-range",""},
+	{"if-unmodified-since",""},
+	{"last-modified",""},
+	{"link",""},
+	{"location",""},
+	{"max-forwards",""},
+	{"proxy-authenticate",""},
+	{"proxy-authorization",""},
+	{"range",""},
+	{"referer",""},
+	{"refresh",""},
+	{"retry-after",""},
+	{"server",""},
+	{"set-cookie",""},
+	{"strict-transport-security",""},
+	{"transfer-encoding",""},
+	{"user-agent",""},
+	{"vary",""},
+	{"via",""},
+	{"www-authenticate",""},
+};
+
+constexpr std::size_t staticTableSize = sizeof(staticTable)/sizeof(staticTable[0]);
+
+///Huffman code of each symbol (code, bit length), symbol 256 is EOS
+constexpr std::pair<std::uint32_t, unsigned char> huffmanCodes[257] = {
+	{0x1ff8,13}, {0x7fffd8,23}, {0xfffffe2,28}, {0xfffffe3,28}, {0xfffffe4,28}, {0xfffffe5,28}, {0xfffffe6,28}, {0xfffffe7,28},
+	{0xfffffe8,28}, {0xffffea,24}, {0x3ffffffc,30}, {0xfffffe9,28}, {0xfffffea,28}, {0x3ffffffd,30}, {0xfffffeb,28}, {0xfffffec,28},
+	{0xfffffed,28}, {0xfffffee,28}, {0xfffffef,28}, {0xffffff0,28}, {0xffffff1,28}, {0xffffff2,28}, {0x3ffffffe,30}, {0xffffff3,28},
+	{0xffffff4,28}, {0xffffff5,28}, {0xffffff6,28}, {0xffffff7,28}, {0xffffff8,28}, {0xffffff9,28}, {0xffffffa,28}, {0xffffffb,28},
+	{0x14,6}, {0x3f8,10}, {0x3f9,10}, {0xffa,12}, {0x1ff9,13}, {0x15,6}, {0xf8,8}, {0x7fa,11},
+	{0x3fa,10}, {0x3fb,10}, {0xf9,8}, {0x7fb,11}, {0xfa,8}, {0x16,6}, {0x17,6}, {0x18,6},
+	{0x0,5}, {0x1,5}, {0x2,5}, {0x19,6}, {0x1a,6}, {0x1b,6}, {0x1c,6}, {0x1d,6},
+	{0x1e,6}, {0x1f,6}, {0x5c,7}, {0xfb,8}, {0x7ffc,15}, {0x20,6}, {0xffb,12}, {0x3fc,10},
+	{0x1ffa,13}, {0x21,6}, {0x5d,7}, {0x5e,7}, {0x5f,7}, {0x60,7}, {0x61,7}, {0x62,7},
+	{0x63,7}, {0x64,7}, {0x65,7}, {0x66,7}, {0x67,7}, {0x68,7}, {0x69,7}, {0x6a,7},
+	{0x6b,7}, {0x6c,7}, {0x6d,7}, {0x6e,7}, {0x6f,7}, {0x70,7}, {0x71,7}, {0x72,7},
+	{0xfc,8}, {0x73,7}, {0xfd,8}, {0x1ffb,13}, {0x7fff0,19}, {0x1ffc,13}, {0x3ffc,14}, {0x22,6},
+	{0x7ffd,15}, {0x3,5}, {0x23,6}, {0x4,5}, {0x24,6}, {0x5,5}, {0x25,6}, {0x26,6},
+	{0x27,6}, {0x6,5}, {0x74,7}, {0x75,7}, {0x28,6}, {0x29,6}, {0x2a,6}, {0x7,5},
+	{0x2b,6}, {0x76,7}, {0x2c,6}, {0x8,5}, {0x9,5}, {0x2d,6}, {0x77,7}, {0x78,7},
+	{0x79,7}, {0x7a,7}, {0x7b,7}, {0x7ffe,15}, {0x7fc,11}, {0x3ffd,14}, {0x1ffd,13}, {0xffffffc,28},
+	{0xfffe6,20}, {0x3fffd2,22}, {0xfffe7,20}, {0xfffe8,20}, {0x3fffd3,22}, {0x3fffd4,22}, {0x3fffd5,22}, {0x7fffd9,23},
+	{0x3fffd6,22}, {0x7fffda,23}, {0x7fffdb,23}, {0x7fffdc,23}, {0x7fffdd,23}, {0x7fffde,23}, {0xffffeb,24}, {0x7fffdf,23},
+	{0xffffec,24}, {0xffffed,24}, {0x3fffd7,22}, {0x7fffe0,23}, {0xffffee,24}, {0x7fffe1,23}, {0x7fffe2,23}, {0x7fffe3,23},
+	{0x7fffe4,23}, {0x1fffdc,21}, {0x3fffd8,22}, {0x7fffe5,23}, {0x3fffd9,22}, {0x7fffe6,23}, {0x7fffe7,23}, {0xffffef,24},
+	{0x3fffda,22}, {0x1fffdd,21}, {0xfffe9,20}, {0x3fffdb,22}, {0x3fffdc,22}, {0x7fffe8,23}, {0x7fffe9,23}, {0x1fffde,21},
+	{0x7fffea,23}, {0x3fffdd,22}, {0x3fffde,22}, {0xfffff0,24}, {0x1fffdf,21}, {0x3fffdf,22}, {0x7fffeb,23}, {0x7fffec,23},
+	{0x1fffe0,21}, {0x1fffe1,21}, {0x3fffe0,22}, {0x1fffe2,21}, {0x7fffed,23}, {0x3fffe1,22}, {0x7fffee,23}, {0x7fffef,23},
+	{0xfffea,20}, {0x3fffe2,22}, {0x3fffe3,22}, {0x3fffe4,22}, {0x7ffff0,23}, {0x3fffe5,22}, {0x3fffe6,22}, {0x7ffff1,23},
+	{0x3ffffe0,26}, {0x3ffffe1,26}, {0xfffeb,20}, {0x7fff1,19}, {0x3fffe7,22}, {0x7ffff2,23}, {0x3fffe8,22}, {0x1ffffec,25},
+	{0x3ffffe2,26}, {0x3ffffe3,26}, {0x3ffffe4,26}, {0x7ffffde,27}, {0x7ffffdf,27}, {0x3ffffe5,26}, {0xfffff1,24}, {0x1ffffed,25},
+	{0x7fff2,19}, {0x1fffe3,21}, {0x3ffffe6,26}, {0x7ffffe0,27}, {0x7ffffe1,27}, {0x3ffffe7,26}, {0x7ffffe2,27}, {0xfffff2,24},
+	{0x1fffe4,21}, {0x1fffe5,21}, {0x3ffffe8,26}, {0x3ffffe9,26}, {0xffffffd,28}, {0x7ffffe3,27}, {0x7ffffe4,27}, {0x7ffffe5,27},
+	{0xfffec,20}, {0xfffff3,24}, {0xfffed,20}, {0x1fffe6,21}, {0x3fffe9,22}, {0x1fffe7,21}, {0x1fffe8,21}, {0x7ffff3,23},
+	{0x3fffea,22}, {0x3fffeb,22}, {0x1ffffee,25}, {0x1ffffef,25}, {0xfffff4,24}, {0xfffff5,24}, {0x3ffffea,26}, {0x7ffff4,23},
+	{0x3ffffeb,26}, {0x7ffffe6,27}, {0x3ffffec,26}, {0x3ffffed,26}, {0x7ffffe7,27}, {0x7ffffe8,27}, {0x7ffffe9,27}, {0x7ffffea,27},
+	{0x7ffffeb,27}, {0xffffffe,28}, {0x7ffffec,27}, {0x7ffffed,27}, {0x7ffffee,27}, {0x7ffffef,27}, {0x7fffff0,27}, {0x3ffffee,26},
+	{0x3fffffff,30},
+};
+
+///Decoding tree built from the code table. Positive value is index of next node, negative value is -(symbol+1)
+class HuffmanTree {
+public:
+	HuffmanTree() {
+		int count = 1;
+		for (int sym = 0; sym < 257; sym++) {
+			auto [code, len] = huffmanCodes[sym];
+			int node = 0;
+			for (int b = len - 1; b > 0; b--) {
+				int bit = (code >> b) & 1;
+				if (nodes[node][bit] == 0) nodes[node][bit] = static_cast<short>(count++);
+				node = nodes[node][bit];
+			}
+			nodes[node][code & 1] = static_cast<short>(-(sym+1));
+		}
+	}
+
+	short nodes[256][2] = {};
+};
+
+bool decodeInt(const unsigned char *&p, const unsigned char *end, unsigned int prefix, std::uint64_t &out) {
+	std::uint64_t mask = (1U << prefix) - 1;
+	out = *p++ & mask;
+	if (out < mask) return true;
+	unsigned int shift = 0;
+	while (p < end && shift < 56) {
+		unsigned char b = *p++;
+		out += static_cast<std::uint64_t>(b & 0x7F) << shift;
+		shift += 7;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+bool decodeString(const unsigned char *&p, const unsigned char *end, std::string &out) {
+	if (p == end) return false;
+	bool huffman = (*p & 0x80) != 0;
+	std::uint64_t len;
+	if (!decodeInt(p, end, 7, len) || len > static_cast<std::uint64_t>(end - p)) return false;
+	std::string_view data(reinterpret_cast<const char *>(p), len);
+	p += len;
+	out.clear();
+	if (huffman) return huffmanDecode(data, out);
+	out.append(data);
+	return true;
+}
+
+void encodeInt(std::vector<char> &out, std::uint64_t value, unsigned int prefix, unsigned char flags) {
+	std::uint64_t mask = (1U << prefix) - 1;
+	if (value < mask) {
+		out.push_back(static_cast<char>(flags | value));
+		return;
+	}
+	out.push_back(static_cast<char>(flags | mask));
+	value -= mask;
+	while (value >= 0x80) {
+		out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+void encodeString(std::vector<char> &out, std::string_view str) {
+	encodeInt(out, str.size(), 7, 0);
+	out.insert(out.end(), str.begin(), str.end());
+}
+
+}
+
+bool huffmanDecode(std::string_view data, std::string &out) {
+	static const HuffmanTree tree;
+	int node = 0;
+	//count of bits since last symbol, all must be 1 (prefix of EOS) and less than 8
+	unsigned int padBits = 0;
+	bool padOnes = true;
+	for (char c: data) {
+		unsigned char b = static_cast<unsigned char>(c);
+		for (int i = 7; i >= 0; i--) {
+			int bit = (b >> i) & 1;
+			short nx = tree.nodes[node][bit];
+			padBits++;
+			padOnes = padOnes && bit;
+			if (nx < 0) {
+				int sym = -nx - 1;
+				if (sym == 256) return false;
+				out.push_back(static_cast<char>(sym));
+				node = 0;
+				padBits = 0;
+				padOnes = true;
+			} else if (nx == 0) {
+				return false;
+			} else {
+				node = nx;
+			}
+		}
+	}
+	return padBits < 8 && padOnes;
+}
+
+bool HPackDecoder::decode(std::string_view block, HeaderList &out, std::size_t maxListSize) {
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(block.data());
+	const unsigned char *end = p + block.size();
+	std::size_t listSize = 0;
+	std::string name, value;
+	out.clear();
+	while (p < end) {
+		unsigned char b = *p;
+		std::uint64_t index;
+		if (b & 0x80) {
+			//indexed header field
+			std::string_view n, v;
+			if (!decodeInt(p, end, 7, index) || !getEntry(index, n, v)) return false;
+			out.emplace_back(n, v);
+		} else if ((b & 0xE0) == 0x20) {
+			//dynamic table size update, allowed only at beginning of the block
+			if (!out.empty() || !decodeInt(p, end, 5, index) || index > maxAllowed) return false;
+			maxSize = index;
+			evict(maxSize);
+			continue;
+		} else {
+			//literal, with incremental indexing (6 bit prefix) or without indexing (4 bit prefix)
+			bool indexing = (b & 0xC0) == 0x40;
+			if (!decodeInt(p, end, indexing?6:4, index)) return false;
+			if (index) {
+				std::string_view n, v;
+				if (!getEntry(index, n, v)) return false;
+				name = n;
+			} else if (!decodeString(p, end, name)) {
+				return false;
+			}
+			if (!decodeString(p, end, value)) return false;
+			out.emplace_back(name, value);
+			if (indexing) add(std::move(name), std::move(value));
+		}
+		listSize += out.back().first.size() + out.back().second.size() + 32;
+		if (listSize > maxListSize) return false;
+	}
+	return true;
+}
+
+void HPackDecoder::add(std::string &&name, std::string &&value) {
+	std::size_t sz = name.size() + value.size() + 32;
+	if (sz > maxSize) {
+		//entry larger than table empties the table
+		evict(0);
+		return;
+	}
+	evict(maxSize - sz);
+	dynTable.emplace_front(std::move(name), std::move(value));
+	dynSize += sz;
+}
+
+void HPackDecoder::evict(std::size_t limit) {
+	while (dynSize > limit) {
+		const auto &e = dynTable.back();
+		dynSize -= e.first.size() + e.second.size() + 32;
+		dynTable.pop_back();
+	}
+}
+
+bool HPackDecoder::getEntry(std::uint64_t index, std::string_view &name, std::string_view &value) const {
+	if (index == 0) return false;
+	if (index <= staticTableSize) {
+		name = staticTable[index-1].first;
+		value = staticTable[index-1].second;
+		return true;
+	}
+	index -= staticTableSize + 1;
+	if (index >= dynTable.size()) return false;
+	name = dynTable[index].first;
+	value = dynTable[index].second;
+	return true;
+}
+
+void HPackEncoder::encodeStatus(unsigned int status, std::vector<char> &out) {
+	char buff[3] = {
+			static_cast<char>('0' + status / 100 % 10),
+			static_cast<char>('0' + status / 10 % 10),
+			static_cast<char>('0' + status % 10)
+	};
+	std::string_view code(buff, 3);
+	//entries 8-14 of the static table contain common status codes
+	for (std::size_t i = 7; i < 14; i++) {
+		if (staticTable[i].second == code) {
+			encodeInt(out, i+1, 7, 0x80);
+			return;
+		}
+	}
+	encodeInt(out, 8, 4, 0);
+	encodeString(out, code);
+}
+
+void HPackEncoder::encodeHeader(std::string_view name, std::string_view value, std::vector<char> &out) {
+	std::size_t index = 0;
+	for (std::size_t i = 14; i < staticTableSize; i++) {
+		if (staticTable[i].first == name) {
+			index = i+1;
+			break;
+		}
+	}
+	encodeInt(out, index, 4, 0);
+	if (!index) encodeString(out, name);
+	encodeString(out, value);
+}
+
+}
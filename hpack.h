@@ -0,0 +1,92 @@
+/*
+ * hpack.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_USERVER_HPACK_H_
+#define SRC_USERVER_HPACK_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace userver {
+
+///Decoder of HTTP/2 header blocks (RFC 7541)
+/**
+ * Object holds dynamic table of the connection, so one instance must be used to decode all
+ * header blocks received on the connection in order of arrival
+ */
+class HPackDecoder {
+public:
+
+	using HeaderList = std::vector<std::pair<std::string, std::string> >;
+
+	///Construct decoder
+	/**
+	 * @param maxTableSize maximum size of the dynamic table, as announced by SETTINGS_HEADER_TABLE_SIZE
+	 */
+	HPackDecoder(std::size_t maxTableSize = 4096):maxAllowed(maxTableSize),maxSize(maxTableSize) {}
+
+	///Decode header block
+	/**
+	 * @param block complete header block (all CONTINUATION frames joined)
+	 * @param out receives decoded headers in order of appearance. Previous content is cleared
+	 * @param maxListSize maximum size of decoded headers (as defined by SETTINGS_MAX_HEADER_LIST_SIZE)
+	 * @retval true success
+	 * @retval false compression error, the connection must be closed, because state of the
+	 * dynamic table is undefined
+	 */
+	bool decode(std::string_view block, HeaderList &out, std::size_t maxListSize = ~std::size_t(0));
+
+protected:
+
+	std::deque<std::pair<std::string, std::string> > dynTable;
+	std::size_t dynSize = 0;
+	std::size_t maxAllowed;
+	std::size_t maxSize;
+
+	void add(std::string &&name, std::string &&value);
+	void evict(std::size_t limit);
+	bool getEntry(std::uint64_t index, std::string_view &name, std::string_view &value) const;
+
+};
+
+///Encoder of HTTP/2 header blocks (RFC 7541)
+/**
+ * Encoder doesn't use the dynamic table, so it has no state and it doesn't depend on
+ * SETTINGS_HEADER_TABLE_SIZE of the peer. Names of the static table are referenced by index, the rest is
+ * written as literal without indexing
+ */
+class HPackEncoder {
+public:
+	///Encode :status pseudo header
+	static void encodeStatus(unsigned int status, std::vector<char> &out);
+	///Encode header field
+	/**
+	 * @param name name of the field. It must be in lower case
+	 * @param value value
+	 * @param out output buffer, data are appended
+	 */
+	static void encodeHeader(std::string_view name, std::string_view value, std::vector<char> &out);
+};
+
+///Decode Huffman encoded string (RFC 7541 Appendix B)
+/**
+ * @param data encoded string
+ * @param out decoded string is appended here
+ * @retval true success
+ * @retval false invalid encoding
+ */
+bool huffmanDecode(std::string_view data, std::string &out);
+
+}
+
+
+
+#endif /* SRC_USERVER_HPACK_H_ */
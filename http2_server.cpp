@@ -0,0 +1,1072 @@
+/*
+ * http2_server.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include "http2_server.h"
+#include "format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace userver {
+
+std::uint32_t Http2Connection::maxConcurrentStreams = 64;
+std::uint32_t Http2Connection::streamWindowSize = 256*1024;
+std::uint32_t Http2Connection::connWindowSize = 16*1024*1024;
+std::uint32_t Http2Connection::maxHeaderListSize = 65536;
+std::size_t Http2Connection::streamBufferSize = 65536;
+
+namespace {
+
+constexpr std::string_view connPreface("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+///SETTINGS_MAX_FRAME_SIZE of the server (default value is not changed)
+constexpr std::uint32_t maxFrameSize = 16384;
+constexpr std::int64_t maxWindowSize = 0x7FFFFFFF;
+
+namespace frame {
+	constexpr unsigned int data = 0;
+	constexpr unsigned int headers = 1;
+	constexpr unsigned int priority = 2;
+	constexpr unsigned int rst_stream = 3;
+	constexpr unsigned int settings = 4;
+	constexpr unsigned int push_promise = 5;
+	constexpr unsigned int ping = 6;
+	constexpr unsigned int goaway = 7;
+	constexpr unsigned int window_update = 8;
+	constexpr unsigned int continuation = 9;
+}
+
+namespace flag {
+	constexpr unsigned int end_stream = 0x1;
+	constexpr unsigned int ack = 0x1;
+	constexpr unsigned int end_headers = 0x4;
+	constexpr unsigned int padded = 0x8;
+	constexpr unsigned int priority = 0x20;
+}
+
+namespace setting {
+	constexpr unsigned int enable_push = 2;
+	constexpr unsigned int max_concurrent_streams = 3;
+	constexpr unsigned int initial_window_size = 4;
+	constexpr unsigned int max_frame_size = 5;
+	constexpr unsigned int max_header_list_size = 6;
+}
+
+std::uint32_t getU32(const char *p) {
+	const unsigned char *c = reinterpret_cast<const unsigned char *>(p);
+	return (static_cast<std::uint32_t>(c[0]) << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+}
+
+void putU32(char *p, std::uint32_t v) {
+	p[0] = static_cast<char>(v >> 24);
+	p[1] = static_cast<char>(v >> 16);
+	p[2] = static_cast<char>(v >> 8);
+	p[3] = static_cast<char>(v);
+}
+
+void putSetting(std::string &out, unsigned int id, std::uint32_t value) {
+	char buff[6];
+	buff[0] = static_cast<char>(id >> 8);
+	buff[1] = static_cast<char>(id);
+	putU32(buff+2, value);
+	out.append(buff, 6);
+}
+
+std::string decodeBase64Url(std::string_view data) {
+	std::string out;
+	unsigned int acc = 0, bits = 0;
+	for (char c: data) {
+		int v;
+		if (c >= 'A' && c <= 'Z') v = c - 'A';
+		else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+		else if (c >= '0' && c <= '9') v = c - '0' + 52;
+		else if (c == '-' || c == '+') v = 62;
+		else if (c == '_' || c == '/') v = 63;
+		else continue;
+		acc = (acc << 6) | v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			out.push_back(static_cast<char>(acc >> bits));
+		}
+	}
+	return out;
+}
+
+///Headers which are not transfered by HTTP/2 (RFC 7540 8.1.2.2)
+bool isConnectionHeader(std::string_view name) {
+	return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+			|| name == "transfer-encoding" || name == "upgrade" || name == "http2-settings";
+}
+
+}
+
+struct Http2Connection::StreamState {
+	std::uint32_t id = 0;
+	///response to HEAD request has no body
+	bool head = false;
+	//---- input
+	///data of request not yet read by the stream
+	std::vector<char> input;
+	///input is chunk encoded (request has no content-length)
+	bool chunkedInput = false;
+	bool inputEof = false;
+	///bytes of DATA in input, they are returned to the stream window once they are read
+	std::size_t inputRaw = 0;
+	///bytes read, not yet announced by WINDOW_UPDATE
+	std::uint32_t credit = 0;
+	std::int64_t recvWindow = 0;
+	CallbackT<void()> readWait;
+	///readWait is resolved with timeout after this time
+	std::chrono::steady_clock::time_point readDeadline;
+	///readWait has been resolved by timeout
+	bool readTimeout = false;
+	///provider which runs readWait and flushWait (provider of the waiting thread)
+	AsyncProvider waitProvider;
+	//---- output
+	///body of the response waiting for send window
+	std::vector<char> output;
+	std::size_t outpos = 0;
+	std::int64_t sendWindow = 0;
+	///response is complete, END_STREAM is sent after output
+	bool outputEnd = false;
+	///END_STREAM has been sent
+	bool outputDone = false;
+	bool reset = false;
+	///stream object has been destroyed
+	bool detached = false;
+	CallbackT<void(bool)> flushWait;
+
+	std::size_t pending() const {return output.size() - outpos;}
+};
+
+///Stream of single request. Presents the request in HTTP/1.1 format and converts the response to frames
+class Http2Connection::H2Stream: public AbstractStream {
+public:
+	H2Stream(std::shared_ptr<Http2Connection> owner, PStreamState st):owner(std::move(owner)),st(std::move(st)) {}
+	~H2Stream();
+
+	virtual std::string_view read() override;
+	virtual void readAsync(CallbackT<void(const std::string_view &data)> &&fn) override;
+	virtual void putBack(const std::string_view &pb) override {curbuff = pb;}
+	virtual void write(const std::string_view &data) override;
+	virtual bool writeNB(const std::string_view &data) override;
+	virtual void closeOutput() override;
+	virtual void closeInput() override {}
+	virtual void flush() override;
+	virtual void flushAsync(CallbackT<void(bool)> &&fn) override;
+	virtual bool timeouted() const override {return tmflag;}
+	virtual void clearTimeout() override {tmflag = false;}
+	virtual std::size_t getOutputBufferSize() const override {return streamBufferSize;}
+
+protected:
+
+	enum class OutState {
+		///response header is being collected
+		header,
+		///body with content-length
+		length,
+		chunk_size,
+		chunk_data,
+		chunk_end,
+		trailer,
+		///body without length, ends when stream is closed
+		close,
+		///response is complete, rest of data are ignored
+		done
+	};
+
+	std::shared_ptr<Http2Connection> owner;
+	PStreamState st;
+	std::vector<char> rdbuff;
+	std::string_view curbuff;
+	std::vector<char> hdrbuff;
+	std::string chunkLine;
+	OutState outState = OutState::header;
+	std::uint64_t remain = 0;
+	bool tmflag = false;
+
+	bool inputReady() const {return !st->input.empty() || st->inputEof || st->reset || owner->closed;}
+	bool outputFailed() const {return st->reset || owner->closed;}
+	std::string_view takeInput(std::unique_lock<std::mutex> &lk);
+	template<typename Pred> bool wait(std::unique_lock<std::mutex> &lk, Pred &&pred);
+	void processOutput(std::string_view data);
+	void sendHeader();
+	void appendBody(std::string_view data);
+};
+
+Http2Connection::Http2Connection(Stream &&conn, AsyncProvider provider, unsigned int timeout, Dispatch &&dispatch)
+	:conn(std::move(conn)),provider(provider),timeout(timeout),dispatch(std::move(dispatch)) {}
+
+Http2Connection::~Http2Connection() {}
+
+bool Http2Connection::isPreface(std::string_view data) {
+	if (data.size() < 3) return false;
+	std::size_t len = std::min(data.size(), connPreface.size());
+	return data.substr(0, len) == connPreface.substr(0, len);
+}
+
+void Http2Connection::start(std::shared_ptr<Http2Connection> me) {
+	{
+		std::unique_lock lk(me->lock);
+		me->sendPreface();
+		me->startWrite(lk);
+	}
+	readLoop(me);
+}
+
+void Http2Connection::startUpgraded(std::shared_ptr<Http2Connection> me, std::string_view settings, HPackDecoder::HeaderList &&request) {
+	{
+		std::unique_lock lk(me->lock);
+		me->sendPreface();
+	}
+	std::string s = decodeBase64Url(settings);
+	if (s.size() % 6 != 0 || !me->processSettings(s, false)) return;
+	me->lastStreamId = 1;
+	if (!me->openStream(1, true, request)) return;
+	readLoop(me);
+}
+
+void Http2Connection::sendPreface() {
+	std::string s;
+	putSetting(s, setting::max_concurrent_streams, maxConcurrentStreams);
+	putSetting(s, setting::initial_window_size, streamWindowSize);
+	putSetting(s, setting::max_header_list_size, maxHeaderListSize);
+	queueFrame(frame::settings, 0, 0, s);
+	if (connWindowSize > connRecvWindow) {
+		char buff[4];
+		putU32(buff, static_cast<std::uint32_t>(connWindowSize - connRecvWindow));
+		queueFrame(frame::window_update, 0, 0, std::string_view(buff, 4));
+		connRecvWindow = connWindowSize;
+	}
+}
+
+void Http2Connection::readLoop(std::shared_ptr<Http2Connection> me) {
+	me->conn.read() >> [me](std::string_view data) {
+		if (data.empty()) {
+			if (me->conn.timeouted()) {
+				std::unique_lock lk(me->lock);
+				if (!me->streams.empty() && !me->closed) {
+					me->expireStreams(lk);
+					lk.unlock();
+					me->conn.clearTimeout();
+					readLoop(me);
+				} else if (!me->closed) {
+					//idle connection is closed gracefully
+					char buff[8];
+					putU32(buff, me->lastStreamId);
+					putU32(buff+4, static_cast<std::uint32_t>(Http2Error::no_error));
+					me->queueFrame(frame::goaway, 0, 0, std::string_view(buff, 8));
+					me->goaway = me->closing = true;
+					me->startWrite(lk);
+				}
+			} else {
+				me->onClose();
+			}
+		} else if (me->onData(data)) {
+			//other streams can keep the connection busy, so deadlines are checked after each read
+			std::unique_lock lk(me->lock);
+			me->expireStreams(lk);
+			lk.unlock();
+			readLoop(me);
+		}
+	};
+}
+
+void Http2Connection::expireStreams(std::unique_lock<std::mutex> &lk) {
+	auto now = std::chrono::steady_clock::now();
+	bool expired = false;
+	for (auto &x: streams) {
+		StreamState &st = *x.second;
+		if (st.readWait != nullptr && st.readDeadline <= now) {
+			//request body stalled, handler receives timeout and the stream is canceled
+			st.readTimeout = true;
+			resetStream(st, Http2Error::cancel);
+			expired = true;
+		}
+	}
+	if (expired) schedule(lk);
+}
+
+void Http2Connection::onClose() {
+	std::unique_lock lk(lock);
+	abortAll();
+}
+
+bool Http2Connection::onData(std::string_view data) {
+	std::string_view buf = data;
+	if (!inbuff.empty()) {
+		inbuff.insert(inbuff.end(), data.begin(), data.end());
+		buf = std::string_view(inbuff.data(), inbuff.size());
+	}
+	if (!prefaceReceived) {
+		std::size_t len = std::min(buf.size(), connPreface.size());
+		if (buf.substr(0, len) != connPreface.substr(0, len)) return connError(Http2Error::protocol_error);
+		if (len == connPreface.size()) {
+			buf = buf.substr(len);
+			prefaceReceived = true;
+		}
+	}
+	while (prefaceReceived && buf.size() >= 9) {
+		std::uint32_t len = getU32(buf.data()) >> 8;
+		if (len > maxFrameSize) return connError(Http2Error::frame_size_error);
+		if (buf.size() < len + 9) break;
+		unsigned int type = static_cast<unsigned char>(buf[3]);
+		unsigned int flags = static_cast<unsigned char>(buf[4]);
+		std::uint32_t id = getU32(buf.data()+5) & 0x7FFFFFFF;
+		if (!processFrame(type, flags, id, buf.substr(9, len))) return false;
+		buf = buf.substr(len + 9);
+	}
+	//keep incomplete frame for the next read
+	if (buf.empty()) {
+		inbuff.clear();
+	} else if (inbuff.empty()) {
+		inbuff.assign(buf.begin(), buf.end());
+	} else {
+		inbuff.erase(inbuff.begin(), inbuff.begin() + (buf.data() - inbuff.data()));
+	}
+	return true;
+}
+
+bool Http2Connection::processFrame(unsigned int type, unsigned int flags, std::uint32_t id, std::string_view payload) {
+	//header block must be continuous
+	if (headerStream && (type != frame::continuation || id != headerStream)) return connError(Http2Error::protocol_error);
+	//first frame must be SETTINGS
+	if (!settingsReceived && type != frame::settings) return connError(Http2Error::protocol_error);
+	switch (type) {
+		case frame::data:
+			return processData(id, flags, payload);
+		case frame::headers: {
+			if (id == 0) return connError(Http2Error::protocol_error);
+			if (flags & flag::padded) {
+				if (payload.empty()) return connError(Http2Error::protocol_error);
+				std::size_t pad = static_cast<unsigned char>(payload[0]);
+				payload = payload.substr(1);
+				if (pad > payload.size()) return connError(Http2Error::protocol_error);
+				payload = payload.substr(0, payload.size() - pad);
+			}
+			if (flags & flag::priority) {
+				if (payload.size() < 5) return connError(Http2Error::protocol_error);
+				payload = payload.substr(5);
+			}
+			if (flags & flag::end_headers) return processHeaders(id, (flags & flag::end_stream) != 0, payload);
+			headerBlock.assign(payload.begin(), payload.end());
+			headerStream = id;
+			headerEndStream = (flags & flag::end_stream) != 0;
+			return true;
+		}
+		case frame::continuation:
+			if (!headerStream) return connError(Http2Error::protocol_error);
+			headerBlock.insert(headerBlock.end(), payload.begin(), payload.end());
+			if (headerBlock.size() > maxHeaderListSize) return connError(Http2Error::enhance_your_calm);
+			if (flags & flag::end_headers) {
+				headerStream = 0;
+				return processHeaders(id, headerEndStream, std::string_view(headerBlock.data(), headerBlock.size()));
+			}
+			return true;
+		case frame::priority:
+			if (id == 0) return connError(Http2Error::protocol_error);
+			return true;
+		case frame::rst_stream: {
+			if (id == 0 || id > lastStreamId) return connError(Http2Error::protocol_error);
+			if (payload.size() != 4) return connError(Http2Error::frame_size_error);
+			std::unique_lock lk(lock);
+			auto iter = streams.find(id);
+			if (iter != streams.end()) {
+				StreamState &st = *iter->second;
+				st.reset = true;
+				wakeStream(st);
+				schedule(lk);
+			}
+			return true;
+		}
+		case frame::settings:
+			if (id != 0) return connError(Http2Error::protocol_error);
+			if (flags & flag::ack) {
+				if (!payload.empty()) return connError(Http2Error::frame_size_error);
+				return true;
+			}
+			if (payload.size() % 6 != 0) return connError(Http2Error::frame_size_error);
+			settingsReceived = true;
+			return processSettings(payload, true);
+		case frame::push_promise:
+			return connError(Http2Error::protocol_error);
+		case frame::ping: {
+			if (id != 0) return connError(Http2Error::protocol_error);
+			if (payload.size() != 8) return connError(Http2Error::frame_size_error);
+			if (flags & flag::ack) return true;
+			std::unique_lock lk(lock);
+			queueFrame(frame::ping, flag::ack, 0, payload);
+			startWrite(lk);
+			return true;
+		}
+		case frame::goaway: {
+			if (id != 0) return connError(Http2Error::protocol_error);
+			std::unique_lock lk(lock);
+			goaway = true;
+			startWrite(lk);
+			return true;
+		}
+		case frame::window_update: {
+			if (payload.size() != 4) return connError(Http2Error::frame_size_error);
+			std::uint32_t inc = getU32(payload.data()) & 0x7FFFFFFF;
+			std::unique_lock lk(lock);
+			if (id == 0) {
+				connSendWindow += inc;
+				if (inc == 0 || connSendWindow > maxWindowSize) {
+					lk.unlock();
+					return connError(inc?Http2Error::flow_control_error:Http2Error::protocol_error);
+				}
+			} else {
+				auto iter = streams.find(id);
+				if (iter != streams.end()) {
+					StreamState &st = *iter->second;
+					st.sendWindow += inc;
+					if (inc == 0) resetStream(st, Http2Error::protocol_error);
+					else if (st.sendWindow > maxWindowSize) resetStream(st, Http2Error::flow_control_error);
+				}
+			}
+			schedule(lk);
+			return true;
+		}
+		default:
+			//unknown frames are ignored
+			return true;
+	}
+}
+
+bool Http2Connection::processSettings(std::string_view payload, bool ack) {
+	std::unique_lock lk(lock);
+	Http2Error err = Http2Error::no_error;
+	for (std::size_t i = 0; i + 6 <= payload.size() && err == Http2Error::no_error; i += 6) {
+		unsigned int id = (static_cast<unsigned char>(payload[i]) << 8) | static_cast<unsigned char>(payload[i+1]);
+		std::uint32_t value = getU32(payload.data()+i+2);
+		switch (id) {
+			case setting::enable_push:
+				if (value > 1) err = Http2Error::protocol_error;
+				break;
+			case setting::initial_window_size:
+				if (value > maxWindowSize) {
+					err = Http2Error::flow_control_error;
+				} else {
+					//change is applied to all open streams
+					std::int64_t delta = static_cast<std::int64_t>(value) - peerInitialWindow;
+					for (auto &x: streams) x.second->sendWindow += delta;
+					peerInitialWindow = value;
+				}
+				break;
+			case setting::max_frame_size:
+				if (value < 16384 || value > 16777215) err = Http2Error::protocol_error;
+				else peerMaxFrameSize = value;
+				break;
+			default:
+				break;
+		}
+	}
+	if (err != Http2Error::no_error) {
+		lk.unlock();
+		return connError(err);
+	}
+	if (ack) queueFrame(frame::settings, flag::ack, 0, std::string_view());
+	schedule(lk);
+	return true;
+}
+
+bool Http2Connection::processHeaders(std::uint32_t id, bool endStream, std::string_view block) {
+	//block must be decoded always to keep the dynamic table in sync
+	if (!decoder.decode(block, headers, maxHeaderListSize)) return connError(Http2Error::compression_error);
+	if ((id & 1) == 0) return connError(Http2Error::protocol_error);
+	{
+		std::unique_lock lk(lock);
+		auto iter = streams.find(id);
+		if (iter != streams.end()) {
+			//trailers - they are not passed to the request, just end the body
+			StreamState &st = *iter->second;
+			if (st.inputEof) {
+				resetStream(st, Http2Error::stream_closed);
+			} else if (!endStream) {
+				resetStream(st, Http2Error::protocol_error);
+			} else {
+				st.inputEof = true;
+				if (st.chunkedInput) {
+					std::string_view eof("0\r\n\r\n");
+					st.input.insert(st.input.end(), eof.begin(), eof.end());
+				}
+				wakeStream(st);
+			}
+			schedule(lk);
+			return true;
+		}
+	}
+	if (id <= lastStreamId) return connError(Http2Error::stream_closed);
+	lastStreamId = id;
+	return openStream(id, endStream, headers);
+}
+
+bool Http2Connection::openStream(std::uint32_t id, bool endStream, const HPackDecoder::HeaderList &hdrs) {
+	std::unique_lock lk(lock);
+	if (goaway) return true;
+	auto refuse = [&](Http2Error err) {
+		char buff[4];
+		putU32(buff, static_cast<std::uint32_t>(err));
+		queueFrame(frame::rst_stream, 0, id, std::string_view(buff, 4));
+		startWrite(lk);
+		return true;
+	};
+	if (streams.size() >= maxConcurrentStreams) return refuse(Http2Error::refused_stream);
+
+	std::string_view method, path, authority;
+	bool hasHost = false;
+	bool hasLength = false;
+	for (const auto &[name, value]: hdrs) {
+		//line breaks can't be passed to HTTP/1.1 header
+		if (name.find_first_of("\r\n:", 1) != name.npos || value.find_first_of("\r\n") != value.npos) {
+			return refuse(Http2Error::protocol_error);
+		}
+		if (name == ":method") method = value;
+		else if (name == ":path") path = value;
+		else if (name == ":authority") authority = value;
+		else if (name == "host") hasHost = true;
+		else if (name == "content-length") hasLength = true;
+	}
+	if (method.empty() || path.empty()) return refuse(Http2Error::protocol_error);
+
+	auto st = std::make_shared<StreamState>();
+	std::string req;
+	req.reserve(1024);
+	req.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+	if (!hasHost && !authority.empty()) req.append("Host: ").append(authority).append("\r\n");
+	std::string cookie;
+	for (const auto &[name, value]: hdrs) {
+		if (name.empty() || name[0] == ':' || isConnectionHeader(name) || name == "te" || name == "expect") continue;
+		if (name == "cookie") {
+			//cookies can be split to multiple fields (RFC 7540 8.1.2.5)
+			if (!cookie.empty()) cookie.append("; ");
+			cookie.append(value);
+		} else {
+			req.append(name).append(": ").append(value).append("\r\n");
+		}
+	}
+	if (!cookie.empty()) req.append("cookie: ").append(cookie).append("\r\n");
+	if (!endStream && !hasLength) {
+		req.append("transfer-encoding: chunked\r\n");
+		st->chunkedInput = true;
+	}
+	req.append("\r\n");
+
+	st->id = id;
+	st->head = method == "HEAD";
+	st->input.assign(req.begin(), req.end());
+	st->inputEof = endStream;
+	st->recvWindow = streamWindowSize;
+	st->sendWindow = peerInitialWindow;
+	streams.emplace(id, st);
+	lk.unlock();
+	dispatch(Stream(new H2Stream(shared_from_this(), st)));
+	return true;
+}
+
+bool Http2Connection::processData(std::uint32_t id, unsigned int flags, std::string_view payload) {
+	if (id == 0 || id > lastStreamId) return connError(Http2Error::protocol_error);
+	std::size_t flowLen = payload.size();
+	if (flags & flag::padded) {
+		if (payload.empty()) return connError(Http2Error::protocol_error);
+		std::size_t pad = static_cast<unsigned char>(payload[0]);
+		payload = payload.substr(1);
+		if (pad > payload.size()) return connError(Http2Error::protocol_error);
+		payload = payload.substr(0, payload.size() - pad);
+	}
+	std::unique_lock lk(lock);
+	if (static_cast<std::int64_t>(flowLen) > connRecvWindow) {
+		lk.unlock();
+		return connError(Http2Error::flow_control_error);
+	}
+	connRecvWindow -= flowLen;
+	//connection window is restored once data are moved to the stream, the stream window
+	//limits the memory
+	creditInput(nullptr, flowLen);
+	auto iter = streams.find(id);
+	if (iter == streams.end() || iter->second->inputEof || iter->second->reset || iter->second->detached) {
+		if (iter == streams.end() || iter->second->inputEof) {
+			char buff[4];
+			putU32(buff, static_cast<std::uint32_t>(Http2Error::stream_closed));
+			queueFrame(frame::rst_stream, 0, id, std::string_view(buff, 4));
+		}
+		startWrite(lk);
+		return true;
+	}
+	StreamState &st = *iter->second;
+	st.recvWindow -= flowLen;
+	if (st.recvWindow < 0) {
+		resetStream(st, Http2Error::flow_control_error);
+		schedule(lk);
+		return true;
+	}
+	//padding is returned to the window immediately
+	if (flowLen > payload.size()) creditInput(&st, flowLen - payload.size());
+	if (!payload.empty()) {
+		if (st.chunkedInput) {
+			char buff[maxIntegerChars+2];
+			char *e = formatUnsigned(buff, buff+maxIntegerChars, payload.size(), 16);
+			*e++ = '\r';
+			*e++ = '\n';
+			st.input.insert(st.input.end(), buff, e);
+			st.input.insert(st.input.end(), payload.begin(), payload.end());
+			st.input.push_back('\r');
+			st.input.push_back('\n');
+		} else {
+			st.input.insert(st.input.end(), payload.begin(), payload.end());
+		}
+		st.inputRaw += payload.size();
+	}
+	if (flags & flag::end_stream) {
+		st.inputEof = true;
+		if (st.chunkedInput) {
+			std::string_view eof("0\r\n\r\n");
+			st.input.insert(st.input.end(), eof.begin(), eof.end());
+		}
+	}
+	wakeStream(st);
+	startWrite(lk);
+	return true;
+}
+
+bool Http2Connection::connError(Http2Error err) {
+	std::unique_lock lk(lock);
+	if (!closing) {
+		char buff[8];
+		putU32(buff, lastStreamId);
+		putU32(buff+4, static_cast<std::uint32_t>(err));
+		queueFrame(frame::goaway, 0, 0, std::string_view(buff, 8));
+		goaway = closing = true;
+		startWrite(lk);
+	}
+	return false;
+}
+
+void Http2Connection::queueFrame(unsigned int type, unsigned int flags, std::uint32_t id, std::string_view payload) {
+	std::size_t len = payload.size();
+	char hdr[9];
+	putU32(hdr, static_cast<std::uint32_t>(len << 8 | type));
+	hdr[4] = static_cast<char>(flags);
+	putU32(hdr+5, id);
+	outq.insert(outq.end(), hdr, hdr+9);
+	outq.insert(outq.end(), payload.begin(), payload.end());
+}
+
+void Http2Connection::queueHeaders(std::uint32_t id, bool endStream, std::string_view block) {
+	unsigned int type = frame::headers;
+	unsigned int flags = endStream?flag::end_stream:0;
+	do {
+		std::string_view part = block.substr(0, peerMaxFrameSize);
+		block = block.substr(part.size());
+		queueFrame(type, flags | (block.empty()?flag::end_headers:0), id, part);
+		type = frame::continuation;
+		flags = 0;
+	} while (!block.empty());
+}
+
+void Http2Connection::resetStream(StreamState &st, Http2Error err) {
+	if (st.reset) return;
+	st.reset = true;
+	char buff[4];
+	putU32(buff, static_cast<std::uint32_t>(err));
+	queueFrame(frame::rst_stream, 0, st.id, std::string_view(buff, 4));
+	st.output.clear();
+	st.outpos = 0;
+	wakeStream(st);
+}
+
+void Http2Connection::creditInput(StreamState *st, std::size_t bytes) {
+	std::uint32_t &credit = st?st->credit:connCredit;
+	std::uint32_t window = st?streamWindowSize:connWindowSize;
+	if (st && (st->inputEof || st->reset || st->detached)) return;
+	credit += static_cast<std::uint32_t>(bytes);
+	//window updates are sent in batches
+	if (credit >= window / 2) {
+		char buff[4];
+		putU32(buff, credit);
+		queueFrame(frame::window_update, 0, st?st->id:0, std::string_view(buff, 4));
+		if (st) st->recvWindow += credit; else connRecvWindow += credit;
+		credit = 0;
+	}
+}
+
+void Http2Connection::wakeStream(StreamState &st) {
+	cond.notify_all();
+	if (st.readWait != nullptr && (!st.input.empty() || st.inputEof || st.reset || closed)) {
+		st.waitProvider.runAsync(std::move(st.readWait));
+		st.readWait = nullptr;
+	}
+	if (st.flushWait != nullptr && (st.pending() == 0 || st.reset || closed)) {
+		st.waitProvider.runAsync([fn = std::move(st.flushWait), ok = !st.reset && !closed]() mutable {
+			fn(ok);
+		});
+		st.flushWait = nullptr;
+	}
+}
+
+void Http2Connection::schedule(std::unique_lock<std::mutex> &lk) {
+	//streams with pending data send one frame per round, until output queue is full
+	bool progress = true;
+	while (progress && outq.size() < streamBufferSize) {
+		progress = false;
+		for (auto &x: streams) {
+			StreamState &st = *x.second;
+			if (st.reset || st.outputDone) continue;
+			std::size_t pending = st.pending();
+			if (pending) {
+				std::int64_t w = std::min<std::int64_t>({connSendWindow, st.sendWindow, peerMaxFrameSize, static_cast<std::int64_t>(pending)});
+				if (w <= 0) continue;
+				bool last = st.outputEnd && static_cast<std::size_t>(w) == pending;
+				queueFrame(frame::data, last?flag::end_stream:0, st.id, std::string_view(st.output.data() + st.outpos, w));
+				st.outpos += w;
+				connSendWindow -= w;
+				st.sendWindow -= w;
+				if (st.outpos == st.output.size()) {
+					st.output.clear();
+					st.outpos = 0;
+				}
+				st.outputDone = last;
+				progress = true;
+				wakeStream(st);
+			} else if (st.outputEnd) {
+				queueFrame(frame::data, flag::end_stream, st.id, std::string_view());
+				st.outputDone = true;
+				progress = true;
+			}
+		}
+	}
+	for (auto iter = streams.begin(); iter != streams.end();) {
+		StreamState &st = *iter->second;
+		if (st.detached && (st.outputDone || st.reset)) {
+			if (!st.reset && !st.inputEof) {
+				//response is complete, client can stop sending the request (RFC 7540 8.1)
+				char buff[4];
+				putU32(buff, static_cast<std::uint32_t>(Http2Error::no_error));
+				queueFrame(frame::rst_stream, 0, st.id, std::string_view(buff, 4));
+			}
+			iter = streams.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+	startWrite(lk);
+}
+
+void Http2Connection::startWrite(std::unique_lock<std::mutex> &lk) {
+	if (writing || closed) return;
+	if (outq.empty()) {
+		if (closing || (goaway && streams.empty())) {
+			abortAll();
+			lk.unlock();
+			try {
+				conn.closeOutput();
+			} catch (...) {
+
+			}
+			lk.lock();
+		}
+		return;
+	}
+	writing = true;
+	std::swap(outq, wrbuff);
+	auto me = shared_from_this();
+	auto cur = getCurrentAsyncProvider_NoException();
+	if (cur.has_value() && *cur == provider) {
+		lk.unlock();
+		writeOut(me);
+		lk.lock();
+	} else {
+		//writing is completed by the provider of the connection, handlers can't block it
+		provider.runAsync([me]{
+			writeOut(me);
+		});
+	}
+}
+
+void Http2Connection::writeOut(std::shared_ptr<Http2Connection> me) {
+	me->conn.writeNB(std::string_view(me->wrbuff.data(), me->wrbuff.size()));
+	me->conn.flush() >> [me](bool ok) {
+		std::unique_lock lk(me->lock);
+		me->writing = false;
+		me->wrbuff.clear();
+		if (ok) me->schedule(lk);
+		else me->abortAll();
+	};
+}
+
+void Http2Connection::abortAll() {
+	closed = true;
+	outq.clear();
+	for (auto iter = streams.begin(); iter != streams.end();) {
+		StreamState &st = *iter->second;
+		st.reset = true;
+		wakeStream(st);
+		if (st.detached) iter = streams.erase(iter); else ++iter;
+	}
+	cond.notify_all();
+}
+
+Http2Connection::H2Stream::~H2Stream() {
+	CallbackT<void()> rw;
+	std::unique_lock lk(owner->lock);
+	rw = std::move(st->readWait);
+	st->readWait = nullptr;
+	st->detached = true;
+	if (!st->reset && !st->outputEnd) {
+		//incomplete response can't be ended by END_STREAM
+		if (outState == OutState::header || (outState == OutState::length && remain)) {
+			owner->resetStream(*st, Http2Error::internal_error);
+		} else {
+			st->outputEnd = true;
+		}
+	}
+	st->inputRaw = 0;
+	st->input.clear();
+	owner->schedule(lk);
+}
+
+std::string_view Http2Connection::H2Stream::takeInput(std::unique_lock<std::mutex> &lk) {
+	rdbuff.clear();
+	std::swap(rdbuff, st->input);
+	if (st->inputRaw) {
+		owner->creditInput(st.get(), st->inputRaw);
+		st->inputRaw = 0;
+		owner->startWrite(lk);
+	}
+	return std::string_view(rdbuff.data(), rdbuff.size());
+}
+
+template<typename Pred>
+bool Http2Connection::H2Stream::wait(std::unique_lock<std::mutex> &lk, Pred &&pred) {
+	if (owner->cond.wait_for(lk, std::chrono::milliseconds(owner->timeout), std::forward<Pred>(pred))) return true;
+	tmflag = true;
+	return false;
+}
+
+std::string_view Http2Connection::H2Stream::read() {
+	if (!curbuff.empty()) return std::exchange(curbuff, std::string_view());
+	std::unique_lock lk(owner->lock);
+	if (!wait(lk, [&]{return inputReady();})) return std::string_view();
+	return takeInput(lk);
+}
+
+void Http2Connection::H2Stream::readAsync(CallbackT<void(const std::string_view &data)> &&fn) {
+	if (!curbuff.empty()) {
+		fn(std::exchange(curbuff, std::string_view()));
+		return;
+	}
+	std::unique_lock lk(owner->lock);
+	if (inputReady()) {
+		std::string_view data = takeInput(lk);
+		lk.unlock();
+		fn(data);
+	} else {
+		st->waitProvider = getCurrentAsyncProvider_NoException().value_or(owner->provider);
+		st->readDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(owner->timeout);
+		st->readWait = [this, fn = std::move(fn)]() mutable {
+			std::unique_lock lk(owner->lock);
+			if (std::exchange(st->readTimeout, false)) {
+				tmflag = true;
+				lk.unlock();
+				fn(std::string_view());
+				return;
+			}
+			std::string_view data = takeInput(lk);
+			lk.unlock();
+			fn(data);
+		};
+	}
+}
+
+bool Http2Connection::H2Stream::writeNB(const std::string_view &data) {
+	std::unique_lock lk(owner->lock);
+	processOutput(data);
+	return st->pending() >= streamBufferSize;
+}
+
+void Http2Connection::H2Stream::write(const std::string_view &data) {
+	std::unique_lock lk(owner->lock);
+	processOutput(data);
+	if (st->pending() >= streamBufferSize) {
+		owner->schedule(lk);
+		if (!wait(lk, [&]{return st->pending() < streamBufferSize || outputFailed();})) {
+			owner->resetStream(*st, Http2Error::cancel);
+		}
+	}
+}
+
+void Http2Connection::H2Stream::closeOutput() {
+	std::unique_lock lk(owner->lock);
+	if (outState != OutState::header) {
+		outState = OutState::done;
+		st->outputEnd = true;
+		owner->schedule(lk);
+	}
+}
+
+void Http2Connection::H2Stream::flush() {
+	std::unique_lock lk(owner->lock);
+	owner->schedule(lk);
+	if (!wait(lk, [&]{return st->pending() == 0 || outputFailed();})) {
+		owner->resetStream(*st, Http2Error::cancel);
+	}
+}
+
+void Http2Connection::H2Stream::flushAsync(CallbackT<void(bool)> &&fn) {
+	std::unique_lock lk(owner->lock);
+	owner->schedule(lk);
+	if (st->pending() == 0 || outputFailed()) {
+		bool ok = !outputFailed();
+		lk.unlock();
+		fn(ok);
+	} else {
+		st->waitProvider = getCurrentAsyncProvider_NoException().value_or(owner->provider);
+		st->flushWait = std::move(fn);
+	}
+}
+
+void Http2Connection::H2Stream::processOutput(std::string_view data) {
+	while (!data.empty()) {
+		switch (outState) {
+			case OutState::header: {
+				std::size_t prev = hdrbuff.size();
+				hdrbuff.insert(hdrbuff.end(), data.begin(), data.end());
+				std::string_view h(hdrbuff.data(), hdrbuff.size());
+				std::size_t pos = h.find("\r\n\r\n", prev > 3?prev - 3:0);
+				if (pos == h.npos) return;
+				data = data.substr(pos + 4 - prev);
+				hdrbuff.resize(pos);
+				sendHeader();
+			} break;
+			case OutState::length: {
+				std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(remain, data.size()));
+				appendBody(data.substr(0, n));
+				data = data.substr(n);
+				remain -= n;
+				if (remain == 0) {
+					outState = OutState::done;
+					st->outputEnd = true;
+				}
+			} break;
+			case OutState::chunk_size: {
+				std::size_t p = data.find('\n');
+				chunkLine.append(data.substr(0, p));
+				if (p == data.npos) return;
+				data = data.substr(p + 1);
+				remain = std::strtoull(chunkLine.c_str(), nullptr, 16);
+				chunkLine.clear();
+				outState = remain?OutState::chunk_data:OutState::trailer;
+			} break;
+			case OutState::chunk_data: {
+				std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(remain, data.size()));
+				appendBody(data.substr(0, n));
+				data = data.substr(n);
+				remain -= n;
+				if (remain == 0) outState = OutState::chunk_end;
+			} break;
+			case OutState::chunk_end: {
+				std::size_t p = data.find('\n');
+				if (p == data.npos) return;
+				data = data.substr(p + 1);
+				outState = OutState::chunk_size;
+			} break;
+			case OutState::trailer: {
+				//trailer lines are skipped until empty line
+				std::size_t p = data.find('\n');
+				chunkLine.append(data.substr(0, p));
+				if (p == data.npos) return;
+				data = data.substr(p + 1);
+				if (chunkLine.empty() || chunkLine == "\r") {
+					outState = OutState::done;
+					st->outputEnd = true;
+				}
+				chunkLine.clear();
+			} break;
+			case OutState::close:
+				appendBody(data);
+				return;
+			case OutState::done:
+				return;
+		}
+	}
+}
+
+void Http2Connection::H2Stream::sendHeader() {
+	std::string_view h(hdrbuff.data(), hdrbuff.size());
+	std::size_t eol = h.find("\r\n");
+	std::string_view first = h.substr(0, eol);
+	h = eol == h.npos?std::string_view():h.substr(eol + 2);
+	unsigned int status = 0;
+	std::size_t sp = first.find(' ');
+	for (std::size_t i = sp + 1; sp != first.npos && i < first.size() && i < sp + 4; i++) {
+		status = status * 10 + (first[i] - '0');
+	}
+	std::vector<char> block;
+	HPackEncoder::encodeStatus(status, block);
+	bool chunked = false;
+	bool hasLength = false;
+	std::uint64_t length = 0;
+	std::string name;
+	while (!h.empty()) {
+		eol = h.find("\r\n");
+		std::string_view line = h.substr(0, eol);
+		h = eol == h.npos?std::string_view():h.substr(eol + 2);
+		std::size_t sep = line.find(':');
+		if (sep == line.npos) continue;
+		name.assign(line.substr(0, sep));
+		std::transform(name.begin(), name.end(), name.begin(), [](char c){return c >= 'A' && c <= 'Z'?c + 32:c;});
+		std::string_view value = line.substr(sep + 1);
+		while (!value.empty() && value.front() == ' ') value = value.substr(1);
+		while (!value.empty() && value.back() == ' ') value = value.substr(0, value.size() - 1);
+		if (name == "transfer-encoding") {
+			chunked = value.find("chunked") != value.npos;
+		} else if (!isConnectionHeader(name)) {
+			if (name == "content-length") {
+				hasLength = true;
+				length = std::strtoull(std::string(value).c_str(), nullptr, 10);
+			}
+			HPackEncoder::encodeHeader(name, value, block);
+		}
+	}
+	hdrbuff.clear();
+	std::string_view blk(block.data(), block.size());
+	if (status >= 100 && status < 200) {
+		//informational response, final response follows
+		owner->queueHeaders(st->id, false, blk);
+		return;
+	}
+	bool nobody = st->head || status == 204 || status == 304 || (!chunked && hasLength && length == 0);
+	if (st->reset) {
+		outState = OutState::done;
+		return;
+	}
+	owner->queueHeaders(st->id, nobody, blk);
+	if (nobody) {
+		outState = OutState::done;
+		st->outputEnd = st->outputDone = true;
+	} else if (chunked) {
+		outState = OutState::chunk_size;
+	} else if (hasLength) {
+		remain = length;
+		outState = OutState::length;
+	} else {
+		outState = OutState::close;
+	}
+}
+
+void Http2Connection::H2Stream::appendBody(std::string_view data) {
+	if (st->reset) return;
+	if (st->outpos && st->outpos == st->output.size()) {
+		st->output.clear();
+		st->outpos = 0;
+	}
+	st->output.insert(st->output.end(), data.begin(), data.end());
+}
+
+}
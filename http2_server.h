@@ -0,0 +1,183 @@
+/*
+ * http2_server.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_USERVER_HTTP2_SERVER_H_
+#define SRC_USERVER_HTTP2_SERVER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "async_provider.h"
+#include "hpack.h"
+#include "stream.h"
+
+namespace userver {
+
+///Error codes of HTTP/2 (RFC 7540 section 7)
+enum class Http2Error: std::uint32_t {
+	no_error = 0,
+	protocol_error = 1,
+	internal_error = 2,
+	flow_control_error = 3,
+	settings_timeout = 4,
+	stream_closed = 5,
+	frame_size_error = 6,
+	refused_stream = 7,
+	cancel = 8,
+	compression_error = 9,
+	connect_error = 10,
+	enhance_your_calm = 11,
+	inadequate_security = 12,
+	http_1_1_required = 13
+};
+
+///Server side of a cleartext HTTP/2 connection (h2c)
+/**
+ * Connection demultiplexes streams and presents each stream as a separate Stream,
+ * which carries the request in HTTP/1.1 format. The response written to the stream in HTTP/1.1
+ * format is converted to HTTP/2 frames. This allows to process streams by HttpServerRequest
+ * and existing handlers without modification.
+ *
+ * Request body without content-length is presented as chunked body. Connection-specific
+ * headers of the response (Connection, Transfer-Encoding, etc) are removed.
+ *
+ * @note Server push and stream priorities are not supported
+ */
+class Http2Connection: public std::enable_shared_from_this<Http2Connection> {
+public:
+
+	///Function which receives stream of a new request
+	using Dispatch = CallbackT<void(Stream &&)>;
+
+	///Create connection
+	/**
+	 * @param conn connected stream
+	 * @param provider asynchronous provider which reads and writes the connection. Asynchronous
+	 * operations of streams complete in the provider of the thread which started them. It
+	 * should be different provider than the one running the handlers, otherwise handlers
+	 * waiting for data can block all threads, so nobody reads the data
+	 * @param timeout timeout in milliseconds for blocking operations of streams and for an idle connection.
+	 * Asynchronous read of a stream which doesn't receive data in time is completed with timeout
+	 * and the stream is canceled. Deadlines are checked when the connection receives data or
+	 * times out, so the timeout can be exceeded up to twice
+	 * @param dispatch function which receives streams of new requests. Function is called
+	 * from the thread reading the connection, so it should not block
+	 */
+	Http2Connection(Stream &&conn, AsyncProvider provider, unsigned int timeout, Dispatch &&dispatch);
+	~Http2Connection();
+
+	///Start connection, client sends connection preface (prior knowledge)
+	/** Must be called in a thread of the provider of the connection */
+	static void start(std::shared_ptr<Http2Connection> me);
+	///Start connection upgraded from HTTP/1.1
+	/**
+	 * Response 101 must be already sent. Must be called in a thread of the provider of the connection
+	 *
+	 * @param me pointer to connection
+	 * @param settings content of the HTTP2-Settings header (base64url encoded)
+	 * @param request headers of the upgraded request including pseudo headers (:method, :path, :authority).
+	 * The request becomes the stream 1
+	 */
+	static void startUpgraded(std::shared_ptr<Http2Connection> me, std::string_view settings, HPackDecoder::HeaderList &&request);
+
+	///Determines whether data starts with the client connection preface
+	/**
+	 * @param data first data received on the connection
+	 * @retval true data starts with preface or they are prefix of it (at least 3 bytes are needed)
+	 */
+	static bool isPreface(std::string_view data);
+
+	///Maximum count of concurrent streams (SETTINGS_MAX_CONCURRENT_STREAMS)
+	static std::uint32_t maxConcurrentStreams;
+	///Receive window of a stream (SETTINGS_INITIAL_WINDOW_SIZE)
+	static std::uint32_t streamWindowSize;
+	///Receive window of the connection
+	/** Received data are returned to the connection window once they are stored to
+	 * the stream, so this window affects only throughput. Memory held by unread request
+	 * bodies is bounded by maxConcurrentStreams * streamWindowSize per connection */
+	static std::uint32_t connWindowSize;
+	///Maximum size of request headers (SETTINGS_MAX_HEADER_LIST_SIZE)
+	static std::uint32_t maxHeaderListSize;
+	///Size of output buffered by a stream. When exceeded, write operation waits for window
+	static std::size_t streamBufferSize;
+
+protected:
+
+	struct StreamState;
+	class H2Stream;
+	using PStreamState = std::shared_ptr<StreamState>;
+
+	Stream conn;
+	AsyncProvider provider;
+	unsigned int timeout;
+	Dispatch dispatch;
+
+	std::mutex lock;
+	std::condition_variable cond;
+	std::map<std::uint32_t, PStreamState> streams;
+	///frames waiting to write
+	std::vector<char> outq;
+	///frames being written
+	std::vector<char> wrbuff;
+	bool writing = false;
+	bool closed = false;
+	///GOAWAY sent or received, connection is closed when streams are finished
+	bool goaway = false;
+	///connection is closed once pending frames are written
+	bool closing = false;
+	std::int64_t connSendWindow = 65535;
+	std::int64_t connRecvWindow = 65535;
+	std::uint32_t connCredit = 0;
+	std::int64_t peerInitialWindow = 65535;
+	std::uint32_t peerMaxFrameSize = 16384;
+
+	//---- reader state, accessed by the reading thread only
+	std::vector<char> inbuff;
+	HPackDecoder decoder;
+	HPackDecoder::HeaderList headers;
+	std::vector<char> headerBlock;
+	std::uint32_t headerStream = 0;
+	bool headerEndStream = false;
+	bool prefaceReceived = false;
+	bool settingsReceived = false;
+	std::uint32_t lastStreamId = 0;
+
+	static void readLoop(std::shared_ptr<Http2Connection> me);
+	bool onData(std::string_view data);
+	bool processFrame(unsigned int type, unsigned int flags, std::uint32_t id, std::string_view payload);
+	bool processSettings(std::string_view payload, bool ack);
+	bool processHeaders(std::uint32_t id, bool endStream, std::string_view block);
+	bool processData(std::uint32_t id, unsigned int flags, std::string_view payload);
+	bool openStream(std::uint32_t id, bool endStream, const HPackDecoder::HeaderList &hdrs);
+	bool connError(Http2Error err);
+	void onClose();
+
+	//---- functions called under lock
+	void queueFrame(unsigned int type, unsigned int flags, std::uint32_t id, std::string_view payload);
+	void queueHeaders(std::uint32_t id, bool endStream, std::string_view block);
+	void resetStream(StreamState &st, Http2Error err);
+	void creditInput(StreamState *st, std::size_t bytes);
+	void schedule(std::unique_lock<std::mutex> &lk);
+	void startWrite(std::unique_lock<std::mutex> &lk);
+	static void writeOut(std::shared_ptr<Http2Connection> me);
+	void abortAll();
+	void wakeStream(StreamState &st);
+	void expireStreams(std::unique_lock<std::mutex> &lk);
+	void sendPreface();
+};
+
+}
+
+
+
+#endif /* SRC_USERVER_HTTP2_SERVER_H_ */
@@ -255,6 +255,8 @@ NetAddrList HttpClient::resolve(const CrackedURL &cu) {
 	NetAddr addr(NetAddr::PNetAddr(nullptr));
 	if (cfg.resolve != nullptr)  {
 		return cfg.resolve(cu.domain);
+	} else if (!cfg.upstream.empty()) {
+		return NetAddr::fromString(cfg.upstream, std::to_string(cu.port));
 	} else {
 		auto lst = NetAddr::fromString(cu.host, std::to_string(cu.port));
 		return lst;
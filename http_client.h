@@ -263,6 +263,10 @@ struct HttpClientCfg {
 	CallbackT<PSocket(const NetAddr &, const std::string_view &host)> connect;
 	CallbackT<PSocket(const NetAddr &, const std::string_view &host)> sslConnect;
 	CallbackT<NetAddrList(const std::string_view &)> resolve;
+	///Connect all requests to this address instead of resolving the host from the URL
+	/** For example "unix:/run/app.sock". The host from the URL is still sent in the Host header.
+	 * Ignored when resolve is set */
+	std::string upstream;
 };
 
 class HttpClient {
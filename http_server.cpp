@@ -12,9 +12,21 @@
 #include <atomic>
 #include <sstream>
 #include <fstream>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "helpers.h"
+#include "http2_server.h"
 #include "socket_server.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "filedesc.h"
+#endif
 
 #ifdef __GNUC__
 #if __GNUC__ < 8
@@ -32,7 +44,7 @@ namespace std {
 
 namespace userver {
 
-static std::string_view statusMessages[] = {
+static constexpr std::string_view statusMessages[] = {
 		"100 Continue",
 		"101 Switching Protocols",
 		"200 OK",
@@ -87,32 +99,96 @@ static std::string_view statusMessages[] = {
 #define SET_COOKIE  "Set-Cookie"
 #define CRLF "\r\n"
 #define DATE "Date"
+#define CONTENT_ENCODING "Content-Encoding"
+#define ACCEPT_ENCODING "Accept-Encoding"
+#define VARY "Vary"
 
 std::atomic<std::size_t> HttpServerRequest::identCounter(0);
 
-std::string_view getStatusCodeMsg(int code) {
-	char num[100];
-	snprintf(num,100,"%d",code);
-	std::string_view codestr(num);
-	if (codestr.length() == 3) {
-
-		auto f = std::lower_bound(
-				std::begin(statusMessages),
-				std::end(statusMessages),
-				codestr, [](const std::string_view &a, const std::string_view &b){
-			return a.substr(0,3) < b.substr(0,3);
-		});
-		if (f != std::end(statusMessages)) {
-			if (f->substr(0,3) == codestr)
-				return f->substr(4);
+///Maps status code to the index of statusMessages
+struct StatusLineTable {
+	static constexpr int minCode = 100;
+	static constexpr int maxCode = 599;
+	static constexpr unsigned char none = 0xFF;
+	unsigned char index[maxCode - minCode + 1];
+
+	constexpr StatusLineTable():index() {
+		for (auto &x: index) x = none;
+		for (std::size_t i = 0; i < sizeof(statusMessages)/sizeof(statusMessages[0]); i++) {
+			const std::string_view &m = statusMessages[i];
+			int code = (m[0] - '0') * 100 + (m[1] - '0') * 10 + (m[2] - '0');
+			index[code - minCode] = static_cast<unsigned char>(i);
 		}
+	}
 
+	///Returns status line without the protocol version ("200 OK"), or empty string for unknown code
+	constexpr std::string_view get(int code) const {
+		if (code < minCode || code > maxCode || index[code - minCode] == none) return std::string_view();
+		return statusMessages[index[code - minCode]];
 	}
-	return "Unexpected status";
-}
+};
+
+static constexpr StatusLineTable statusLineTable;
 
+std::string_view getStatusCodeMsg(int code) {
+	std::string_view ln = statusLineTable.get(code);
+	if (ln.empty()) return "Unexpected status";
+	return ln.substr(4);
+}
+
+///Retrieves value of the Date header for current time
+/** The value is formatted once per second for each thread */
+static std::string_view cachedHttpDate() {
+	static thread_local std::time_t lastTime = 0;
+	static thread_local char buffer[64];
+	static thread_local std::size_t length = 0;
+	std::time_t now = std::time(nullptr);
+	if (now != lastTime) {
+		httpDate(now, [&](std::string_view d){
+			length = std::min(d.length(), sizeof(buffer));
+			std::copy(d.begin(), d.begin() + length, buffer);
+		});
+		lastTime = now;
+	}
+	return std::string_view(buffer, length);
+}
 
 std::size_t HttpServerRequest::maxChunkSize = 16384;
+std::size_t HttpServerRequest::maxDiscardSize = 256*1024;
+std::size_t HttpServerRequest::sendFileBlockSize = 64*1024;
+std::size_t HttpServerRequest::poolSize = 32;
+bool HttpServerRequest::compressResponses = false;
+std::size_t HttpServerRequest::compressMinSize = 1024;
+
+namespace {
+
+///Memory and buffers of destroyed requests, kept for reuse
+/** Each thread has own pool, so no locking is needed. A request destroyed by other thread
+ * than the one created it just moves its memory to the pool of that thread */
+struct RequestPool {
+	struct Buffers {
+		std::vector<char> inHeaderData;
+		std::vector<char> sendHeader;
+		std::vector<char> logBuffer;
+		std::vector<std::pair<std::string_view, std::string_view> > inHeader;
+		std::string statusMessage;
+	};
+	std::vector<void *> blocks;
+	std::vector<Buffers> buffers;
+
+	~RequestPool();
+};
+
+thread_local RequestPool requestPool;
+///Set when the pool of the thread is destroyed, requests destroyed later are not pooled
+thread_local bool requestPoolClosed = false;
+
+RequestPool::~RequestPool() {
+	requestPoolClosed = true;
+	for (void *p: blocks) ::operator delete(p);
+}
+
+}
 
 std::size_t HeaderValue::getUInt() const {
 	std::size_t n = 0;
@@ -131,11 +207,16 @@ void HeaderValue::trim(std::string_view &what) {
 }
 
 
+///Converts ASCII letter to lowercase. Header names are ASCII, so locale is not involved
+static inline int asciiLower(char c) {
+	return c >= 'A' && c <= 'Z'?c + ('a' - 'A'):static_cast<unsigned char>(c);
+}
+
 bool HeaderValue::lessHeader(const std::pair<std::string_view, std::string_view> &a,
 				const std::pair<std::string_view, std::string_view> &b) {
 	auto ln = std::min(a.first.length(), b.first.length());
 	for (std::size_t i = 0; i < ln; i++) {
-		int c = std::tolower(a.first[i]) - std::tolower(b.first[i]);
+		int c = asciiLower(a.first[i]) - asciiLower(b.first[i]);
 		if (c) return c<0;
 	}
 	return (static_cast<int>(a.first.length()) - static_cast<int>(b.first.length())) < 0;
@@ -145,59 +226,180 @@ bool HeaderValue::iequal(const std::string_view &a, const std::string_view &b) {
 	if (a.length() != b.length()) return false;
 	auto ln = a.length();
 	for (std::size_t i = 0; i < ln; i++) {
-		int c = std::tolower(a[i]) - std::tolower(b[i]);
-		if (c) return false;
+		if (asciiLower(a[i]) != asciiLower(b[i])) return false;
 	}
 	return true;
 }
 
-bool HttpServerRequest::readHeader(std::string_view &buff, int &m) {
-	int pos = 0;
-	for (char c: buff) {
-		switch (m) {
-		case 0: if (c == '\r') {
-					++m;
-				} else {
-					inHeaderData.push_back(c);
-				} break;
-		case 1: if (c == '\n') {
-					++m;
-				} else {
-					inHeaderData.push_back('\r');
-					if (c == '\r') {
-						m = 1;
-					} else {
-						m = 0;
-						inHeaderData.push_back(c);
-					}
-				} break;
-		case 2: if (c == '\r') {
-					++m;
-				} else  {
-					inHeaderData.push_back('\r');
-					inHeaderData.push_back('\n');
-					inHeaderData.push_back(c);
-					m = 0;
-				} break;
-		case 3: if (c == '\n') {
-					pos++;
-					buff = buff.substr(pos);
-					return true;
-				} else {
-					inHeaderData.push_back('\r');
-					inHeaderData.push_back('\n');
-					inHeaderData.push_back('\r');
-					if (c == '\r') {
-						m = 1;
-					} else {
-						m = 0;
-						inHeaderData.push_back(c);
-					}
-				} break;
+///Names of well known headers, order of KnownHeader
+static constexpr std::string_view knownHeaderNames[] = {
+		"Accept",
+		"Accept-Encoding",
+		"Accept-Language",
+		"Authorization",
+		"Cache-Control",
+		"Connection",
+		"Content-Encoding",
+		"Content-Length",
+		"Content-Type",
+		"Cookie",
+		"Date",
+		"ETag",
+		"Expect",
+		"Forwarded",
+		"Host",
+		"If-Match",
+		"If-Modified-Since",
+		"If-None-Match",
+		"Keep-Alive",
+		"Last-Modified",
+		"Origin",
+		"Pragma",
+		"Range",
+		"Referer",
+		"Sec-WebSocket-Key",
+		"Sec-WebSocket-Protocol",
+		"Sec-WebSocket-Version",
+		"Server",
+		"TE",
+		"Trailer",
+		"Transfer-Encoding",
+		"Upgrade",
+		"User-Agent",
+		"Via",
+		"X-Forwarded-For",
+		"X-Forwarded-Host",
+		"X-Forwarded-Proto",
+		"X-Real-IP",
+		"X-Request-ID",
+};
+
+static_assert(sizeof(knownHeaderNames)/sizeof(knownHeaderNames[0]) == static_cast<std::size_t>(KnownHeader::count), "knownHeaderNames doesn't match KnownHeader");
+
+///Hash of the header name. Setting 0x20 bit makes letters lowercase
+static constexpr std::size_t knownHeaderHash(const std::string_view &name) {
+	return (name.length() + (name.front() | 0x20) * 4 + (name.back() | 0x20) * 21) & 127;
+}
+
+///Table which maps the hash to the well known header
+struct KnownHeaderTable {
+	unsigned char index[128];
+	bool perfect;
+
+	constexpr KnownHeaderTable():index(),perfect(true) {
+		for (auto &x: index) x = static_cast<unsigned char>(KnownHeader::unknown);
+		for (std::size_t i = 0; i < static_cast<std::size_t>(KnownHeader::count); i++) {
+			auto h = knownHeaderHash(knownHeaderNames[i]);
+			if (index[h] != static_cast<unsigned char>(KnownHeader::unknown)) perfect = false;
+			index[h] = static_cast<unsigned char>(i);
 		}
-		pos++;
 	}
-	return false;
+};
+
+static constexpr KnownHeaderTable knownHeaderTable;
+static_assert(knownHeaderTable.perfect, "knownHeaderHash is not perfect, adjust its coefficients");
+
+KnownHeader HeaderValue::classify(const std::string_view &name) {
+	if (name.empty()) return KnownHeader::unknown;
+	auto idx = knownHeaderTable.index[knownHeaderHash(name)];
+	if (idx != static_cast<unsigned char>(KnownHeader::unknown) && iequal(name, knownHeaderNames[idx])) {
+		return static_cast<KnownHeader>(idx);
+	}
+	return KnownHeader::unknown;
+}
+
+std::string_view HeaderValue::getName(KnownHeader h) {
+	if (h >= KnownHeader::count) return std::string_view();
+	return knownHeaderNames[static_cast<std::size_t>(h)];
+}
+
+std::string_view HeaderValue::getListSeparator(KnownHeader h) {
+	switch (h) {
+		case KnownHeader::accept:
+		case KnownHeader::accept_encoding:
+		case KnownHeader::accept_language:
+		case KnownHeader::cache_control:
+		case KnownHeader::connection:
+		case KnownHeader::content_encoding:
+		case KnownHeader::expect:
+		case KnownHeader::forwarded:
+		case KnownHeader::if_match:
+		case KnownHeader::if_none_match:
+		case KnownHeader::keep_alive:
+		case KnownHeader::pragma:
+		case KnownHeader::sec_websocket_protocol:
+		case KnownHeader::sec_websocket_version:
+		case KnownHeader::te:
+		case KnownHeader::trailer:
+		case KnownHeader::transfer_encoding:
+		case KnownHeader::upgrade:
+		case KnownHeader::via:
+		case KnownHeader::x_forwarded_for:
+		case KnownHeader::x_forwarded_host:
+		case KnownHeader::x_forwarded_proto:
+			return ", ";
+		case KnownHeader::cookie:
+			return "; ";
+		default:
+			return std::string_view();
+	}
+}
+
+///Finds end of the header block (\r\n\r\n)
+/**
+ * @param beg begin of data
+ * @param len length of data
+ * @param from offset where to start
+ * @return offset of the sequence, or npos if not found
+ */
+static std::size_t findHeaderEnd(const char *beg, std::size_t len, std::size_t from) {
+	std::size_t i = from;
+#ifdef __SSE2__
+	//check 16 positions at once. The sequence has '\r' at offsets 0 and 2,
+	//which is rare inside of the header block
+	const __m128i cr = _mm_set1_epi8('\r');
+	while (i + 19 <= len) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(beg + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(beg + i + 2));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, cr)));
+		while (mask) {
+			std::size_t p = i + __builtin_ctz(mask);
+			if (beg[p+1] == '\n' && beg[p+3] == '\n') return p;
+			mask &= mask - 1;
+		}
+		i += 16;
+	}
+#endif
+	while (i + 4 <= len) {
+		const char *p = static_cast<const char *>(std::memchr(beg + i, '\r', len - i - 3));
+		if (p == nullptr) break;
+		i = p - beg;
+		if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n') return i;
+		++i;
+	}
+	return std::string_view::npos;
+}
+
+bool HttpServerRequest::readHeader(std::string_view &buff) {
+	std::size_t prev = inHeaderData.size();
+	if (prev == 0) {
+		//whole header block is usually received by single read - copy it at once
+		std::size_t pos = findHeaderEnd(buff.data(), buff.size(), 0);
+		if (pos != buff.npos) {
+			inHeaderData.assign(buff.data(), buff.data() + pos);
+			buff = buff.substr(pos + 4);
+			return true;
+		}
+		inHeaderData.assign(buff.begin(), buff.end());
+		return false;
+	}
+	//header block spans reads, the sequence can be split between reads
+	inHeaderData.insert(inHeaderData.end(), buff.begin(), buff.end());
+	std::size_t pos = findHeaderEnd(inHeaderData.data(), inHeaderData.size(), prev > 3?prev - 3:0);
+	if (pos == buff.npos) return false;
+	buff = buff.substr(pos + 4 - prev);
+	inHeaderData.resize(pos);
+	return true;
 }
 
 void HttpServerRequest::setKeepAliveCallback(KeepAliveCallback &&kc) {
@@ -205,31 +407,31 @@ void HttpServerRequest::setKeepAliveCallback(KeepAliveCallback &&kc) {
 }
 
 bool HttpServerRequest::readHeader() {
-	int m = 0;
 	std::string_view buf = stream.read();
 	while (!buf.empty()) {
-		if (readHeader(buf, m)) {
+		if (readHeader(buf)) {
 			stream.putBack(buf);
 			return true;
 		}
+		buf = stream.read();
 	}
 	return false;
 }
 
 template<typename Fn>
-void HttpServerRequest::readHeaderAsync(int m, Fn &&fn) {
-	stream.read()>>[this, m, fn = std::move(fn)](std::string_view data) mutable {
+void HttpServerRequest::readHeaderAsync(Fn &&fn) {
+	stream.read()>>[this, fn = std::move(fn)](std::string_view data) mutable {
 		if (data.empty()) {
 			fn(false);
 			return;
 		}
 		initTime = std::chrono::system_clock::now();
-		bool res = readHeader(data, m);
+		bool res = readHeader(data);
 		if (res) {
 			stream.putBack(data);
 			fn(true);
 		}
-		else readHeaderAsync(m, std::move(fn));
+		else readHeaderAsync(std::move(fn));
 	};
 }
 
@@ -244,12 +446,20 @@ bool HttpServerRequest::parse() {
 }
 
 HeaderValue HttpServerRequest::get(const std::string_view &item) const {
+	KnownHeader kh = HeaderValue::classify(item);
+	if (kh != KnownHeader::unknown) return get(kh);
 	std::pair srch(item, std::string_view());
 	auto iter =std::lower_bound(inHeader.begin(), inHeader.end(), srch, HeaderValue::lessHeader);
 	if (iter == inHeader.end() || HeaderValue::lessHeader(srch, *iter)) return HeaderValue();
 	else return HeaderValue(std::string_view(iter->second));
 }
 
+HeaderValue HttpServerRequest::get(KnownHeader item) const {
+	const std::string_view &v = knownHeaders[static_cast<std::size_t>(item)];
+	if (v.data() == nullptr) return HeaderValue();
+	else return HeaderValue(v);
+}
+
 std::string_view HttpServerRequest::getMethod() const {
 	return method;
 }
@@ -280,30 +490,83 @@ bool HttpServerRequest::parseFirstLine(std::string_view &v) {
 	if (x == fl.npos) return false;
 	auto y = fl.find(' ',x+1);
 	if (y == fl.npos) return false;
-	std::copy(fl.begin(), fl.end(), std::back_inserter(firstLine));
-	for (std::size_t i = 0; i < x; i++) firstLine[i] = std::toupper(firstLine[i]);
-	for (std::size_t i = y, cnt = firstLine.size(); i < cnt; i++) firstLine[i] = std::toupper(firstLine[i]);
-	method = std::string_view(firstLine.data(), x);
-	path = std::string_view(firstLine.data()+x+1, y - x - 1);
-	httpver = std::string_view(firstLine.data()+y+1, firstLine.size() - y - 1);
+	//the line is parsed in place, method and version are converted to uppercase
+	char *line = inHeaderData.data() + (fl.data() - inHeaderData.data());
+	for (std::size_t i = 0; i < x; i++) line[i] = std::toupper(line[i]);
+	for (std::size_t i = y, cnt = fl.size(); i < cnt; i++) line[i] = std::toupper(line[i]);
+	method = fl.substr(0, x);
+	path = fl.substr(x+1, y - x - 1);
+	httpver = fl.substr(y+1);
 	return true;
 }
 
 
 HttpServerRequest::HttpServerRequest()
 {
+	if (requestPoolClosed) return;
+	auto &bufs = requestPool.buffers;
+	if (!bufs.empty()) {
+		RequestPool::Buffers &b = bufs.back();
+		inHeaderData = std::move(b.inHeaderData);
+		sendHeader = std::move(b.sendHeader);
+		logBuffer = std::move(b.logBuffer);
+		inHeader = std::move(b.inHeader);
+		statusMessage = std::move(b.statusMessage);
+		bufs.pop_back();
+	}
+}
+
+void *HttpServerRequest::operator new(std::size_t sz) {
+	//derived classes have different size, they are not pooled
+	if (sz != sizeof(HttpServerRequest) || requestPoolClosed || requestPool.blocks.empty()) return ::operator new(sz);
+	auto &blocks = requestPool.blocks;
+	void *p = blocks.back();
+	blocks.pop_back();
+	return p;
+}
+
+void HttpServerRequest::operator delete(void *ptr, std::size_t sz) {
+	if (sz == sizeof(HttpServerRequest) && !requestPoolClosed && requestPool.blocks.size() < poolSize) {
+		try {
+			requestPool.blocks.push_back(ptr);
+			return;
+		} catch (...) {
+			//can't be pooled
+		}
+	}
+	::operator delete(ptr);
+}
+
+void HttpServerRequest::recycleBuffers() {
+	if (requestPoolClosed || inHeaderData.capacity() == 0) return;
+	auto &bufs = requestPool.buffers;
+	if (bufs.size() >= poolSize) return;
+	inHeaderData.clear();
+	sendHeader.clear();
+	logBuffer.clear();
+	inHeader.clear();
+	statusMessage.clear();
+	bufs.push_back({std::move(inHeaderData), std::move(sendHeader), std::move(logBuffer),
+		std::move(inHeader), std::move(statusMessage)});
 }
 
 void HttpServerRequest::reuse_buffers(HttpServerRequest &from) {
 	//reuse buffers from other request to avoid reallocations
-	std::swap(firstLine, from.firstLine);
 	std::swap(inHeaderData, from.inHeaderData);
 	std::swap(sendHeader, from.sendHeader);
 	std::swap(logBuffer, from.logBuffer);
-	firstLine.clear();
 	inHeaderData.clear();
 	sendHeader.clear();
 	logBuffer.clear();
+	//take unread body of the previous request, it is discarded before the next request is read
+	std::visit([&](auto &body) {
+		using T = std::decay_t<decltype(body)>;
+		if constexpr(std::is_same_v<T, LimitedStream<Stream &> >) {
+			if (body.getRemainingInput()) body.transferInput(bodyStream.emplace<T>(stream, 0, 0));
+		} else if constexpr(std::is_same_v<T, ChunkedStream<Stream &> >) {
+			if (body.hasRemainingInput()) body.transferInput(bodyStream.emplace<T>(stream, false, true));
+		}
+	}, from.bodyStream);
 }
 
 std::size_t HttpServerRequest::getIdent() const {
@@ -313,7 +576,37 @@ std::size_t HttpServerRequest::getIdent() const {
 void HttpServerRequest::initAsync(Stream &&stream, CallbackT<void(bool)> &&initDone) {
 	this->stream = std::move(stream);
 	ident = ++identCounter;
-	readHeaderAsync(0, [this, initDone = std::move(initDone)](bool v){
+	sendCountStart = this->stream.getSendCount();
+	AbstractStream *prevBody = getBodyDecoder();
+	if (prevBody) {
+		discardBodyAsync(Stream(prevBody, false), maxDiscardSize, [this, initDone = std::move(initDone)](bool ok) mutable {
+			abandonBody();
+			if (ok) {
+				readHeaderAndInit(std::move(initDone));
+			} else {
+				initDone(false);
+			}
+		});
+	} else {
+		readHeaderAndInit(std::move(initDone));
+	}
+}
+
+void HttpServerRequest::discardBodyAsync(Stream &&body, std::size_t limit, CallbackT<void(bool)> &&cb) {
+	body.read() >> [this, limit, cb = std::move(cb)](Stream &body, const std::string_view &data) mutable {
+		if (data.empty()) {
+			//malformed body can't be separated from the next request
+			cb(!body.timeouted() && !hasBodyError());
+		} else if (data.size() > limit) {
+			cb(false);
+		} else {
+			discardBodyAsync(std::move(body), limit - data.size(), std::move(cb));
+		}
+	};
+}
+
+void HttpServerRequest::readHeaderAndInit(CallbackT<void(bool)> &&initDone) {
+	readHeaderAsync([this, initDone = std::move(initDone)](bool v){
 		initTime = std::chrono::system_clock::now();
 		valid = v && parse() && processHeaders();
 		if (logger) logger->log(ReqEvent::init, *this);
@@ -329,12 +622,46 @@ const std::chrono::system_clock::time_point &HttpServerRequest::getRecvTime() co
 bool HttpServerRequest::init(Stream &&stream) {
 	this->stream = std::move(stream);
 	ident = ++identCounter;
+	sendCountStart = this->stream.getSendCount();
 	initTime = std::chrono::system_clock::now();
 	valid = readHeader() && parse() && processHeaders();
 	if (logger) logger->log(ReqEvent::init, *this);
 	return valid;
 }
 
+bool HttpServerRequest::canPipeline() const {
+	return valid && enableKeepAlive && !hasBody && !hasExpect
+			&& (method == "GET" || method == "HEAD")
+			&& !get(KnownHeader::upgrade).defined;
+}
+
+bool HttpServerRequest::takePipelined(HttpServerRequest &next) {
+	std::string_view data = stream.readBuffered();
+	std::string_view rest = data;
+	if (!data.empty() && next.readHeader(rest) && next.parse()
+			&& (next.method == "GET" || next.method == "HEAD")) {
+		//request must not have body, otherwise it can't be separated from the stream
+		auto ctlh = next.get(KnownHeader::content_length);
+		if (next.getBodyFraming() == BodyFraming::length
+				&& (!ctlh.defined || ctlh == "0")
+				&& !next.get(KnownHeader::expect).defined) {
+			stream.putBack(rest);
+			return true;
+		}
+	}
+	stream.putBack(data);
+	return false;
+}
+
+void HttpServerRequest::initPipelined(Stream &&output) {
+	this->stream = std::move(output);
+	ident = ++identCounter;
+	sendCountStart = this->stream.getSendCount();
+	initTime = std::chrono::system_clock::now();
+	valid = processHeaders();
+	if (logger) logger->log(ReqEvent::init, *this);
+}
+
 HttpServerRequest::~HttpServerRequest() {
 	try {
 		if (stream.valid()) {
@@ -342,7 +669,7 @@ HttpServerRequest::~HttpServerRequest() {
 				set(CONNECTION,CONN_CLOSE);
 				if (!valid) {
 					enableKeepAlive = false;
-					if (httpver.substr(0,5) == "HTTP/1") {
+					if (httpver.substr(0,6) == "HTTP/1") {
 						sendErrorPage(400);
 					} else {
 						logger = nullptr;
@@ -352,11 +679,14 @@ HttpServerRequest::~HttpServerRequest() {
 			}
 			stream.flush();
 			if (logger) logger->log(ReqEvent::done,*this);
-			if (enableKeepAlive && !hasBody && klcb != nullptr) klcb(stream, *this);
+			//unread body is taken by the next request through reuse_buffers()
+			if (enableKeepAlive && klcb != nullptr && prepareKeepAlive()) klcb(stream, *this);
 		}
 	} catch (...) {
 
 	}
+	abandonBody();
+	recycleBuffers();
 }
 
 bool HttpServerRequest::isValid() {
@@ -364,19 +694,14 @@ bool HttpServerRequest::isValid() {
 }
 
 Stream HttpServerRequest::getBody() {
-	Stream bodyStream;
 	if (hasBody) {
-		auto te = get(TRANSFER_ENCODING);
-		auto ctlh = get(CONTENT_LENGTH);
-		if (method == "GET" || method == "HEAD") {
-			bodyStream = Stream(std::make_unique<LimitedStream<Stream &> >(stream,0,0));
-		} else if (te.defined && te != TE_CHUNKED) {
-			bodyStream = Stream(std::make_unique<ChunkedStream<Stream &> >(stream, 0, true));
-		} else if (ctlh.defined) {
-			auto ctl = ctlh.getUInt();
-			bodyStream = Stream(std::make_unique<LimitedStream<Stream &> >(stream,ctl,0));
+		//framing doesn't depend on the method, otherwise the body of GET would be
+		//processed as the next request
+		if (getBodyFraming() == BodyFraming::chunked) {
+			bodyStream.emplace<ChunkedStream<Stream &> >(stream, false, true);
 		} else {
-			bodyStream = Stream(std::make_unique<LimitedStream<Stream &> >(stream,0,0));
+			auto ctl = get(KnownHeader::content_length).getUInt();
+			bodyStream.emplace<LimitedStream<Stream &> >(stream,ctl,0);
 		}
 		if (hasExpect) {
 			stream.writeNB(httpver);
@@ -385,32 +710,103 @@ Stream HttpServerRequest::getBody() {
 			stream.flush();
 		}
 		hasBody = false;
-	} else {
-		bodyStream = Stream(std::make_unique<LimitedStream<Stream &> >(stream,0,0));
+	} else if (std::holds_alternative<std::monostate>(bodyStream)) {
+		bodyStream.emplace<LimitedStream<Stream &> >(stream,0,0);
+	}
+	return Stream(getBodyDecoder(), false);
+
+}
+
+AbstractStream *HttpServerRequest::getBodyDecoder() {
+	return std::visit([](auto &x) -> AbstractStream * {
+		if constexpr(std::is_base_of_v<AbstractStream, std::decay_t<decltype(x)> >) return &x;
+		else return nullptr;
+	}, bodyStream);
+}
+
+bool HttpServerRequest::hasBodyError() const {
+	auto cs = std::get_if<ChunkedStream<Stream &> >(&bodyStream);
+	return cs && cs->hasError();
+}
+
+bool HttpServerRequest::prepareKeepAlive() {
+	if (hasBody) {
+		if (!canDiscardBody()) return false;
+		getBody();
+	}
+	//body read by the handler was malformed, the connection must be closed
+	if (hasBodyError()) return false;
+	//large body is not discarded, connection is closed instead
+	auto ls = std::get_if<LimitedStream<Stream &> >(&bodyStream);
+	return !ls || ls->getRemainingInput() <= maxDiscardSize;
+}
+
+bool HttpServerRequest::canDiscardBody() const {
+	//client waits for 100-continue, so the body was not sent
+	if (hasExpect) return false;
+	switch (getBodyFraming()) {
+		case BodyFraming::chunked: return true;
+		case BodyFraming::length: return get(KnownHeader::content_length).getUInt() <= maxDiscardSize;
+		default: return false;
 	}
-	return bodyStream;
+}
+
+HttpServerRequest::BodyFraming HttpServerRequest::getBodyFraming() const {
+	auto te = get(KnownHeader::transfer_encoding);
+	auto ctlh = get(KnownHeader::content_length);
+	if (!te.defined) {
+		if (!ctlh.defined) return BodyFraming::length;
+		std::string_view ctl = ctlh;
+		//value must be a number which doesn't overflow
+		bool digits = !ctl.empty() && ctl.size() < 19 && std::all_of(ctl.begin(), ctl.end(), [](char c) {return c >= '0' && c <= '9';});
+		return digits?BodyFraming::length:BodyFraming::invalid;
+	}
+	//both headers can be interpreted differently by other servers on the way
+	if (ctlh.defined) return BodyFraming::invalid;
+	//repeated headers are folded into single list
+	std::string_view list = te;
+	bool chunked = false;
+	bool unsupported = false;
+	while (!list.empty()) {
+		auto coding = splitAt(",", list);
+		trim(coding);
+		if (coding.empty()) continue;
+		//chunked must be the last coding and can't be applied twice
+		if (chunked) return BodyFraming::invalid;
+		if (HeaderValue::iequal(coding, TE_CHUNKED)) chunked = true;
+		else unsupported = true;
+	}
+	if (!chunked) return BodyFraming::invalid;
+	return unsupported?BodyFraming::unsupported:BodyFraming::chunked;
+}
 
+void HttpServerRequest::abandonBody() {
+	//don't read rest of the body synchronously
+	std::visit([](auto &x) {
+		if constexpr(!std::is_same_v<std::decay_t<decltype(x)>, std::monostate>) x.abandonInput();
+	}, bodyStream);
+	bodyStream.emplace<std::monostate>();
 }
 
 bool HttpServerRequest::processHeaders() {
-	auto te = get(TRANSFER_ENCODING);
-	auto ctlh = get(CONTENT_LENGTH);
-	if (te.defined && te != TE_CHUNKED && !ctlh.defined) {
-		sendErrorPage(411);return false;
+	switch (getBodyFraming()) {
+		case BodyFraming::invalid: sendErrorPage(400);return false;
+		case BodyFraming::unsupported: sendErrorPage(501);return false;
+		case BodyFraming::chunked: hasBody = true;break;
+		default: hasBody = get(KnownHeader::content_length).getUInt() != 0;break;
 	}
-	hasBody = te == TE_CHUNKED || (ctlh.defined && ctlh != "0");
-	host = get("Host");
+	host = get(KnownHeader::host);
 
 	if (httpver == "HTTP/1.1") {
-		if (get(CONNECTION) != CONN_CLOSE) {
+		if (get(KnownHeader::connection) != CONN_CLOSE) {
 			enableKeepAlive = true;
 		}
 	} else {
-		if (get(CONNECTION) == "keep-alive") {
+		if (get(KnownHeader::connection) == "keep-alive") {
 			enableKeepAlive = true;
 		}
 	}
-	auto expect = get("Expect");
+	auto expect = get(KnownHeader::expect);
 	if (expect.defined) {
 		if (!HeaderValue::iequal(expect ,"100-continue")) {
 			sendErrorPage(417);
@@ -425,67 +821,59 @@ bool HttpServerRequest::processHeaders() {
 
 
 void HttpServerRequest::set(const std::string_view &key, const std::string_view &value) {
-	if (HeaderValue::iequal(key, CONTENT_TYPE)) {
+	switch (HeaderValue::classify(key)) {
+	case KnownHeader::content_type:
 		has_content_type = true;
-	}
-	else if (HeaderValue::iequal(key, CONTENT_LENGTH)) {
+		compressible = CompressStream::isCompressible(value);
+		break;
+	case KnownHeader::content_encoding:
+		has_content_encoding = true;
+		break;
+	case KnownHeader::content_length: {
 		has_content_length = true;
 		HeaderValue hv(value);
 		send_content_length = hv.getUInt();
-	}
-	else if (HeaderValue::iequal(key, DATE)) {
+		} break;
+	case KnownHeader::date:
 		has_date = true;
-	}
-	else if (HeaderValue::iequal(key, TRANSFER_ENCODING)) {
+		break;
+	case KnownHeader::transfer_encoding:
 		has_transfer_encoding = true;
 		if (HeaderValue::iequal(value,TE_CHUNKED)) {
 			has_transfer_encoding_chunked = true;
 		}
-	}
-	else if (HeaderValue::iequal(key, CONNECTION)) {
+		break;
+	case KnownHeader::connection:
 		has_connection = true;
 		if (HeaderValue::iequal(value, CONN_CLOSE)) enableKeepAlive = false;
-	} else if (HeaderValue::iequal(key, "Last-Modified") || HeaderValue::iequal(key, "ETag")) {
+		break;
+	case KnownHeader::last_modified:
 		has_last_modified = true;
-	}
-	else if (HeaderValue::iequal(key, "Server")) {
+		break;
+	case KnownHeader::etag:
+		has_last_modified = true;
+		//value follows CRLF, key and ": "
+		etagPos = sendHeader.size() + key.size() + 4;
+		break;
+	case KnownHeader::server:
 		has_server = true;
+		break;
+	default:
+		break;
 	}
-
-	std::string_view crlf(CRLF);
-	std::string_view sep(": ");
-	std::copy(crlf.begin(), crlf.end(), std::back_inserter(sendHeader));
-	std::copy(key.begin(), key.end(), std::back_inserter(sendHeader));
-	std::copy(sep.begin(), sep.end(), std::back_inserter(sendHeader));
-	std::copy(value.begin(), value.end(), std::back_inserter(sendHeader));
-}
-
-static char *numToStr(char *buff, std::size_t x) {
-	if (x) {
-		char *c = numToStr(buff, x/10);
-		*c = '0'+(x%10);
-		return c+1;
-	} else {
-		return buff;
-	}
+	appendHeader(CRLF);
+	appendHeader(key);
+	appendHeader(": ");
+	appendHeader(value);
 }
 
-static void putCode(Stream &stream, std::size_t x) {
-	if (x) {
-		putCode(stream, x/10);
-		stream.putCharNB('0' + (x%10));
-	}
+void HttpServerRequest::appendHeader(const std::string_view &data) {
+	sendHeader.insert(sendHeader.end(), data.begin(), data.end());
 }
 
 void HttpServerRequest::set(const std::string_view &key, std::size_t number) {
-	if (number == 0) {
-		set(key,"0");
-	}
-	else {
-		char buff[40];
-		*numToStr(buff, number) = 0;
-		set(key, buff);
-	}
+	char buff[maxIntegerChars];
+	set(key, std::string_view(buff, formatUnsigned(buff, std::end(buff), number) - buff));
 }
 
 void HttpServerRequest::setStatus(int code) {
@@ -502,7 +890,41 @@ void HttpServerRequest::setContentType(const std::string_view &contentType) {
 	set("Content-Type",contentType);
 }
 
+ContentEncoding HttpServerRequest::selectEncoding(std::size_t size) {
+	if (!compressEnabled || !compressible || has_content_encoding || has_content_length
+			|| size < compressMinSize
+			|| statusCode < 200 || statusCode == 204 || statusCode == 206 || statusCode == 304) {
+		return ContentEncoding::identity;
+	}
+	return CompressStream::negotiate(get(KnownHeader::accept_encoding));
+}
+
+void HttpServerRequest::setContentEncoding(ContentEncoding enc) {
+	set(CONTENT_ENCODING, CompressStream::getName(enc));
+	set(VARY, ACCEPT_ENCODING);
+	//compressed content is not byte-identical with the tagged content
+	if (etagPos && etagPos < sendHeader.size() && sendHeader[etagPos] == '"') {
+		sendHeader.insert(sendHeader.begin() + etagPos, {'W', '/'});
+	}
+}
+
+static thread_local std::vector<char> compressBuffer;
+
 void HttpServerRequest::send(const std::string_view &body) {
+	ContentEncoding enc = selectEncoding(body.size());
+	if (enc != ContentEncoding::identity) {
+		std::vector<char> &buff = compressBuffer;
+		if (CompressStream::compress(enc, body, buff) && buff.size() < body.size()) {
+			setContentEncoding(enc);
+			set(CONTENT_LENGTH, buff.size());
+			Stream s = send();
+			s.write(std::string_view(buff.data(), buff.size()));
+			s.flush();
+			//large buffers are not kept
+			if (buff.capacity() > 4 * CompressStream::bufferSize) std::vector<char>().swap(buff);
+			return;
+		}
+	}
 	if (!has_content_length && statusCode != 204 && statusCode != 304) {
 		set("Content-Length", body.length());
 	}
@@ -515,60 +937,81 @@ Stream HttpServerRequest::send() {
 	if (response_sent) {
 		throw std::runtime_error("Response already sent (can't use send() twice during single request)s");
 	}
-	if (hasBody && !hasExpect) {
-		//handler did not pick body - and Expect: 100-continue is not set
-		//this can happen, when error is send without reading body
+	if (hasBody && !canDiscardBody()) {
+		//handler did not pick body and the body cannot be discarded by the next request
 		//this request cannot be kept alive, because body will not be read
 		enableKeepAlive = false;
 	}
-	bool nocontent = statusCode == 204 || statusCode == 304;
+	bool nocontent = statusCode < 200 || statusCode == 204 || statusCode == 304;
+	ContentEncoding enc = selectEncoding(~std::size_t(0));
+	if (enc != ContentEncoding::identity) setContentEncoding(enc);
+	//fixed headers are appended pre-serialized, without classification
 	if (!nocontent) {
 		if (!has_content_type) {
-			set("Content-Type","application/octet-stream");
+			appendHeader(CRLF CONTENT_TYPE ": application/octet-stream");
+			has_content_type = true;
 		}
 		if (!has_transfer_encoding) {
 			if (!has_content_length) {
 				if (enableKeepAlive && httpver == "HTTP/1.1") {
-					set("Transfer-Encoding", "chunked");
+					appendHeader(CRLF TRANSFER_ENCODING ": " TE_CHUNKED);
+					has_transfer_encoding = has_transfer_encoding_chunked = true;
 				} else if (!has_connection) {
-					set("Connection","close");
+					appendHeader(CRLF CONNECTION ": " CONN_CLOSE);
+					has_connection = true;
+					enableKeepAlive = false;
 				}
 			}
 		}
 	}
 	if (!has_connection && !enableKeepAlive) {
-		set("Connection","close");
+		appendHeader(CRLF CONNECTION ": " CONN_CLOSE);
+		has_connection = true;
 	}
 	if (!has_date) {
-		httpDate(time(0), [&](std::string_view d){
-			set("Date", d);
-		});
+		appendHeader(CRLF DATE ": ");
+		appendHeader(cachedHttpDate());
+		has_date = true;
 	}
 
 	if (!has_server) {
-		set("Server","userver");
+		appendHeader(CRLF "Server: userver");
+		has_server = true;
 	}
 
-	std::string_view statusMsg;
-	if (statusMessage.empty()) statusMsg = getStatusCodeMsg(statusCode); else statusMsg = statusMessage;
+	std::string_view statusLine = statusMessage.empty()?statusLineTable.get(statusCode):std::string_view();
 	stream.writeNB(httpver);
-	stream.putCharNB(' ');
-	putCode(stream, statusCode);
-	stream.putCharNB(' ');
-	stream.writeNB(statusMsg);
+	if (!statusLine.empty()) {
+		stream.writeNB(" ");
+		stream.writeNB(statusLine);
+	} else {
+		std::string_view statusMsg;
+		if (statusMessage.empty()) statusMsg = getStatusCodeMsg(statusCode); else statusMsg = statusMessage;
+		stream.formatNB(" %d %s", statusCode, statusMsg);
+	}
 	stream.writeNB(std::string_view(sendHeader.data(), sendHeader.size()));
 	stream.writeNB("\r\n\r\n");
 	response_sent = true;
 	if (logger) logger->log(ReqEvent::header_sent,*this);
 	if (nocontent || method == "HEAD" ) {
 		return Stream(std::make_unique<LimitedStream<Stream &> >(stream, 0, 0));
-	} else if (has_transfer_encoding_chunked) {
-		return Stream(std::make_unique<ChunkedStream<Stream &> >(stream, maxChunkSize,false));
+	}
+	Stream s;
+	if (has_transfer_encoding_chunked) {
+		s = Stream(std::make_unique<ChunkedStream<Stream &> >(stream, maxChunkSize,false));
 	} else if (has_content_length) {
 		return Stream(std::make_unique<LimitedStream<Stream &> >(stream, 0, send_content_length));
 	} else {
-		return Stream(stream.makeReference());
+		s = Stream(stream.makeReference());
+	}
+	if (enc != ContentEncoding::identity) {
+		return Stream(std::make_unique<CompressStream>(std::move(s), enc));
 	}
+	return s;
+}
+
+std::size_t HttpServerRequest::getSendCount() const {
+	return stream.valid()?stream.getSendCount() - sendCountStart:0;
 }
 
 unsigned int HttpServerRequest::getStatus() const {
@@ -627,15 +1070,76 @@ void HttpServerRequest::setCookie(const std::string_view &name,
 
 
 bool HttpServerRequest::parseHeaders(std::string_view &dt) {
+	//repeated well known headers, they are folded once all headers are parsed
+	std::vector<std::pair<KnownHeader, std::string_view> > repeated;
 	while (!dt.empty()) {
 		auto ln = splitAt(CRLF, dt);
 		auto key = splitAt(":", ln);
 		auto value = ln;
 		trim(key);
 		trim(value);
-		inHeader.push_back(std::pair(key,value));
+		KnownHeader kh = HeaderValue::classify(key);
+		if (kh != KnownHeader::unknown) {
+			std::string_view &slot = knownHeaders[static_cast<std::size_t>(kh)];
+			if (slot.data() == nullptr) slot = value;
+			else repeated.push_back(std::pair(kh, value));
+		} else {
+			inHeader.push_back(std::pair(key,value));
+		}
 	}
 	std::sort(inHeader.begin(), inHeader.end(), HeaderValue::lessHeader);
+	return repeated.empty() || foldHeaders(repeated);
+}
+
+///Folds repeated well known headers
+/**
+ * Values of list headers are joined in order of occurrence. Other headers keep the first
+ * value. Different values of Host or Content-Length make the request invalid, because
+ * they would be interpreted differently by other servers on the way
+ *
+ * @param repeated second and further occurrences of headers
+ * @retval true success
+ * @retval false invalid request
+ */
+bool HttpServerRequest::foldHeaders(std::vector<std::pair<KnownHeader, std::string_view> > &repeated) {
+	std::stable_sort(repeated.begin(), repeated.end(), [](const auto &a, const auto &b) {
+		return a.first < b.first;
+	});
+	//whole storage is reserved at once, so folded values are not moved while they are built
+	std::size_t sz = 0;
+	for (auto iter = repeated.begin(); iter != repeated.end(); ++iter) {
+		auto sep = HeaderValue::getListSeparator(iter->first);
+		if (sep.empty()) continue;
+		if (iter == repeated.begin() || std::prev(iter)->first != iter->first) {
+			sz += knownHeaders[static_cast<std::size_t>(iter->first)].size();
+		}
+		sz += sep.size() + iter->second.size();
+	}
+	foldedHeaders.clear();
+	foldedHeaders.reserve(sz);
+	auto iter = repeated.begin();
+	while (iter != repeated.end()) {
+		KnownHeader kh = iter->first;
+		std::string_view &slot = knownHeaders[static_cast<std::size_t>(kh)];
+		auto sep = HeaderValue::getListSeparator(kh);
+		if (sep.empty()) {
+			if ((kh == KnownHeader::host || kh == KnownHeader::content_length) && iter->second != slot) {
+				return false;
+			}
+			++iter;
+			continue;
+		}
+		std::size_t start = foldedHeaders.size();
+		foldedHeaders.insert(foldedHeaders.end(), slot.begin(), slot.end());
+		for (; iter != repeated.end() && iter->first == kh; ++iter) {
+			if (iter->second.empty()) continue;
+			if (foldedHeaders.size() > start) foldedHeaders.insert(foldedHeaders.end(), sep.begin(), sep.end());
+			foldedHeaders.insert(foldedHeaders.end(), iter->second.begin(), iter->second.end());
+		}
+		if (foldedHeaders.size() > start) {
+			slot = std::string_view(foldedHeaders.data() + start, foldedHeaders.size() - start);
+		}
+	}
 	return true;
 }
 
@@ -738,7 +1242,7 @@ bool HttpServerRequest::sendFile(std::unique_ptr<HttpServerRequest> &&reqptr, co
 		*p++='"';
 		*p = 0;
 		std::string_view curEtag(hexBuff, p-hexBuff);
-		for (auto etg = std::string_view(reqptr->get("If-None-Match")); !etg.empty();) {
+		for (auto etg = std::string_view(reqptr->get(KnownHeader::if_none_match)); !etg.empty();) {
 			auto tag = splitAt(",", etg);
 			trim(tag);
 			if (tag == curEtag) {
@@ -752,6 +1256,7 @@ bool HttpServerRequest::sendFile(std::unique_ptr<HttpServerRequest> &&reqptr, co
 	if (!reqptr->has_content_type) {
 		reqptr->setContentTypeFromExt(p.extension().string());
 	}
+#ifdef _WIN32
 	std::unique_ptr<std::istream> file (std::make_unique<std::fstream>(p, std::ios::binary | std::ios::in ));
 	if (!(*file)) {
 		return false;
@@ -774,6 +1279,27 @@ bool HttpServerRequest::sendFile(std::unique_ptr<HttpServerRequest> &&reqptr, co
 			}
 		}
 	}
+#else
+	int fd = ::open(p.c_str(), O_RDONLY|O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	auto file = std::make_unique<FileDesc>(fd);
+	struct stat st;
+	if (!file->isRegular() || fstat(fd, &st)) {
+		reqptr->sendErrorPage(403);
+	} else if (st.st_size == 0) {
+		reqptr->sendErrorPage(204);
+	} else {
+		reqptr->set(CONTENT_LENGTH,static_cast<std::size_t>(st.st_size));
+		Stream out = reqptr->send();
+		if (out.canSendFile()) {
+			sendFileDirect(reqptr, file, out, 0, st.st_size);
+		} else {
+			sendFileAsync(reqptr, file, out, st.st_size);
+		}
+	}
+#endif
 	return true;
 	} catch (std::exception &e) {
 		reqptr->log(LogLevel::error, e.what());
@@ -781,6 +1307,7 @@ bool HttpServerRequest::sendFile(std::unique_ptr<HttpServerRequest> &&reqptr, co
 	}
 }
 
+#ifdef _WIN32
 void HttpServerRequest::sendFileAsync(std::unique_ptr<HttpServerRequest> &reqptr, std::unique_ptr<std::istream>&in, Stream &out) {
 	char buff[10000];
 	while (!(!(*in))) {
@@ -804,11 +1331,178 @@ void HttpServerRequest::sendFileAsync(std::unique_ptr<HttpServerRequest> &reqptr
 		// empty
 	};
 }
+#else
+void HttpServerRequest::sendFileAsync(std::unique_ptr<HttpServerRequest> &reqptr, std::unique_ptr<FileDesc> &in, Stream &out, std::uint64_t remain) {
+	if (remain == 0) {
+		//empty flush async, just held request until flushed
+		out.flush() >>[reqptr = std::move(reqptr)]() {
+			// empty
+		};
+		return;
+	}
+	std::size_t sz = static_cast<std::size_t>(std::min<std::uint64_t>(remain, sendFileBlockSize));
+	//read directly into the output buffer when possible
+	char *buff = out.reserveNB(sz);
+	std::unique_ptr<char[]> tmp;
+	if (buff == nullptr) {
+		tmp = std::make_unique<char[]>(sz);
+		buff = tmp.get();
+	}
+	FileDesc &f = *in;
+	f.read(buff, sz, [reqptr = std::move(reqptr), in = std::move(in), out = std::move(out), tmp = std::move(tmp), buff, remain](int r) mutable {
+		if (tmp == nullptr) out.commitNB(r);
+		if (r <= 0) {
+			//file truncated or read error - connection is closed because the content is incomplete
+			reqptr->log(LogLevel::error, in->timeouted()?"sendFile: unable to read file":"sendFile: file truncated");
+			reqptr->enableKeepAlive = false;
+			reqptr->stream.closeOutput();
+			return;
+		}
+		if (tmp != nullptr) out.writeNB(std::string_view(buff, r));
+		out.flush() >> [reqptr = std::move(reqptr), in = std::move(in), remain = remain - r](Stream &out, bool ok) mutable {
+			if (ok) {
+				sendFileAsync(reqptr, in, out, remain);
+			}
+		};
+	});
+}
+
+void HttpServerRequest::sendFileDirect(std::unique_ptr<HttpServerRequest> &reqptr, std::unique_ptr<FileDesc> &in, Stream &out, std::uint64_t offset, std::uint64_t remain) {
+	if (remain == 0) {
+		//empty flush async, just held request until flushed
+		out.flush() >>[reqptr = std::move(reqptr)]() {
+			// empty
+		};
+		return;
+	}
+	Stream ref = out.makeReference();
+	std::size_t sz = static_cast<std::size_t>(std::min<std::uint64_t>(remain, 0x40000000));
+	int fd = in->getHandle();
+	ref.sendFileAsync(fd, offset, sz, [reqptr = std::move(reqptr), in = std::move(in), out = std::move(out), offset, remain](int r) mutable {
+		if (r <= 0) {
+			//connection is closed because the content is incomplete
+			reqptr->log(LogLevel::error, "sendFile: unable to send file");
+			reqptr->enableKeepAlive = false;
+			reqptr->stream.closeOutput();
+			return;
+		}
+		sendFileDirect(reqptr, in, out, offset + r, remain - r);
+	});
+}
+#endif
+
+///Node of the path trie (compressed radix trie)
+/** Published nodes are never modified. Modification copies nodes on the way from the root
+ * to the modified node, other nodes are shared with previous version */
+struct HttpServerMapper::RouteNode {
+	using PNode = std::shared_ptr<const RouteNode>;
+	///Label of the edge from the parent
+	std::string label;
+	std::shared_ptr<Handler> handler;
+	///Children ordered by the first character of their labels
+	std::vector<PNode> children;
+
+	std::vector<PNode>::const_iterator findChild(char c) const {
+		return std::lower_bound(children.begin(), children.end(), c, [](const PNode &n, char c) {
+			return n->label[0] < c;
+		});
+	}
+
+	///Creates new version of the node with modified handler
+	/**
+	 * @param rest rest of the path after the label of this node
+	 * @param h new handler, nullptr to remove the handler
+	 * @return new version of the node, or nullptr if there is nothing to change
+	 */
+	PNode set(std::string_view rest, const std::shared_ptr<Handler> &h) const {
+		if (rest.empty()) {
+			if (h != nullptr && handler != nullptr) return nullptr;
+			auto n = std::make_shared<RouteNode>(*this);
+			n->handler = h;
+			return n;
+		}
+		auto iter = findChild(rest[0]);
+		if (iter == children.end() || (*iter)->label[0] != rest[0]) {
+			if (h == nullptr) return nullptr;
+			auto n = std::make_shared<RouteNode>(*this);
+			auto leaf = std::make_shared<RouteNode>();
+			leaf->label = rest;
+			leaf->handler = h;
+			n->children.insert(n->children.begin() + (iter - children.begin()), std::move(leaf));
+			return n;
+		}
+		const RouteNode &child = **iter;
+		std::size_t common = 0;
+		std::size_t maxc = std::min(child.label.size(), rest.size());
+		while (common < maxc && child.label[common] == rest[common]) ++common;
+		PNode newChild;
+		if (common == child.label.size()) {
+			newChild = child.set(rest.substr(common), h);
+			if (newChild == nullptr) return nullptr;
+		} else {
+			if (h == nullptr) return nullptr;
+			//split the edge, the child continues below the new node
+			auto split = std::make_shared<RouteNode>();
+			auto tail = std::make_shared<RouteNode>(child);
+			split->label = child.label.substr(0, common);
+			tail->label = child.label.substr(common);
+			if (common == rest.size()) {
+				split->handler = h;
+				split->children.push_back(std::move(tail));
+			} else {
+				auto leaf = std::make_shared<RouteNode>();
+				leaf->label = rest.substr(common);
+				leaf->handler = h;
+				bool leafFirst = leaf->label[0] < tail->label[0];
+				split->children.push_back(leafFirst?std::move(leaf):std::move(tail));
+				split->children.push_back(leafFirst?std::move(tail):std::move(leaf));
+			}
+			newChild = std::move(split);
+		}
+		auto n = std::make_shared<RouteNode>(*this);
+		n->children[iter - children.begin()] = std::move(newChild);
+		return n;
+	}
+
+	///Finds handler of the longest registered prefix of the path
+	/**
+	 * Prefix matches, when it is whole path or it is followed by '/'
+	 *
+	 * @param path path
+	 * @param limit only prefixes shorter than limit are considered
+	 * @param len receives length of found prefix
+	 * @return found node, or nullptr
+	 */
+	const RouteNode *match(std::string_view path, std::size_t limit, std::size_t &len) const {
+		const RouteNode *node = this;
+		const RouteNode *found = nullptr;
+		std::size_t pos = 0;
+		while (pos < limit) {
+			if (node->handler != nullptr && (pos == path.size() || path[pos] == '/')) {
+				found = node;
+				len = pos;
+			}
+			if (pos == path.size()) break;
+			auto iter = node->findChild(path[pos]);
+			if (iter == node->children.end()) break;
+			const RouteNode *child = iter->get();
+			if (path.compare(pos, child->label.size(), child->label) != 0) break;
+			pos += child->label.size();
+			node = child;
+		}
+		return found;
+	}
+};
 
 void HttpServerMapper::addPath(const std::string_view &path, Handler &&handler) {
-	std::lock_guard _(mapping->shrmux);
-	if (handler == nullptr) mapping->pathMapping.erase(std::string(path));
-	else mapping->pathMapping.emplace(std::string(path), std::move(handler));
+	std::lock_guard _(mapping->routeLock);
+	std::shared_ptr<Handler> h;
+	if (handler != nullptr) h = std::make_shared<Handler>(std::move(handler));
+	static const RouteNode emptyRoot;
+	RouteNode::PNode root = std::atomic_load(&mapping->routes);
+	RouteNode::PNode newRoot = (root?root.get():&emptyRoot)->set(path, h);
+	if (newRoot == nullptr) return;
+	std::atomic_store(&mapping->routes, std::move(newRoot));
 }
 
 /*void HttpServerMapper::serve(Stream &&stream) {
@@ -821,19 +1515,18 @@ void HttpServerMapper::addPath(const std::string_view &path, Handler &&handler)
 
 bool HttpServerMapper::execHandler(PHttpServerRequest &req, const std::string_view &vpath) {
 	try {
-		std::shared_lock _(mapping->shrmux);
 		std::string_view curvpath = vpath;
 		curvpath = splitAt("?", curvpath);
-
-		while (true) {
-			auto iter = mapping->pathMapping.find(curvpath);
-			if (iter != mapping->pathMapping.end()) {
-				std::string_view restPath = vpath.substr(curvpath.size());
-				if (req == nullptr || iter->second(req, restPath)) return true;
-			}
-			auto spos = curvpath.rfind('/');
-			if (spos == curvpath.npos) break;
-			curvpath = curvpath.substr(0,spos);
+		//the version is held until the handler returns, so it can't be released by addPath
+		RouteNode::PNode root = std::atomic_load(&mapping->routes);
+		if (root == nullptr) return false;
+		//when the handler refuses the request, shorter prefixes are tried
+		std::size_t limit = curvpath.size() + 1;
+		std::size_t len;
+		while (const RouteNode *node = root->match(curvpath, limit, len)) {
+			std::string_view restPath = vpath.substr(len);
+			if (req == nullptr || (*node->handler)(req, restPath)) return true;
+			limit = len;
 		}
 		return false;
 	} catch (std::exception &e) {
@@ -850,38 +1543,187 @@ bool HttpServerMapper::execHandler(PHttpServerRequest &req, const std::string_vi
 	}
 }
 
+///Table of detected prefixes of hosts
+/**
+ * The table has fixed count of slots organized to buckets. Slot holds the host and
+ * its prefix packed in atomic words and it is guarded by a sequence number (seqlock). Readers
+ * never wait nor write to the slot except the reference flag. Writer acquires the slot by
+ * making the sequence odd. If the slot is already being written, the update is skipped, the
+ * prefix is detected again by some future request.
+ *
+ * When the bucket is full, the writer replaces first slot which was not referenced since last
+ * scan (clock algorithm)
+ */
+struct HttpServerMapper::HostCache {
+	static constexpr std::size_t maxHost = 128;
+	static constexpr std::size_t maxPrefix = 120;
+	static constexpr std::size_t ways = 4;
+	static constexpr std::size_t words = (maxHost + maxPrefix + 7) / 8;
+
+	struct Slot {
+		///sequence number, odd while the slot is written
+		std::atomic<std::uint32_t> seq = 0;
+		///hash of the host, 0 - slot is empty
+		std::atomic<std::uint32_t> hash = 0;
+		std::atomic<std::uint32_t> hostLen = 0;
+		std::atomic<std::uint32_t> prefixLen = 0;
+		std::atomic<bool> referenced = false;
+		///host followed by the prefix
+		std::atomic<std::uint64_t> data[words] = {};
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::size_t buckets;
+
+	HostCache(std::size_t size) {
+		buckets = 1;
+		while (buckets * ways < size) buckets <<= 1;
+		slots = std::make_unique<Slot[]>(buckets * ways);
+	}
+
+	static std::uint32_t hashOf(std::string_view host) {
+		std::uint32_t h = 2166136261U;
+		for (char c: host) {
+			h = (h ^ static_cast<unsigned char>(c)) * 16777619U;
+		}
+		return h?h:1;
+	}
+
+	Slot *bucket(std::uint32_t hash) const {
+		return slots.get() + (hash & (buckets - 1)) * ways;
+	}
+
+	///Find the host
+	/**
+	 * @param host host
+	 * @param hash hash of the host
+	 * @param prefix buffer of maxPrefix bytes, receives the prefix
+	 * @param plen receives length of the prefix
+	 * @return slot containing the host, or nullptr if not found
+	 */
+	Slot *find(std::string_view host, std::uint32_t hash, char *prefix, std::size_t &plen) const {
+		if (host.size() > maxHost) return nullptr;
+		char buff[words * 8];
+		Slot *b = bucket(hash);
+		for (std::size_t i = 0; i < ways; i++) {
+			Slot &s = b[i];
+			//few attempts when the slot is being modified, then it is considered as not found
+			for (int attempt = 0; attempt < 3; attempt++) {
+				std::uint32_t seq = s.seq.load(std::memory_order_acquire);
+				if (seq & 1) continue;
+				if (s.hash.load(std::memory_order_relaxed) != hash) break;
+				std::size_t hl = s.hostLen.load(std::memory_order_relaxed);
+				std::size_t pl = s.prefixLen.load(std::memory_order_relaxed);
+				if (hl != host.size() || pl > maxPrefix) break;
+				std::size_t cnt = (hl + pl + 7) / 8;
+				for (std::size_t j = 0; j < cnt; j++) {
+					std::uint64_t w = s.data[j].load(std::memory_order_relaxed);
+					std::memcpy(buff + j * 8, &w, 8);
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (s.seq.load(std::memory_order_relaxed) != seq) continue;
+				if (host != std::string_view(buff, hl)) break;
+				std::memcpy(prefix, buff + hl, pl);
+				plen = pl;
+				if (!s.referenced.load(std::memory_order_relaxed)) {
+					s.referenced.store(true, std::memory_order_relaxed);
+				}
+				return &s;
+			}
+		}
+		return nullptr;
+	}
+
+	///Store prefix of the host
+	/** Hosts and prefixes longer than limits are not stored */
+	void store(std::string_view host, std::uint32_t hash, std::string_view prefix) {
+		if (host.size() > maxHost || prefix.size() > maxPrefix) return;
+		Slot *b = bucket(hash);
+		char tmp[maxPrefix];
+		std::size_t tmplen;
+		Slot *s = find(host, hash, tmp, tmplen);
+		if (s == nullptr) {
+			for (std::size_t i = 0; i < ways && s == nullptr; i++) {
+				if (b[i].hash.load(std::memory_order_relaxed) == 0) s = b+i;
+			}
+			for (std::size_t i = 0; i < ways && s == nullptr; i++) {
+				if (!b[i].referenced.exchange(false, std::memory_order_relaxed)) s = b+i;
+			}
+			if (s == nullptr) s = b + (hash >> 24) % ways;
+		}
+		std::uint32_t seq = s->seq.load(std::memory_order_relaxed);
+		if ((seq & 1) || !s->seq.compare_exchange_strong(seq, seq+1, std::memory_order_relaxed)) return;
+		std::atomic_thread_fence(std::memory_order_release);
+		char buff[words * 8] = {};
+		std::copy(prefix.begin(), prefix.end(), std::copy(host.begin(), host.end(), buff));
+		std::size_t cnt = (host.size() + prefix.size() + 7) / 8;
+		for (std::size_t j = 0; j < cnt; j++) {
+			std::uint64_t w;
+			std::memcpy(&w, buff + j * 8, 8);
+			s->data[j].store(w, std::memory_order_relaxed);
+		}
+		s->hostLen.store(static_cast<std::uint32_t>(host.size()), std::memory_order_relaxed);
+		s->prefixLen.store(static_cast<std::uint32_t>(prefix.size()), std::memory_order_relaxed);
+		s->hash.store(hash, std::memory_order_relaxed);
+		s->referenced.store(true, std::memory_order_relaxed);
+		s->seq.store(seq+2, std::memory_order_release);
+	}
+
+	///Forget the host
+	void erase(std::string_view host, std::uint32_t hash) {
+		char tmp[maxPrefix];
+		std::size_t tmplen;
+		Slot *s = find(host, hash, tmp, tmplen);
+		if (s == nullptr) return;
+		std::uint32_t seq = s->seq.load(std::memory_order_relaxed);
+		if ((seq & 1) || !s->seq.compare_exchange_strong(seq, seq+1, std::memory_order_relaxed)) return;
+		std::atomic_thread_fence(std::memory_order_release);
+		s->hash.store(0, std::memory_order_relaxed);
+		s->seq.store(seq+2, std::memory_order_release);
+	}
+};
+
+std::size_t HttpServerMapper::hostCacheSize = 256;
+
 HttpServerMapper::HttpServerMapper() {
 	mapping = std::make_shared<PathMapping>();
+	mapping->hostCache = std::make_shared<HostCache>(hostCacheSize);
 }
 
 bool HttpServerMapper::execHandlerByHost(PHttpServerRequest &req) {
 
 	if (!req->isValid()) return true;
-	std::string host (req->getHost());
-	std::string vpathbuff ( req->getPath());
-	std::string_view vpath(vpathbuff);
-	std::string_view prefix;
-	std::shared_lock _(mapping->shrmux);
-	auto iter = mapping->hostMapping.find(host);
-	auto iend = mapping->hostMapping.end();
-	if (iter == iend) {
+	//views point to the request, which can be destroyed by a handler which accepted it. Values
+	//needed after the request is accepted are copied to the buffers on stack
+	std::string_view host = req->getHost();
+	std::string_view vpath = req->getPath();
+	HostCache &cache = *mapping->hostCache;
+	std::uint32_t hash = HostCache::hashOf(host);
+	char hostbuff[HostCache::maxHost];
+	char prefixbuff[HostCache::maxPrefix];
+	std::size_t plen;
+	auto copyHost = [&]{
+		if (host.size() > HostCache::maxHost) return std::string_view();
+		std::copy(host.begin(), host.end(), hostbuff);
+		return std::string_view(hostbuff, host.size());
+	};
+	if (!cache.find(host, hash, prefixbuff, plen)) {
+		std::string_view hostCopy = copyHost();
+		bool cacheable = hostCopy.size() == host.size();
 		req->setRootOffset(0);
 		if (execHandler(req, vpath)) {
-			_.unlock();
-			std::unique_lock __(mapping->shrmux);
-			mapping->hostMapping.emplace(std::move(host), "");
+			if (cacheable) cache.store(hostCopy, hash, std::string_view());
 			return true;
 		}
 
 		auto q = vpath.find('?');
 		auto p = vpath.find('/',1);
 		while (p<q) {
-			prefix = vpath.substr(0, p);
+			bool fits = p <= HostCache::maxPrefix;
+			if (fits) std::copy(vpath.begin(), vpath.begin() + p, prefixbuff);
 			req->setRootOffset(p);
 			if (execHandler(req, vpath.substr(p))) {
-				_.unlock();
-				std::unique_lock __(mapping->shrmux);
-				mapping->hostMapping[host] = prefix;
+				if (cacheable && fits) cache.store(hostCopy, hash, std::string_view(prefixbuff, p));
 				return true;
 			}
 			p = vpath.find('/',p+1);
@@ -889,19 +1731,14 @@ bool HttpServerMapper::execHandlerByHost(PHttpServerRequest &req) {
 		if (req->directoryRedir()) return true;
 
 	} else {
-		prefix = iter->second;
+		std::string_view prefix(prefixbuff, plen);
 
 		if (vpath == "/" && req->getMethod() == "DELETE" && !req->isBodyAvailable()) {//special uri - clear mapping
-			if (iter != iend) {
-				_.unlock();
-				std::unique_lock __(mapping->shrmux);
-				mapping->hostMapping.erase(iter);
-			}
+			cache.erase(host, hash);
 			req->sendErrorPage(202);
 			return true;
 		}
 
-		auto plen = prefix.length();
 		req->setRootOffset(plen);
 		if (vpath.length() > plen
 			&& vpath.substr(0,plen) == prefix
@@ -913,6 +1750,7 @@ bool HttpServerMapper::execHandlerByHost(PHttpServerRequest &req) {
 			if (req->directoryRedir()) return true;
 		}
 
+		std::string_view hostCopy = copyHost();
 		while (!prefix.empty()) {
 			auto c = prefix.rfind('/');
 			if (c != prefix.npos) {
@@ -926,9 +1764,7 @@ bool HttpServerMapper::execHandlerByHost(PHttpServerRequest &req) {
 				&& vpath.substr(0,plen) == prefix
 				&& vpath[plen] == '/'
 				&& execHandler(req, vpath.substr(plen))) {
-					_.unlock();
-					std::unique_lock __(mapping->shrmux);
-					iter->second = prefix;
+					cache.store(hostCopy, hash, prefix);
 					return true;
 			}
 		}
@@ -939,41 +1775,106 @@ bool HttpServerMapper::execHandlerByHost(PHttpServerRequest &req) {
 
 
 void HttpServer::start(NetAddrList listenSockets, AsyncProvider a) {
-	if (socketServer.has_value()) return;
+	if (socketServer.has_value() || tlsSocketServer.has_value()) return;
 
-	socketServer.emplace(listenSockets);
+	if (!listenSockets.empty() || tlsFactory == nullptr) {
+		socketServer.emplace(listenSockets);
+	}
+	if (tlsFactory != nullptr) {
+		tlsSocketServer.emplace(tlsListenSockets);
+		handshakeProvider = createAsyncProvider(AsyncProviderConfig{1, static_cast<int>(handshakeThreads)});
+	}
+	if (h2c) {
+		http2Provider = createAsyncProvider(AsyncProviderConfig{1, static_cast<int>(h2cThreads)});
+	}
 
 	asyncProvider = a;
 
 	logger = new Logger(*this);
+	if (accessLog == nullptr) {
+		accessLog = std::make_unique<AccessLog>([this](const std::string_view &data) {
+			std::lock_guard _(lock);
+			std::cout.write(data.data(), data.size());
+			std::cout.flush();
+		});
+	}
 
 	a.runAsync([=]{
-		listen();
+		if (socketServer.has_value()) listen();
+		if (tlsSocketServer.has_value()) listenTLS();
 	});
 
 }
 
 
 void HttpServer::start(NetAddrList listenSockets, const AsyncProviderConfig &cfg) {
-	if (socketServer.has_value()) return;
+	if (socketServer.has_value() || tlsSocketServer.has_value()) return;
 
 	start(listenSockets, createAsyncProvider(cfg));
 }
 
+void HttpServer::setTLS(NetAddrList listenSockets, PSSLServerFactory &&factory, unsigned int handshakeThreads, unsigned int maxPendingHandshakes) {
+	tlsListenSockets = std::move(listenSockets);
+	tlsFactory = std::move(factory);
+	this->handshakeThreads = std::max(handshakeThreads, 1U);
+	this->maxPendingHandshakes = maxPendingHandshakes;
+}
+
+SSLSessionStats HttpServer::getTLSSessionStats() const {
+	return tlsFactory == nullptr?SSLSessionStats():tlsFactory.getSessionStats();
+}
+
 void HttpServer::listen() {
 	socketServer->waitAcceptAsync([&](std::optional<SocketServer::AcceptInfo> &acpt) {
 		if (acpt.has_value()) {
 			acpt->sock.setIOTimeout(iotimeout);
-			Stream s(std::make_unique<SocketStream>(std::make_unique<Socket>(std::move(acpt->sock))));
-			if (!onConnect(s)) {
-				PHttpServerRequest req = std::make_unique<HttpServerRequest>();
-				beginRequest(std::move(s), std::move(req));
-			}
+			acceptConnection(std::make_unique<Socket>(std::move(acpt->sock)));
 			this->listen();
 		}
 	});
 }
 
+void HttpServer::listenTLS() {
+	tlsSocketServer->waitAcceptAsync([&](std::optional<SocketServer::AcceptInfo> &acpt) {
+		if (acpt.has_value()) {
+			//connections above the limit are closed
+			if (pendingHandshakes < maxPendingHandshakes) {
+				acpt->sock.setIOTimeout(iotimeout);
+				try {
+					handshake(tlsFactory.makeSecure(acpt->sock));
+				} catch (...) {
+					unhandled();
+				}
+			}
+			this->listenTLS();
+		}
+	});
+}
+
+void HttpServer::handshake(std::unique_ptr<ISocket> &&sock) {
+	++pendingHandshakes;
+	//handshake is started in the handshake provider, so it is finished there as well
+	handshakeProvider.runAsync([this, sock = std::move(sock)]() mutable {
+		ISocket *s = sock.get();
+		s->waitConnect(iotimeout, [this, sock = std::move(sock)](bool ok) mutable {
+			--pendingHandshakes;
+			if (ok) {
+				asyncProvider.runAsync([this, sock = std::move(sock)]() mutable {
+					acceptConnection(std::move(sock));
+				});
+			}
+		});
+	});
+}
+
+void HttpServer::acceptConnection(std::unique_ptr<ISocket> &&sock) {
+	Stream s(std::make_unique<SocketStream>(std::move(sock)));
+	if (!onConnect(s)) {
+		PHttpServerRequest req = std::make_unique<HttpServerRequest>();
+		beginRequest(std::move(s), std::move(req));
+	}
+}
+
 
 
 
@@ -995,9 +1896,16 @@ AsyncProvider HttpServer::getAsyncProvider() {
 HttpServer::~HttpServer() {
 	stop();
 	logger->close();
+	accessLog.reset();
 }
 
 void HttpServer::stop() {
+	if (handshakeProvider) {
+		handshakeProvider->stop();
+	}
+	if (http2Provider) {
+		http2Provider->stop();
+	}
 	if (asyncProvider) {
 		asyncProvider->stop();
 	}
@@ -1007,18 +1915,28 @@ void HttpServer::stop() {
 
 void HttpServer::log(ReqEvent event, const HttpServerRequest &req) noexcept {
 	if (event == ReqEvent::done) {
-		std::lock_guard _(lock);
-		buildLogMsg(std::cout, req);
+		if (accessLog != nullptr) {
+			auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::system_clock::now() - req.getRecvTime()).count();
+			accessLog->access(static_cast<std::uint32_t>(dur), req.getResponseSize(), req.getStatus(),
+					req.getMethod(), req.getHost(), req.getPath());
+		} else {
+			std::lock_guard _(lock);
+			buildLogMsg(std::cout, req);
+		}
 	}
 }
 
 void HttpServer::log(const HttpServerRequest &, const std::string_view &msg) noexcept {
-	std::lock_guard _(lock);
-	buildLogMsg(std::cout, msg);
+	if (accessLog != nullptr) {
+		accessLog->message(msg);
+	} else {
+		std::lock_guard _(lock);
+		buildLogMsg(std::cout, msg);
+	}
 }
 
 void HttpServer::log(const HttpServerRequest &r, LogLevel, const std::string_view &msg) noexcept {
-	std::lock_guard _(lock);
 	log(r,msg);
 }
 void HttpServer::error_page(HttpServerRequest &r, int status, const std::string_view &desc) noexcept {
@@ -1038,46 +1956,306 @@ void HttpServer::unhandled() noexcept {
 }
 
 
+///Orders responses of pipelined requests of a connection
+/**
+ * Responses of pipelined requests are collected in slots. The connection is returned
+ * by the first (non-pipelined) request once its response is sent. Then responses are written in
+ * order as they are completed. When all responses are written, the connection continues by reading
+ * next request
+ *
+ * Responses waiting in memory are limited by SocketStream::maxBufferLimit per connection
+ */
+class HttpPipeline {
+public:
+	std::size_t addSlot() {
+		std::lock_guard _(mx);
+		slots.emplace_back();
+		return base + slots.size() - 1;
+	}
+
+	///Accounts memory allocated for a response
+	/**
+	 * @param size size in bytes
+	 * @retval true allocated
+	 * @retval false limit of the connection exceeded
+	 */
+	bool allocate(std::size_t size) {
+		std::lock_guard _(mx);
+		if (limit && buffered + size > limit) return false;
+		buffered += size;
+		return true;
+	}
+
+	void release(std::size_t size) {
+		std::lock_guard _(mx);
+		buffered -= size;
+	}
+
+	///Completes response
+	/**
+	 * @param slot slot of the response
+	 * @param data response
+	 * @param allocated size accounted by allocate()
+	 * @param keepAlive connection can continue after the response
+	 */
+	void complete(std::size_t slot, std::vector<char> &&data, std::size_t allocated, bool keepAlive) {
+		std::unique_lock lk(mx);
+		Slot &s = slots[slot - base];
+		s.data = std::move(data);
+		s.allocated = allocated;
+		s.keepAlive = keepAlive;
+		s.done = true;
+		drain(lk);
+	}
+
+	void resume(Stream &s, CallbackT<void(Stream &)> &&cont) {
+		std::unique_lock lk(mx);
+		conn = std::move(s);
+		this->cont = std::move(cont);
+		hasConn = true;
+		drain(lk);
+	}
+
+protected:
+	struct Slot {
+		std::vector<char> data;
+		std::size_t allocated = 0;
+		bool keepAlive = false;
+		bool done = false;
+	};
+
+	std::mutex mx;
+	std::deque<Slot> slots;
+	std::size_t base = 0;
+	std::size_t limit = SocketStream::maxBufferLimit;
+	std::size_t buffered = 0;
+	Stream conn;
+	CallbackT<void(Stream &)> cont;
+	bool hasConn = false;
+	bool draining = false;
+	///connection will be closed, remaining responses are dropped (accessed by draining thread only)
+	bool closed = false;
+
+	void drain(std::unique_lock<std::mutex> &lk) {
+		if (!hasConn || draining) return;
+		draining = true;
+		while (!slots.empty() && slots.front().done) {
+			Slot s = std::move(slots.front());
+			slots.pop_front();
+			++base;
+			lk.unlock();
+			if (!closed) {
+				conn.write(std::string_view(s.data.data(), s.data.size()));
+				closed = !s.keepAlive;
+			}
+			lk.lock();
+			buffered -= s.allocated;
+		}
+		draining = false;
+		if (!slots.empty()) return;
+		hasConn = false;
+		Stream c = std::move(conn);
+		auto fn = std::move(cont);
+		lk.unlock();
+		c.flush();
+		if (!closed) fn(c);
+	}
+};
+
+///Output stream of a pipelined request. Response is collected in memory and passed to the pipeline
+/** When responses exceed the limit of the connection, the response is dropped as if the
+ * client disconnected: further writes are discarded, flushAsync() reports failure and the
+ * connection is closed after the previous responses are sent. Exception can't be used here,
+ * because the response can be written by asynchronous operations (sendFile) */
+class PipelinedOutput: public AbstractStream {
+public:
+	PipelinedOutput(std::shared_ptr<HttpPipeline> pipeline, std::size_t slot)
+		:pipeline(std::move(pipeline)),slot(slot) {}
+	~PipelinedOutput() {
+		try {
+			pipeline->complete(slot, std::move(buffer), allocated, keepAlive);
+		} catch (...) {
+
+		}
+	}
+	virtual std::string_view read() override {return std::string_view();}
+	virtual void readAsync(CallbackT<void(const std::string_view &data)> &&fn) override {fn(std::string_view());}
+	virtual void putBack(const std::string_view &) override {}
+	virtual void write(const std::string_view &data) override {writeNB(data);}
+	virtual bool writeNB(const std::string_view &data) override {
+		if (grow(buffer.size() + data.size())) buffer.insert(buffer.end(), data.begin(), data.end());
+		return false;
+	}
+	virtual void closeOutput() override {closed = true; keepAlive = false;}
+	virtual void closeInput() override {}
+	virtual void flush() override {}
+	virtual void flushAsync(CallbackT<void(bool)> &&fn) override {fn(!dropped);}
+	virtual bool timeouted() const override {return dropped;}
+	virtual void clearTimeout() override {}
+	virtual std::size_t getOutputBufferSize() const override {return HttpServerRequest::maxChunkSize;}
+	virtual char *reserveNB(std::size_t size) override {
+		if (!grow(buffer.size() + size)) return nullptr;
+		reserved = buffer.size();
+		buffer.resize(reserved + size);
+		return buffer.data() + reserved;
+	}
+	virtual bool commitNB(std::size_t size) override {
+		buffer.resize(reserved + size);
+		return false;
+	}
+	///Called by keep-alive callback of the request, the connection can continue after the response
+	void setKeepAlive() {keepAlive = !closed;}
+
+protected:
+	std::shared_ptr<HttpPipeline> pipeline;
+	std::size_t slot;
+	std::vector<char> buffer;
+	std::size_t reserved = 0;
+	std::size_t allocated = 0;
+	bool keepAlive = false;
+	bool closed = false;
+	bool dropped = false;
+
+	bool grow(std::size_t size) {
+		if (dropped) return false;
+		if (size <= allocated) return true;
+		if (pipeline->allocate(size - allocated)) {
+			allocated = size;
+			return true;
+		}
+		//incomplete response can't be sent, the connection will be closed
+		buffer.clear();
+		buffer.shrink_to_fit();
+		pipeline->release(allocated);
+		allocated = 0;
+		dropped = true;
+		closeOutput();
+		return false;
+	}
+};
+
 void HttpServer::beginRequest(Stream &&s, PHttpServerRequest &&req) {
 	req->setLogger(PLogger::staticCast(logger));
 	s.read() >> [this, req = std::move(req)](Stream &s, const std::string_view &data) mutable {
 		if (!data.empty()) {
 			s.putBack(data);
+			if (h2c && Http2Connection::isPreface(data)) {
+				beginHttp2(std::move(s));
+				return;
+			}
 			HttpServerRequest *preq = req.get();
 			preq->initAsync(std::move(s), [req = std::move(req), this](bool v) mutable {
 				if (v) {
-					req->setKeepAliveCallback([this](Stream &s, HttpServerRequest &req){
+					if (h2c && upgradeHttp2(req)) return;
+					std::shared_ptr<HttpPipeline> pipeline;
+					if (pipelineDepth > 1) beginPipelined(*req, pipeline);
+					req->setKeepAliveCallback([this, pipeline = std::move(pipeline)](Stream &s, HttpServerRequest &req){
 						PHttpServerRequest newreq = createRequest();
 						reuse_buffers(req,*newreq);
-						newreq->reuse_buffers(req);
-						beginRequest(std::move(s), std::move(newreq));
-					});
-					try {
-						if (!execHandlerByHost(req)) {
-							req->sendErrorPage(404);
+						if (pipeline) {
+							//responses of pipelined requests must be sent before the next request is read
+							pipeline->resume(s, [this, newreq = std::move(newreq)](Stream &s) mutable {
+								beginRequest(std::move(s), std::move(newreq));
+							});
+						} else {
+							beginRequest(std::move(s), std::move(newreq));
 						}
-					} catch (...) {
-						if (req != nullptr && !req->isResponseSent()) {
-							try{
-								req->sendErrorPage(500, "An unexpected error occurred while processing the request. See the log file for a description of the error");
-							} catch (...) {
-								//empty
-							}
-						}
-						throw;
-
-					}
+					});
+					execRequest(req);
 				}
 			});
 		}
 	};
 }
 
+void HttpServer::beginPipelined(HttpServerRequest &req, std::shared_ptr<HttpPipeline> &pipeline) {
+	bool more = req.canPipeline();
+	for (unsigned int i = 1; more && i < pipelineDepth; i++) {
+		PHttpServerRequest next = createRequest();
+		if (!req.takePipelined(*next)) break;
+		if (pipeline == nullptr) pipeline = std::make_shared<HttpPipeline>();
+		PipelinedOutput *out = new PipelinedOutput(pipeline, pipeline->addSlot());
+		next->setLogger(PLogger::staticCast(logger));
+		next->initPipelined(Stream(out));
+		next->setKeepAliveCallback([out](Stream &, HttpServerRequest &) {
+			out->setKeepAlive();
+		});
+		more = next->canPipeline();
+		asyncProvider.runAsync([this, next = std::move(next)]() mutable {
+			execRequest(next);
+		});
+	}
+}
+
+void HttpServer::execRequest(PHttpServerRequest &req) {
+	try {
+		if (!execHandlerByHost(req)) {
+			req->sendErrorPage(404);
+		}
+	} catch (...) {
+		if (req != nullptr && !req->isResponseSent()) {
+			try{
+				req->sendErrorPage(500, "An unexpected error occurred while processing the request. See the log file for a description of the error");
+			} catch (...) {
+				//empty
+			}
+		}
+		throw;
+
+	}
+}
+
 void HttpServerRequest::log2(LogLevel lev) {
 	logger->handler_log( *this, lev, std::string_view(logBuffer.data(), logBuffer.size()));
 	logBuffer.clear();
 }
 
+void HttpServer::beginHttp2(Stream &&s) {
+	auto conn = std::make_shared<Http2Connection>(std::move(s), http2Provider, iotimeout, [this](Stream &&s) {
+		dispatchHttp2(std::move(s));
+	});
+	http2Provider.runAsync([conn]{
+		Http2Connection::start(conn);
+	});
+}
+
+bool HttpServer::upgradeHttp2(PHttpServerRequest &req) {
+	HeaderValue upg = req->get(KnownHeader::upgrade);
+	HeaderValue settings = req->get("HTTP2-Settings");
+	if (!upg.defined || !settings.defined || !HeaderValue::iequal(upg, "h2c") || req->isBodyAvailable()) return false;
+	//request becomes the stream 1 of the connection
+	HPackDecoder::HeaderList hdrs;
+	hdrs.emplace_back(":method", req->getMethod());
+	hdrs.emplace_back(":path", req->getPath());
+	hdrs.emplace_back(":scheme", "http");
+	hdrs.emplace_back(":authority", req->getHost());
+	req->forEachHeader([&](std::string_view name, std::string_view value) {
+		if (HeaderValue::classify(name) == KnownHeader::host) return;
+		std::string n(name);
+		std::transform(n.begin(), n.end(), n.begin(), [](char c) {return c >= 'A' && c <= 'Z'?static_cast<char>(c + 32):c;});
+		hdrs.emplace_back(std::move(n), value);
+	});
+	std::string h2settings(settings);
+	Stream stream = req->switchProtocol("h2c");
+	req.reset();
+	auto conn = std::make_shared<Http2Connection>(std::move(stream), http2Provider, iotimeout, [this](Stream &&s) {
+		dispatchHttp2(std::move(s));
+	});
+	http2Provider.runAsync([conn, h2settings = std::move(h2settings), hdrs = std::move(hdrs)]() mutable {
+		Http2Connection::startUpgraded(conn, h2settings, std::move(hdrs));
+	});
+	return true;
+}
+
+void HttpServer::dispatchHttp2(Stream &&s) {
+	//dispatch is called by the reading thread of the connection, so the request runs elsewhere
+	asyncProvider.runAsync([this, s = std::move(s)]() mutable {
+		PHttpServerRequest req = createRequest();
+		req->setLogger(PLogger::staticCast(logger));
+		if (req->init(std::move(s))) execRequest(req);
+	});
+}
+
 PHttpServerRequest HttpServer::createRequest() {
 	return std::make_unique<HttpServerRequest>();
 }
@@ -1125,36 +2303,65 @@ void formatToLog(std::vector<char> &log, const std::string_view &txt) {
 }
 
 void formatToLog(std::vector<char> &log, const std::intptr_t &v) {
-	formatToLog(log, std::to_string(v));
+	char buff[maxIntegerChars];
+	log.insert(log.end(), buff, formatSigned(buff, std::end(buff), v));
 }
 
 void formatToLog(std::vector<char> &log, const std::uintptr_t &v) {
-	formatToLog(log, std::to_string(v));
+	char buff[maxIntegerChars];
+	log.insert(log.end(), buff, formatUnsigned(buff, std::end(buff), v));
 }
 
 void formatToLog(std::vector<char> &log, const double &v) {
-	formatToLog(log, std::to_string(v));
+	char buff[maxDoubleChars];
+	log.insert(log.end(), buff, formatDouble(buff, std::end(buff), v, 6));
+}
+
+bool HttpServer::Logger::enter() noexcept {
+	active.fetch_add(1);
+	if (closed.load()) {
+		leave();
+		return false;
+	}
+	return true;
 }
 
 void HttpServer::Logger::handler_log(const HttpServerRequest &req, LogLevel level, const std::string_view &msg) noexcept {
-    std::shared_lock _(mx);
-	if (!closed) owner.log(req, level, msg);
+	if (!enter()) return;
+	owner.log(req, level, msg);
+	leave();
 }
 
 void HttpServer::Logger::log(ReqEvent event, const HttpServerRequest &req) noexcept {
-    std::shared_lock _(mx);
-    if (!closed) owner.log(event, req);
+	if (!enter()) return;
+	owner.log(event, req);
+	leave();
 }
 
 void HttpServer::Logger::error_page(HttpServerRequest &req, int status, const std::string_view &desc) noexcept {
-    std::shared_lock _(mx);
-    if (!closed) owner.error_page(req,status,desc);
+	if (!enter()) return;
+	owner.error_page(req,status,desc);
+	leave();
 }
 
 Stream& HttpServerRequest::getStream() {
 	return stream;
 }
 
+Stream HttpServerRequest::switchProtocol(const std::string_view &protocol) {
+	enableKeepAlive = false;
+	setStatus(101);
+	set(CONNECTION, "Upgrade");
+	set("Upgrade", protocol);
+	send();
+	stream.flush();
+	if (logger) logger->log(ReqEvent::done,*this);
+	logger = nullptr;
+	Stream s = std::move(stream);
+	stream = Stream();
+	return s;
+}
+
 bool HttpServerRequest::directoryRedir() {
 	auto astq = path.find('?');
 	std::string_view query;
@@ -1240,7 +2447,7 @@ HttpServerMapper::~HttpServerMapper() {}
 
 bool HttpServerRequest::isSecure() const {
 	{
-		auto xfp = get("X-Forwarded-Proto");
+		auto xfp = get(KnownHeader::x_forwarded_proto);
 		if (xfp.defined) return HeaderValue::iequal(xfp, "https");
 	}
 	{
@@ -1260,7 +2467,7 @@ bool HttpServerRequest::isSecure() const {
 		if (xus.defined) return HeaderValue::iequal(xus, "https");
 	}
 	{
-		auto fw = get("Forwarded");
+		auto fw = get(KnownHeader::forwarded);
 		if (fw.defined) {
 			std::string_view c = fw;
 			while (c.empty()) {
@@ -1308,7 +2515,7 @@ bool HttpServerRequest::readBody(std::size_t maxSize, std::vector<char> &out) {
 
 bool HttpServerRequest::reserveBodyBuffer(std::size_t maxSize, std::vector<char> &buffer) {
 	buffer.clear();
-	HeaderValue hv = get("Content-Length");
+	HeaderValue hv = get(KnownHeader::content_length);
 	if (hv.defined){
 		auto sz = hv.getUInt();
 		if (sz >maxSize) {
@@ -1322,8 +2529,8 @@ bool HttpServerRequest::reserveBodyBuffer(std::size_t maxSize, std::vector<char>
 }
 
 void HttpServer::Logger::close() {
-    std::lock_guard _(mx);
-    closed = true;
+	closed.store(true);
+	while (active.load()) std::this_thread::yield();
 }
 
 }
@@ -7,22 +7,32 @@
 
 #ifndef SRC_MAIN_HTTP_SERVER_H_
 #define SRC_MAIN_HTTP_SERVER_H_
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <string_view>
 #include <functional>
 #include <map>
 #include <thread>
-#include <shared_mutex>
+#include <variant>
+#include <atomic>
 
+#include "access_log.h"
 #include "async_provider.h"
+#include "compress_stream.h"
 #include "isocket.h"
 #include "socket_server.h"
+#include "ssl.h"
 #include "stream.h"
 #include "header_value.h"
 #include "shared/refcnt.h"
 
 namespace userver {
 
+#ifndef _WIN32
+class FileDesc;
+#endif
+
 enum class ReqEvent {
 	init,
 	header_sent,
@@ -68,6 +78,12 @@ public:
 	HttpServerRequest();
 	~HttpServerRequest();
 
+	///Requests are allocated from a per-thread pool
+	/** Memory of destroyed requests is reused along with their buffers, see poolSize. Objects
+	 * of derived classes are allocated by the global allocator */
+	static void *operator new(std::size_t sz);
+	static void operator delete(void *ptr, std::size_t sz);
+
 	void initAsync(Stream &&stream, CallbackT<void(bool)> &&initDone);
 
 	bool init(Stream &&stream);
@@ -95,6 +111,8 @@ public:
 
 
 	HeaderValue get(const std::string_view &item) const;
+	///Retrieves well known header in constant time
+	HeaderValue get(KnownHeader item) const;
 	///Retrieves method GET, POST, PUT, etc
 	std::string_view getMethod() const;
 	///Retrieves whole path - including query string.
@@ -105,6 +123,19 @@ public:
 	std::string_view getHTTPVer()  const;
 	///Retrieves host header
 	std::string_view getHost()  const;
+	///Enumerates all headers of the request
+	/**
+	 * @param fn function called for each header as fn(name, value). Well known headers are
+	 * enumerated first and their names are in canonical form. Repeated well known list headers
+	 * are enumerated once with values joined (see HeaderValue::getListSeparator())
+	 */
+	template<typename Fn>
+	void forEachHeader(Fn &&fn) const {
+		for (std::size_t i = 0; i < knownHeaders.size(); i++) {
+			if (knownHeaders[i].data() != nullptr) fn(HeaderValue::getName(static_cast<KnownHeader>(i)), knownHeaders[i]);
+		}
+		for (const auto &x: inHeader) fn(x.first, x.second);
+	}
 	///Returns true, if request is over https
 	/**
 	 * @note This is observed using headers, Forwarded, X-Forwarded-Proto, etc because server can't handle secure connections
@@ -141,8 +172,29 @@ public:
 	void send(const std::string_view &body);
 
 	///Send response header and initialize stream
+	/**
+	 * When the response is compressed (see setCompression()), returned stream compresses
+	 * written data. Response is not compressed, when Content-Length has been set
+	 */
 	Stream send();
 
+	///Enables or disables compression of the response
+	/**
+	 * Response is compressed using the best encoding accepted by the client (Accept-Encoding),
+	 * if the content type is compressible and the response is not smaller than compressMinSize.
+	 * Responses with Content-Encoding set by the handler are not compressed. Content type
+	 * must be set explicitly (setContentType() or set()) before the response is sent, responses
+	 * without Content-Type are sent uncompressed as application/octet-stream. Strong ETag
+	 * of a compressed response is sent as weak, because the compressed content differs from
+	 * the content the handler tagged. Response to HEAD is negotiated as the response to GET,
+	 * only the body is not sent.
+	 *
+	 * @param enable true to enable, false to disable. Default value is compressResponses
+	 *
+	 * @see CompressStream
+	 */
+	void setCompression(bool enable) {compressEnabled = enable;}
+
 	///Send file from filesystem
 	/**
 	 * @param reqptr request pointer (wrapped to unique ptr)
@@ -158,6 +210,9 @@ public:
 	 * the file transfer. In case of true return you should no longer access the
 	 * request object.
 	 *
+	 * @note When the connection can send files directly (TLS offloaded to the kernel, see
+	 * SSLSocket::enableKTLS), the file is sent by the kernel without copying
+	 *
 	 */
 	static bool sendFile(std::unique_ptr<HttpServerRequest> &&reqptr, const std::string_view &path);
 
@@ -187,13 +242,36 @@ public:
 	void setCookie(const std::string_view &name, const std::string_view &value, const CookieDef &cookieDef = {0,false,false,std::string_view(),std::string_view()});
 
 	static std::size_t maxChunkSize;
+	///Maximum size of unread request body, which is discarded to keep the connection alive
+	/** Unread body is discarded asynchronously before the next request on the connection is read.
+	 * If the body is larger, the connection is closed instead */
+	static std::size_t maxDiscardSize;
+	///Size of a block read from the file by sendFile()
+	/** Blocks are read asynchronously directly into the output buffer of the connection */
+	static std::size_t sendFileBlockSize;
+	///Maximum count of destroyed requests kept for reuse by each thread
+	static std::size_t poolSize;
+	///Default state of compression of responses (see setCompression())
+	static bool compressResponses;
+	///Minimum size of the response body to be compressed
+	/** Applies to send(body). Streamed responses of unknown length are always compressed */
+	static std::size_t compressMinSize;
 
 	///Get body
-	/** The body can be read once only */
+	/** The body can be read once only. Returned stream is not owned, the body decoder is
+	 * stored inside of the request object, so it must not be used after the request is destroyed.
+	 * Repeated call returns the same stream */
 	Stream getBody();
 
 	///Get original stream (various protocols need to access stream directly, such a websockets)
 	Stream &getStream();
+	///Sends response 101 and releases the connection
+	/**
+	 * @param protocol value of the Upgrade header
+	 * @return stream of the connection. The request no longer owns the connection, it is not
+	 * kept alive and only its destruction remains
+	 */
+	Stream switchProtocol(const std::string_view &protocol);
 
 	bool isBodyAvailable() const {return hasBody;}
 	///Returns true, when headers has been already sent
@@ -204,6 +282,10 @@ public:
 	const std::chrono::system_clock::time_point &getRecvTime() const;
 	std::intptr_t getResponseSize() const;
 	unsigned int getStatus() const;
+	///Returns count of send operations performed on the connection since the request has been received
+	/** When called after the response is flushed (for example, during ReqEvent::done), it
+	 * returns count of send operations needed to send the response */
+	std::size_t getSendCount() const;
 
 
 
@@ -285,14 +367,42 @@ public:
 	void setContentTypeFromExt(std::string_view ext);
 	bool isResponseSent() const {return response_sent;}
 
+	///Determines whether next request on the connection can be processed before this request is finished
+	/** This is true for keep-alive GET and HEAD requests without body, expectation and upgrade */
+	bool canPipeline() const;
+	///Parses next request already received on the connection of this request
+	/**
+	 * Only data already buffered in the stream are examined, the function never reads
+	 * from the connection.
+	 *
+	 * @param next request object, which receives the header of the next request. It must be fresh object
+	 * @retval true request header was parsed, the request has no body and can be processed concurrently.
+	 * Call initPipelined() on it to finish initialization
+	 * @retval false no complete header is buffered or the request can't be pipelined. Buffered
+	 * data are left in the stream
+	 */
+	bool takePipelined(HttpServerRequest &next);
+	///Finishes initialization of a request obtained by takePipelined()
+	/**
+	 * @param output stream which receives the response. It is not connected to the client
+	 */
+	void initPipelined(Stream &&output);
+
 protected:
 
 	bool parse();
 	bool processHeaders();
+#ifdef _WIN32
 	static void sendFileAsync(std::unique_ptr<HttpServerRequest> &reqptr, std::unique_ptr<std::istream>&in, Stream &out);
+#else
+	static void sendFileAsync(std::unique_ptr<HttpServerRequest> &reqptr, std::unique_ptr<FileDesc> &in, Stream &out, std::uint64_t remain);
+	static void sendFileDirect(std::unique_ptr<HttpServerRequest> &reqptr, std::unique_ptr<FileDesc> &in, Stream &out, std::uint64_t offset, std::uint64_t remain);
+#endif
 
 
 	Stream stream;
+	///Body decoder, constructed inline by getBody(), refers to the stream
+	std::variant<std::monostate, LimitedStream<Stream &>, ChunkedStream<Stream &> > bodyStream;
 	KeepAliveCallback klcb;
 	PLogger logger;
 	bool enableKeepAlive = false;
@@ -301,20 +411,29 @@ protected:
 	bool hasExpect = false;
 	std::size_t ident = 0;
 	std::size_t root_offset = 0;
+	std::size_t sendCountStart = 0;
 	std::chrono::system_clock::time_point initTime;
 
 	static std::atomic<std::size_t> identCounter;
 
-	std::vector<char> firstLine;
+	///Header block of the request. Request line and header fields are parsed in place
 	std::vector<char> inHeaderData;
 	std::vector<char> sendHeader;
 	std::vector<char> logBuffer;
+	///Headers which are not well known, sorted by name
 	std::vector<std::pair<std::string_view, std::string_view> > inHeader;
+	///Values of well known headers. Missing header has nullptr as data
+	std::array<std::string_view, static_cast<std::size_t>(KnownHeader::count)> knownHeaders;
+	///Values of well known headers folded from repeated fields
+	std::vector<char> foldedHeaders;
 	std::string statusMessage;
 	std::string_view method, path, httpver, host;
 
 	bool parseFirstLine(std::string_view &v);
+	///Appends serialized data to the response header
+	void appendHeader(const std::string_view &data);
 	bool parseHeaders(std::string_view &v);
+	bool foldHeaders(std::vector<std::pair<KnownHeader, std::string_view> > &repeated);
 
 	//---- response fields
 
@@ -328,12 +447,22 @@ protected:
 	bool has_connection = false;
 	bool has_last_modified = false;
 	bool has_server = false;
+	bool has_content_encoding = false;
+	///content type of the response is compressible
+	bool compressible = false;
+	bool compressEnabled = compressResponses;
 	std::size_t send_content_length = 0;
+	///position of the value of ETag in sendHeader, 0 - ETag is not set
+	std::size_t etagPos = 0;
+
+	ContentEncoding selectEncoding(std::size_t size);
+	///Sets headers of compressed response, strong ETag is changed to weak
+	void setContentEncoding(ContentEncoding enc);
 
 	bool readHeader();
-	bool readHeader(std::string_view &buff, int &m);
+	bool readHeader(std::string_view &buff);
 	template<typename Fn>
-	void readHeaderAsync(int m, Fn &&done);
+	void readHeaderAsync(Fn &&done);
 
 	template<typename T, typename ... Args>
 	void log2(LogLevel lev, const T &a, const Args & ... args);
@@ -364,11 +493,40 @@ protected:
 
 	bool reserveBodyBuffer(std::size_t maxSize, std::vector<char> &buffer);
 
+	AbstractStream *getBodyDecoder();
+
+	///How the body of the request is delimited
+	enum class BodyFraming {
+		///body length is given by Content-Length, or there is no body
+		length,
+		///body is chunked
+		chunked,
+		///invalid request, the body can't be separated from the next request (400)
+		invalid,
+		///unsupported transfer coding (501)
+		unsupported
+	};
+	///Determines how the body is delimited from the request headers
+	/** The request is invalid, when it has both Transfer-Encoding and Content-Length, when
+	 * 'chunked' is not the final transfer coding or when it is applied more than once. Only
+	 * the chunked transfer coding is supported */
+	BodyFraming getBodyFraming() const;
+	///Determines whether the body decoder failed, so the connection can't continue
+	bool hasBodyError() const;
+	bool prepareKeepAlive();
+	bool canDiscardBody() const;
+	void abandonBody();
+	///Moves buffers to the pool of the current thread
+	void recycleBuffers();
+	void readHeaderAndInit(CallbackT<void(bool)> &&initDone);
+	void discardBodyAsync(Stream &&body, std::size_t limit, CallbackT<void(bool)> &&cb);
+
 };
 
 using PHttpServerRequest = std::unique_ptr<HttpServerRequest>;
 
 class SocketServer;
+class HttpPipeline;
 
 class HttpServerMapper {
 public:
@@ -378,6 +536,19 @@ public:
 
 	using Handler = CallbackT<bool(PHttpServerRequest &, const std::string_view &)>;
 
+	///Register handler for the path
+	/**
+	 * @param path path prefix. Handler receives requests for this path and for all
+	 * paths which continue by '/' after the prefix, unless a handler of a longer prefix
+	 * handles them
+	 * @param handler handler. If the path is already registered, the current handler is
+	 * kept. Set nullptr to remove the handler. Removed handler is destroyed once the requests
+	 * which are executing it (or have already started the search) are finished
+	 *
+	 * @note Routing table is published as immutable snapshot, so requests
+	 * are dispatched without holding a lock during the search. Modification is expensive,
+	 * it is expected, that paths are registered during initialization
+	 */
 	void addPath(const std::string_view &path, Handler &&handler);
 //	void serve(Stream &&stream);
 
@@ -406,14 +577,28 @@ public:
 	 */
 	virtual bool execHandlerByHost(PHttpServerRequest &req);
 
+	///Count of hosts with remembered prefix
+	/** Hosts are kept in a table of fixed size. When the table is full, the least used
+	 * hosts are forgotten and their prefix is detected again. Value is used by the constructor */
+	static std::size_t hostCacheSize;
+
 protected:
 
 
+	struct RouteNode;
+	struct HostCache;
+
 	struct PathMapping {
 
-		std::map<std::string, std::string, std::less<> > hostMapping;
-		std::map<std::string, Handler, std::less<> > pathMapping;
-		std::shared_timed_mutex shrmux;
+		///Detected prefixes of hosts
+		std::shared_ptr<HostCache> hostCache;
+		///Root of current version of the path trie
+		/** Accessed by std::atomic_load and std::atomic_store only. A request holds the version
+		 * it uses, older versions are released once no request uses them. Versions share
+		 * unmodified nodes, so each version costs few nodes only */
+		std::shared_ptr<const RouteNode> routes;
+		///Serializes modifications of the trie
+		std::mutex routeLock;
 	};
 	using PPathMapping = std::shared_ptr<PathMapping>;
 	PPathMapping mapping;
@@ -449,6 +634,25 @@ public:
 	 *
 	 */
 	void start(NetAddrList listenSockets, AsyncProvider asyncProvider);
+
+	///Enables TLS listeners
+	/**
+	 * Connections accepted on these addresses are secured by TLS before they are processed
+	 * as HTTP. Handshakes run on a separate asynchronous provider with its own threads, so
+	 * expensive handshake crypto can't starve threads processing requests. Must be called
+	 * before start(). When TLS is enabled, the list of plain listeners passed to start()
+	 * can be empty
+	 *
+	 * @param listenSockets addresses of TLS listeners
+	 * @param factory factory which secures accepted connections, see createSSLServer()
+	 * @param handshakeThreads count of threads performing handshakes
+	 * @param maxPendingHandshakes maximum count of handshakes in progress. Connections above
+	 * this limit are closed immediately
+	 */
+	void setTLS(NetAddrList listenSockets, PSSLServerFactory &&factory, unsigned int handshakeThreads = 1, unsigned int maxPendingHandshakes = 1024);
+
+	///Retrieves statistics of TLS session resumption
+	SSLSessionStats getTLSSessionStats() const;
 ///Stop the server
 	/**
 	 * Function joins all threads, will block until the operation completes
@@ -497,6 +701,9 @@ public:
 	 * events, you need to use proper synchronization while accessing shared log file. Use synchronization
 	 * when you really needit, because this destroys purpose of paralelisation. It is better to use
 	 * per-thread buffers and occasionaly flush them with synchronization
+	 *
+	 * Default implementation logs finished requests to the AccessLog, which writes them to
+	 * the standard output from a background thread
 	 */
 	virtual void log(ReqEvent event, const HttpServerRequest &req) noexcept;
 
@@ -570,6 +777,34 @@ public:
 	virtual void reuse_buffers(HttpServerRequest &old_req, HttpServerRequest &new_req);
 
 	void setIOTimeout(unsigned int tm) {iotimeout = tm;}
+	///Enables HTTP/1.1 pipelining
+	/**
+	 * When the client sends more requests without waiting for responses, requests already
+	 * received on the connection are dispatched to handlers concurrently. Responses are collected in
+	 * memory and sent to the client in order of the requests.
+	 *
+	 * Only GET and HEAD requests without body are processed this way, other requests
+	 * wait until previous request is finished.
+	 *
+	 * @param depth maximum count of requests of a connection processed at once. Value 1 (default)
+	 * disables pipelining
+	 */
+	void setPipelining(unsigned int depth) {pipelineDepth = std::max(depth, 1U);}
+	///Enables cleartext HTTP/2 (h2c)
+	/**
+	 * Connection is switched to HTTP/2 when the client starts with the HTTP/2 connection
+	 * preface (prior knowledge) or when it requests upgrade by the header 'Upgrade: h2c'. Streams of
+	 * the connection are processed concurrently as separate requests by the same handlers.
+	 * Connections are read and written by a separate asynchronous provider, so handlers
+	 * waiting for data of their streams can't block reading of the connection. Must be called
+	 * before start()
+	 *
+	 * @param enable true to enable, default is false
+	 * @param ioThreads count of threads reading and writing HTTP/2 connections
+	 *
+	 * @see Http2Connection
+	 */
+	void setH2C(bool enable, unsigned int ioThreads = 1) {h2c = enable; h2cThreads = std::max(ioThreads, 1U);}
 
 
 
@@ -584,8 +819,12 @@ protected:
 	    virtual void error_page(HttpServerRequest &req, int status, const std::string_view &desc) noexcept;
 	    void close();
 	    HttpServer &owner;
-	    std::shared_timed_mutex mx;
-	    bool closed = false;
+	    ///count of calls in progress, close() waits until they finish
+	    std::atomic<unsigned int> active = 0;
+	    std::atomic<bool> closed = false;
+
+	    bool enter() noexcept;
+	    void leave() noexcept {active.fetch_sub(1);}
 	};
 
 	std::vector<std::thread> threads;
@@ -593,10 +832,32 @@ protected:
 	std::optional<SocketServer> socketServer;
 	ondra_shared::RefCntPtr<Logger> logger;
 	std::mutex lock;
+	///Log used by default implementation of log() functions, created by start()
+	std::unique_ptr<AccessLog> accessLog;
 	unsigned int iotimeout = 5000;
+	unsigned int pipelineDepth = 1;
+	bool h2c = false;
+	unsigned int h2cThreads = 1;
+	AsyncProvider http2Provider;
+
+	std::optional<SocketServer> tlsSocketServer;
+	NetAddrList tlsListenSockets;
+	PSSLServerFactory tlsFactory;
+	AsyncProvider handshakeProvider;
+	unsigned int handshakeThreads = 1;
+	unsigned int maxPendingHandshakes = 1024;
+	std::atomic<unsigned int> pendingHandshakes = 0;
 
 	void listen();
+	void listenTLS();
+	void handshake(std::unique_ptr<ISocket> &&sock);
+	void acceptConnection(std::unique_ptr<ISocket> &&sock);
 	void beginRequest(Stream &&s, PHttpServerRequest &&req);
+	void beginPipelined(HttpServerRequest &req, std::shared_ptr<HttpPipeline> &pipeline);
+	void execRequest(PHttpServerRequest &req);
+	void beginHttp2(Stream &&s);
+	bool upgradeHttp2(PHttpServerRequest &req);
+	void dispatchHttp2(Stream &&s);
 
 	void buildLogMsg(std::ostream &stream, const HttpServerRequest &req);
 	void buildLogMsg(std::ostream &stream, const std::string_view &msg);
@@ -9,6 +9,7 @@
 #define SRC_MAIN_ISOCKET_H_
 
 #include "helpers.h"
+#include <cstdint>
 
 namespace userver {
 
@@ -111,6 +112,20 @@ public:
 	virtual bool timeouted() const = 0;
 
 	virtual void clearTimeout() = 0;
+
+	///Determines whether the socket can send a file by sendFile()
+	virtual bool canSendFile() const {return false;}
+	///Sends part of a file asynchronously, without copying it to the user space
+	/**
+	 * @param fd file descriptor
+	 * @param offset offset in the file
+	 * @param size count of bytes to send
+	 * @param fn callback receives count of bytes sent, which can be less than size. It
+	 * receives 0 when error, timeout or end of file
+	 *
+	 * @note supported only when canSendFile() returns true
+	 */
+	virtual void sendFile(int , std::uint64_t , std::size_t , CallbackT<void(int)> &&fn) {fn(0);}
 };
 
 
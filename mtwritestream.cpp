@@ -19,6 +19,7 @@ MTWriteStream::~MTWriteStream() {
 }
 
 MTWriteStream::Line MTWriteStream::unlocked("");
+std::size_t MTWriteStream::maxPendingSize = 4*1024*1024;
 
 bool MTWriteStream::send(std::shared_ptr<MTWriteStream> me, const std::string_view &ln) {
 	//if stream is closed, no more can be send
@@ -29,6 +30,13 @@ bool MTWriteStream::send(std::shared_ptr<MTWriteStream> me, const std::string_vi
 	if (!me->lines.compare_exchange_strong(ulk, nullptr)) {
 		//we failed to lock stream, so this mean, that someone is already operates there
 
+		//account enqueued data, close the stream, if the reader is too slow
+		std::size_t p = me->pending.fetch_add(ln.size()) + ln.size();
+		if (maxPendingSize && p > maxPendingSize) {
+			me->pending.fetch_sub(ln.size());
+			me->closed = true;
+			return false;
+		}
 		//allocate line
 		Line *lnptr = new(ln) Line(ln);
 		//read pointer top of the line stack
@@ -38,7 +46,7 @@ bool MTWriteStream::send(std::shared_ptr<MTWriteStream> me, const std::string_vi
 			//set next pointer
 			lnptr->next = nx;
 			//try to replace top of the stack
-		} while (me->lines.compare_exchange_weak(nx, lnptr));
+		} while (!me->lines.compare_exchange_weak(nx, lnptr));
 		//now we success - check next pointer
 		//because if it was &unlocked, whe incidently locked stream for us
 		if (lnptr->next == &unlocked) {
@@ -85,15 +93,29 @@ void MTWriteStream::sendAsync(std::shared_ptr<MTWriteStream> me, const std::stri
 		}
 
 		//no process lines and write to buffer and delete lines from stack
-		while (y) {
-			Line *n = y->next;
-			me->writeNB(y->str);
-			delete y;
-			y = n;
-		}
+		try {
+			while (y) {
+				Line *n = y->next;
+				me->writeNB(y->str);
+				me->pending.fetch_sub(y->str.size());
+				delete y;
+				y = n;
+			}
 
-		//finally write extra line carried by argument
-		me->writeNB(ln);
+			//finally write extra line carried by argument
+			me->writeNB(ln);
+		} catch (...) {
+			//output buffer limit exceeded (ENOBUFS) - the stream can't continue
+			while (y) {
+				Line *n = y->next;
+				me->pending.fetch_sub(y->str.size());
+				delete y;
+				y = n;
+			}
+			//mark stream closed, it stays locked, so no more sending happens
+			me->closed = true;
+			return;
+		}
 		//flush stream asynchronously
 		me->flush() >> [me](bool ok){
 			//locked thread continues here
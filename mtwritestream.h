@@ -31,10 +31,16 @@ public:
 	 * @param me shared pointer to this instance. Function requires shared_ptr to the stream
 	 * @param ln data to send
 	 * @retval true send or enqueued
-	 * @retval false stream already closed
+	 * @retval false stream already closed, or it was closed because the peer is too slow
+	 * and amount of enqueued data exceeded maxPendingSize
 	 */
 	static bool send(std::shared_ptr<MTWriteStream> me, const std::string_view &ln);
 
+	///Maximum amount of data enqueued while the stream is flushing
+	/** When this amount is exceeded, the stream is closed, so a slow reader can't
+	 * cause unlimited memory usage. Set 0 to unlimited */
+	static std::size_t maxPendingSize;
+
 	///Close stream, stops sending anything
 	void close();
 
@@ -74,6 +80,7 @@ protected:
 	std::atomic<Line *> lines = &unlocked;
 //	std::atomic<bool> ip = false;
 	std::atomic<bool> closed = false;
+	std::atomic<std::size_t> pending = 0;
 
 
 
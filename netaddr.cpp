@@ -7,6 +7,9 @@
 
 #include "platform.h"
 #include "init.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include "netaddr.h"
@@ -59,17 +62,22 @@ public:
 #ifndef _WIN32
 class NetAddrUnix: public NetAddrBase<sockaddr_un> {
 public:
-	NetAddrUnix(const sockaddr_un &item, int perm):NetAddrBase<sockaddr_un>(item),permission(perm) {}
+	NetAddrUnix(const sockaddr_un &item, socklen_t len, int perm):NetAddrBase<sockaddr_un>(item),len(len),permission(perm) {}
 	NetAddrUnix(const std::string_view &addr);
 
+	virtual socklen_t getAddrLen() const override {return len;}
 	virtual std::string toString(bool resolve = false) const override;
 	virtual int listen() const override;
 	virtual int connect() const override;
 	virtual int bindUDP() const override;
 	virtual std::unique_ptr<INetAddr> clone() const override {
-		return std::make_unique<NetAddrUnix>(addr,permission);
+		return std::make_unique<NetAddrUnix>(addr,len,permission);
 	}
+	///Socket in abstract namespace (Linux) - the name starts by zero byte
+	bool isAbstract() const {return len > offsetof(sockaddr_un, sun_path) && addr.sun_path[0] == 0;}
+	static socklen_t addrLen(const sockaddr_un &addr, socklen_t maxlen);
 protected:
+	socklen_t len;
 	int permission;
 
 };
@@ -184,9 +192,16 @@ NetAddr& NetAddr::operator =(NetAddr &&other) {
 }
 
 NetAddr NetAddr::fromSockAddr(const sockaddr &addr) {
+	return fromSockAddr(addr, sizeof(sockaddr_storage));
+}
+
+NetAddr NetAddr::fromSockAddr(const sockaddr &addr, socklen_t len) {
 	switch (addr.sa_family) {
 #ifndef _WIN32
-	case AF_UNIX: return NetAddr(std::make_unique<NetAddrUnix>(reinterpret_cast<const sockaddr_un &>(addr),0600));
+	case AF_UNIX: {
+		const sockaddr_un &un = reinterpret_cast<const sockaddr_un &>(addr);
+		return NetAddr(std::make_unique<NetAddrUnix>(un, NetAddrUnix::addrLen(un, len), 0600));
+	}
 #endif
 	case AF_INET: return NetAddr(std::make_unique<NetAddrIPv4>(reinterpret_cast<const sockaddr_in &>(addr)));
 	case AF_INET6: return NetAddr(std::make_unique<NetAddrIPv6>(reinterpret_cast<const sockaddr_in6 &>(addr)));
@@ -352,20 +367,37 @@ SocketHandle NetAddrIPv6::connect() const {
 #ifndef _WIN32
 
 static sockaddr_un createUnAddress(const std::string_view &addr) {
-	sockaddr_un s;
+	sockaddr_un s = {};
 	s.sun_family = AF_UNIX;
 	if (addr.length() >= sizeof(s.sun_path)-1)
 		INetAddr::error(addr, EINVAL, "Socket path is too long.");
 	char *c = s.sun_path;
 	for (char x: addr) *c++ = x;
 	*c = 0;
+	//'@' at the beginning denotes the abstract namespace
+	if (s.sun_path[0] == '@') s.sun_path[0] = 0;
 	return s;
 }
 
+socklen_t NetAddrUnix::addrLen(const sockaddr_un &addr, socklen_t maxlen) {
+	constexpr socklen_t hdr = offsetof(sockaddr_un, sun_path);
+	maxlen = std::min<socklen_t>(maxlen, sizeof(sockaddr_un));
+	if (maxlen <= hdr) return hdr;	//unnamed socket
+	std::size_t pathmax = maxlen - hdr;
+	if (addr.sun_path[0] == 0) {
+		//abstract name isn't terminated, it ends at the first zero byte, or at the given length
+		return static_cast<socklen_t>(hdr + 1 + strnlen(addr.sun_path+1, pathmax-1));
+	} else {
+		return static_cast<socklen_t>(hdr + strnlen(addr.sun_path, pathmax) + 1);
+	}
+}
+
 NetAddrUnix::NetAddrUnix(const std::string_view &addr):NetAddrBase<sockaddr_un>(createUnAddress(addr))
 {
 	auto splt = addr.rfind(':');
     permission = 0;
+    //permissions are not applicable to the abstract namespace
+    if (!addr.empty() && addr[0] == '@') splt = addr.npos;
     if (splt != addr.npos) {
     	auto iter = addr.begin() + splt+1;
     	auto end = addr.end();
@@ -386,20 +418,27 @@ NetAddrUnix::NetAddrUnix(const std::string_view &addr):NetAddrBase<sockaddr_un>(
 				case 'o': permission = permission | S_IROTH | S_IWOTH; break;
 				default:
 					splt = addr.length();
+					permission = 0;
 					iter = end;
 					break;
     		}
     	}
     	this->addr.sun_path[splt] = 0;
     }
+    len = addrLen(this->addr, sizeof(this->addr));
 }
 
 std::string NetAddrUnix::toString(bool ) const {
-	return std::string("unix:").append(addr.sun_path);
+	if (isAbstract()) {
+		std::string out("unix:@");
+		out.append(addr.sun_path+1, len - offsetof(sockaddr_un, sun_path) - 1);
+		return out;
+	}
+	return std::string("unix:").append(addr.sun_path, strnlen(addr.sun_path, sizeof(addr.sun_path)));
 }
 
 int NetAddrUnix::listen() const {
-	if (access(addr.sun_path, 0) == 0) {
+	if (!isAbstract() && access(addr.sun_path, 0) == 0) {
 		bool attempt = true;
 		try {
 			int s = connect();
@@ -415,7 +454,7 @@ int NetAddrUnix::listen() const {
 	try {
 		if (::bind(sock,getAddr(), getAddrLen())) error(this, lastError(), "bind()");
 		if (::listen(sock, SOMAXCONN)) error(this, lastError(), "listen()");
-		if (permission) chmod(addr.sun_path, permission);
+		if (permission && !isAbstract()) chmod(addr.sun_path, permission);
 		return sock;
 	} catch (...) {
 		closesocket(sock);
@@ -70,9 +70,21 @@ public:
 	NetAddr &operator=(const NetAddr &other);
 	NetAddr &operator=(NetAddr &&other);
 
+	///Parse address
+	/**
+	 * @param addr_str address in form host:port, [ipv6]:port, unix:/path/to/socket or unix:@name.
+	 * The path of unix socket can be followed by :permissions (octal or combination of u,g,o),
+	 * which are applied when the socket is created by listen(). The name starting by @
+	 * refers to the abstract namespace (Linux)
+	 * @param default_svc default service (port) when not specified
+	 * @return list of addresses
+	 */
 	static NetAddrList fromString(const std::string_view &addr_str, const std::string_view &default_svc = std::string_view());
 	static NetAddrList fromStringMulti(const std::string_view &addr_str, const std::string_view &default_svc = std::string_view());
 	static NetAddr fromSockAddr(const sockaddr &addr);
+	///Create from socket address of known length (as returned by accept() or getsockname())
+	/** The length is significant for unix sockets, especially in the abstract namespace */
+	static NetAddr fromSockAddr(const sockaddr &addr, socklen_t len);
 
 	socklen_t getAddrLen() const {return addr->getAddrLen();}
 	const sockaddr *getAddr() const {return addr->getAddr();}
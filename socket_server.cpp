@@ -13,6 +13,7 @@
 #include <chrono>
 #include <mutex>
 #include <iterator>
+#include <deque>
 
 #include "socketresource.h"
 #include "async_provider.h"
@@ -49,20 +50,26 @@ void SocketServer::stop() {
 #endif
 }
 
+static_assert(sizeof(sockaddr_storage) <= sizeof(SocketServer::PeerAddr::addr), "PeerAddr is too small");
+
+unsigned int SocketServer::maxAcceptBatch = 32;
+
+NetAddr SocketServer::PeerAddr::get() const {
+	return NetAddr::fromSockAddr(*reinterpret_cast<const sockaddr *>(addr), len);
+}
+
 std::optional<Socket> SocketServer::waitAccept() {
-	sockaddr_storage stor;
+	PeerAddr stor;
 	auto z = waitForSocket(stor);
 	if (z < 0) return std::optional<Socket>();
 	else return Socket(z);
 }
 
 std::optional<SocketServer::AcceptInfo> SocketServer::waitAcceptGetPeer() {
-	sockaddr_storage stor;
+	PeerAddr stor;
 	auto z = waitForSocket(stor);
 	if (z < 0) return std::optional<SocketServer::AcceptInfo>();
-	else return SocketServer::AcceptInfo{
-		Socket(z), NetAddr::fromSockAddr(reinterpret_cast<sockaddr &>(stor))
-	};
+	else return SocketServer::AcceptInfo{Socket(z), stor};
 }
 
 static SocketHandle acceptConn(SocketHandle src, sockaddr *sin, socklen_t *slen) {
@@ -84,7 +91,29 @@ static SocketHandle acceptConn(SocketHandle src, sockaddr *sin, socklen_t *slen)
 #endif
 }
 
-SocketHandle SocketServer::waitForSocket(sockaddr_storage &sin) {
+///Accepts next pending connection, doesn't throw when there is no pending connection
+/**
+ * @return accepted socket or INVALID_SOCKET_HANDLE, when backlog is empty or on error. Errors
+ * are ignored here, because the connection already accepted must be processed first
+ */
+static SocketHandle tryAcceptConn(SocketHandle src, SocketServer::PeerAddr &peer) {
+	peer.len = sizeof(peer.addr);
+#ifdef _WIN32
+	SocketHandle s = accept(src, reinterpret_cast<sockaddr *>(peer.addr), &peer.len);
+	if (s == SOCKET_ERROR) return INVALID_SOCKET_HANDLE;
+	u_long one = 1;
+	ioctlsocket(s, FIONBIO, &one);
+	return s;
+#else
+	SocketHandle s;
+	do {
+		s = accept4(src, reinterpret_cast<sockaddr *>(peer.addr), &peer.len, SOCK_NONBLOCK|SOCK_CLOEXEC);
+	} while (s < 0 && errno == EINTR);
+	return s < 0?INVALID_SOCKET_HANDLE:s;
+#endif
+}
+
+SocketHandle SocketServer::waitForSocket(PeerAddr &sin) {
 	std::basic_string<pollfd> pfds;
 	std::transform(fds.begin(), fds.end(), std::back_insert_iterator(pfds), [](SocketHandle i) {
 		return pollfd{ i,POLLIN,0 };
@@ -104,9 +133,9 @@ SocketHandle SocketServer::waitForSocket(sockaddr_storage &sin) {
 	}
 	for (auto &fd: pfds) {
 		if (fd.revents & POLLIN) {
-			socklen_t slen = sizeof(sin);
+			sin.len = sizeof(sin.addr);
 			try {
-				return acceptConn(fd.fd, reinterpret_cast<sockaddr *>(&sin),&slen);
+				return acceptConn(fd.fd, reinterpret_cast<sockaddr *>(sin.addr),&sin.len);
 			} catch (...) {
 				if (exit) return INVALID_SOCKET_HANDLE;
 			}
@@ -125,18 +154,19 @@ protected:
 	std::mutex lk;
 	AsyncCallback curCallback;
 	std::vector<SocketHandle> charged; //already charged descriptors, to avoid changing repeatedly
-	std::vector<AcceptInfo> ready;    //ready connections arrived when no callback was defined - will be returned immediatelly
+	std::deque<AcceptInfo> ready;    //ready connections arrived when no callback was defined - will be returned immediatelly
 
 	bool isCharged(SocketHandle i) const;
 	void uncharge(SocketHandle i);
 	void charge(SocketHandle i);
+	void drainBacklog(SocketHandle i);
 };
 
 bool SocketServer::AsyncAcceptor::asyncAccept(std::shared_ptr<AsyncAcceptor> me, AsyncCallback &&callback, const std::vector<SocketHandle> &fds) {
 	std::unique_lock _(lk);
 	if (!ready.empty()) {
-		std::optional<SocketServer::AcceptInfo> ainfo(std::move(ready.back()));
-		ready.pop_back();
+		std::optional<SocketServer::AcceptInfo> ainfo(std::move(ready.front()));
+		ready.pop_front();
 		_.unlock();
 		callback(ainfo);
 		return true;
@@ -150,21 +180,19 @@ bool SocketServer::AsyncAcceptor::asyncAccept(std::shared_ptr<AsyncAcceptor> me,
 				std::unique_lock _(me->lk);
 				me->uncharge(i);
 
-				sockaddr_storage sin;
-				socklen_t slen = sizeof(sin);
 				try {
-					SocketHandle s = acceptConn(i, reinterpret_cast<sockaddr *>(&sin), &slen);
+					std::optional<SocketServer::AcceptInfo> ainfo;
+					ainfo.emplace();
+					SocketHandle s = acceptConn(i, reinterpret_cast<sockaddr *>(ainfo->peerAddr.addr), &ainfo->peerAddr.len);
+					ainfo->sock = Socket(s);
 					AsyncCallback cb (std::move(me->curCallback));
 					if (cb != nullptr) {
-						std::optional<SocketServer::AcceptInfo> ainfo({
-							Socket(s), NetAddr::fromSockAddr(reinterpret_cast<sockaddr &>(sin))
-						});
+						me->drainBacklog(i);
 						_.unlock();
 						cb(ainfo);
 					} else {
-						me->ready.push_back({
-							Socket(s), NetAddr::fromSockAddr(reinterpret_cast<sockaddr &>(sin))
-						});
+						me->ready.push_back(std::move(*ainfo));
+						me->drainBacklog(i);
 					}
 				} catch (...) {
 					_.unlock();
@@ -185,6 +213,22 @@ bool SocketServer::AsyncAcceptor::asyncAccept(std::shared_ptr<AsyncAcceptor> me,
 
 }
 
+///Accepts connections which are already waiting in the backlog
+/**
+ * Avoids extra round trip through the dispatcher for every connection during burst. Accepted
+ * connections are stored in the ready queue and picked by next asyncAccept(). Function
+ * must be called under lock
+ */
+void SocketServer::AsyncAcceptor::drainBacklog(SocketHandle i) {
+	for (unsigned int cnt = 1; cnt < maxAcceptBatch; cnt++) {
+		AcceptInfo nfo;
+		SocketHandle s = tryAcceptConn(i, nfo.peerAddr);
+		if (s == INVALID_SOCKET_HANDLE) break;
+		nfo.sock = Socket(s);
+		ready.push_back(std::move(nfo));
+	}
+}
+
 bool SocketServer::waitAcceptAsync(AsyncCallback &&callback) {
 	if (exit) return false;
 
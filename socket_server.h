@@ -21,9 +21,25 @@ public:
 	SocketServer(const NetAddrList &addrLst);
 	~SocketServer();
 
+	///Address of the peer of accepted connection
+	/**
+	 * The address is kept in the raw form as it was returned by accept(). The NetAddr
+	 * object (which needs an allocation) is created only when it is requested
+	 */
+	struct PeerAddr {
+		///raw address - large enough to hold sockaddr_storage
+		alignas(8) unsigned char addr[128];
+		///length of the address
+		socklen_t len = sizeof(addr);
+
+		///Convert to NetAddr
+		NetAddr get() const;
+		operator NetAddr() const {return get();}
+	};
+
 	struct AcceptInfo {
 		Socket sock;
-		NetAddr peerAddr;
+		PeerAddr peerAddr;
 	};
 
 	void stop();
@@ -43,11 +59,18 @@ public:
 	 */
 	bool waitAcceptAsync(AsyncCallback &&callback);
 
+	///Maximum count of connections accepted during single wakeup of the listening socket
+	/**
+	 * Connections above the first one are stored and returned by following waitAcceptAsync()
+	 * without need to wait for the next wakeup.
+	 */
+	static unsigned int maxAcceptBatch;
+
 protected:
 	std::vector<SocketHandle> fds;
 	bool exit = false;
 
-	SocketHandle waitForSocket(sockaddr_storage &sin);
+	SocketHandle waitForSocket(PeerAddr &sin);
 
 	class AsyncAcceptor;
 	std::shared_ptr<AsyncAcceptor> asyncState;
@@ -7,6 +7,10 @@
 
 #include <openssl/ssl.h>
 #include <userver/ssl_exception.h>
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <unordered_map>
 #include "ssl.h"
 #include "ssl_socket.h"
 
@@ -21,10 +25,136 @@ PSSLClientFactory createSSLClient() {
 	return createSSLClient({});
 }
 
+///Client side cache of TLS sessions, one session per server (host and port)
+/** Cache is attached to SSL_CTX and lives as long as the context */
+class SSLSessionCache {
+public:
+	SSLSessionCache(std::size_t maxSize, unsigned int lifetime):maxSize(maxSize),lifetime(lifetime) {}
+	~SSLSessionCache() {
+		for (auto &x: sessions) SSL_SESSION_free(x.second.sess);
+	}
+	SSLSessionCache(const SSLSessionCache &) = delete;
+	SSLSessionCache &operator=(const SSLSessionCache &) = delete;
+
+	///Installs the cache to the context
+	void install(SSL_CTX *ctx) {
+		SSL_CTX_set_app_data(ctx, this);
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, &newSessionCb);
+		SSL_CTX_set_info_callback(ctx, &infoCb);
+	}
+
+	///Prepares connection to resume cached session
+	/**
+	 * @param ssl connection
+	 * @param key identifies the server - host:port. New session of the connection is stored under this key
+	 */
+	void restore(SSL *ssl, const std::string &key) {
+		SSL_set_app_data(ssl, this);
+		SSL_set_ex_data(ssl, keyIndex(), new std::string(key));
+		std::lock_guard _(lock);
+		auto iter = sessions.find(key);
+		if (iter == sessions.end()) return;
+		if (iter->second.expires <= std::time(nullptr)) {
+			SSL_SESSION_free(iter->second.sess);
+			sessions.erase(iter);
+		} else {
+			SSL_set_session(ssl, iter->second.sess);
+		}
+	}
+
+	SSLSessionStats getStats() const {
+		SSLSessionStats st;
+		st.handshakes = handshakes;
+		st.resumed = resumed;
+		std::lock_guard _(lock);
+		st.cached = sessions.size();
+		return st;
+	}
+
+protected:
+	struct Entry {
+		SSL_SESSION *sess;
+		std::time_t expires;
+	};
+
+	std::size_t maxSize;
+	unsigned int lifetime;
+	mutable std::mutex lock;
+	std::unordered_map<std::string, Entry> sessions;
+	std::atomic<std::size_t> handshakes = 0;
+	std::atomic<std::size_t> resumed = 0;
+
+	///Index of the key in the ex_data of the connection
+	static int keyIndex() {
+		static int idx = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+				[](void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+			delete static_cast<std::string *>(ptr);
+		});
+		return idx;
+	}
+
+	///Stores session, takes ownership
+	void store(const std::string &key, SSL_SESSION *sess) {
+		std::time_t now = std::time(nullptr);
+		std::time_t tmout = std::min<long>(SSL_SESSION_get_timeout(sess), lifetime);
+		Entry e{sess, SSL_SESSION_get_time(sess) + tmout};
+		std::lock_guard _(lock);
+		auto iter = sessions.find(key);
+		if (iter != sessions.end()) {
+			SSL_SESSION_free(iter->second.sess);
+			iter->second = e;
+			return;
+		}
+		if (sessions.size() >= maxSize) {
+			//remove expired sessions, then session which expires first
+			auto oldest = sessions.end();
+			for (auto it = sessions.begin(); it != sessions.end();) {
+				if (it->second.expires <= now) {
+					SSL_SESSION_free(it->second.sess);
+					it = sessions.erase(it);
+				} else {
+					if (oldest == sessions.end() || it->second.expires < oldest->second.expires) oldest = it;
+					++it;
+				}
+			}
+			if (sessions.size() >= maxSize && oldest != sessions.end()) {
+				SSL_SESSION_free(oldest->second.sess);
+				sessions.erase(oldest);
+			}
+		}
+		sessions.emplace(key, e);
+	}
+
+	static int newSessionCb(SSL *ssl, SSL_SESSION *sess) {
+		auto cache = reinterpret_cast<SSLSessionCache *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+		auto key = static_cast<const std::string *>(SSL_get_ex_data(ssl, keyIndex()));
+		if (cache == nullptr || key == nullptr || !SSL_SESSION_is_resumable(sess)) return 0;
+		cache->store(*key, sess);
+		return 1;
+	}
+
+	static void infoCb(const SSL *ssl, int where, int ) {
+		if (where & SSL_CB_HANDSHAKE_DONE) {
+			//TLS 1.3 reports processed tickets as handshake too, count the first one only
+			auto cache = reinterpret_cast<SSLSessionCache *>(SSL_get_app_data(ssl));
+			if (cache) {
+				SSL_set_app_data(const_cast<SSL *>(ssl), nullptr);
+				++cache->handshakes;
+				if (SSL_session_reused(ssl)) ++cache->resumed;
+			}
+		}
+	}
+};
+
 class SSLClientFactory: public AbstractSSLClientFactory {
 public:
 
-	SSLClientFactory(const SSLConfig &cfg):ctx(SSL_CTX_new(TLS_client_method()), SSL_CTX_Free()) {
+	SSLClientFactory(const SSLConfig &cfg)
+		:cache(cfg.sessionCacheSize?std::make_shared<SSLSessionCache>(cfg.sessionCacheSize, cfg.sessionLifetime):nullptr)
+		,ctx(SSL_CTX_new(TLS_client_method()), [cache = this->cache](SSL_CTX *ctx){SSL_CTX_free(ctx);}) {
+		if (ctx == nullptr) throw SSLError();
+		if (cache) cache->install(ctx.get());
 		if (cfg.certStorageDir.empty() && cfg.certStorageFile.empty()) {
 			SSL_CTX_set_default_verify_paths(ctx.get());
 		} else {
@@ -50,15 +180,43 @@ public:
 	virtual PSocket makeSecure(Socket &sock, const std::string &host) override {
 		auto sslsock = std::make_unique<SSLSocket>(std::move(sock), ctx, SSLSocket::Mode::connect);
 		auto ssl = sslsock->getSSLSocket();
-		if(!SSL_set_tlsext_host_name(ssl, host.c_str())) throw SSLError();
-		if(!X509_VERIFY_PARAM_set1_host(SSL_get0_param(ssl), host.c_str(), 0)) throw SSLError();
+		//host can contain port, which is not part of the server name
+		std::string_view name(host);
+		std::string_view port("443");
+		if (!name.empty() && name.front() == '[') {
+			auto e = name.find(']');
+			if (e != name.npos) {
+				if (name.substr(e+1, 1) == ":") port = name.substr(e+2);
+				name = name.substr(1, e-1);
+			}
+		} else {
+			auto sep = name.find(':');
+			if (sep != name.npos && name.find(':', sep+1) == name.npos) {
+				port = name.substr(sep+1);
+				name = name.substr(0, sep);
+			}
+		}
+		std::string key(name);
+		if(!SSL_set_tlsext_host_name(ssl, key.c_str())) throw SSLError();
+		if(!X509_VERIFY_PARAM_set1_host(SSL_get0_param(ssl), key.c_str(), 0)) throw SSLError();
+		if (cache) {
+			key.push_back(':');
+			key.append(port);
+			cache->restore(ssl, key);
+		}
 	    return PSocket(sslsock.release());
 	}
 
+	virtual SSLSessionStats getSessionStats() const override {
+		return cache?cache->getStats():SSLSessionStats();
+	}
+
 
 	~SSLClientFactory() {}
 
 protected:
+	//the context holds reference to the cache, because callbacks can be called after the factory is destroyed
+	std::shared_ptr<SSLSessionCache> cache;
 	PSSL_CTX ctx;
 
 };
@@ -67,5 +225,47 @@ PSSLClientFactory createSSLClient(const SSLConfig &cfg) {
 	return std::make_unique<SSLClientFactory>(cfg);
 }
 
+class SSLServerFactory: public AbstractSSLServerFactory {
+public:
+
+	SSLServerFactory(const SSLConfig &cfg):ctx(SSL_CTX_new(TLS_server_method()), SSL_CTX_Free()) {
+		if (ctx == nullptr) throw SSLError();
+		if (SSL_CTX_use_certificate_chain_file(ctx.get(), cfg.certFile.c_str()) <= 0) throw SSLError();
+		if (SSL_CTX_use_PrivateKey_file(ctx.get(), cfg.privKeyFile.c_str(), SSL_FILETYPE_PEM) <= 0) throw SSLError();
+		if (!SSL_CTX_check_private_key(ctx.get())) throw SSLError();
+		if (cfg.sessionCacheSize) {
+			//TLS 1.2 session IDs are kept in the cache, tickets are stateless
+			static const unsigned char sessionIdCtx[] = "userver";
+			SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_SERVER);
+			SSL_CTX_sess_set_cache_size(ctx.get(), static_cast<long>(cfg.sessionCacheSize));
+			SSL_CTX_set_timeout(ctx.get(), static_cast<long>(cfg.sessionLifetime));
+			SSL_CTX_set_session_id_context(ctx.get(), sessionIdCtx, sizeof(sessionIdCtx)-1);
+		} else {
+			SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_OFF);
+			SSL_CTX_set_options(ctx.get(), SSL_OP_NO_TICKET);
+			SSL_CTX_set_num_tickets(ctx.get(), 0);
+		}
+	}
+
+	virtual PSocket makeSecure(Socket &sock) override {
+		return std::make_unique<SSLSocket>(std::move(sock), ctx, SSLSocket::Mode::accept);
+	}
+
+	virtual SSLSessionStats getSessionStats() const override {
+		SSLSessionStats st;
+		st.handshakes = SSL_CTX_sess_accept_good(ctx.get());
+		st.resumed = SSL_CTX_sess_hits(ctx.get());
+		st.cached = SSL_CTX_sess_number(ctx.get());
+		return st;
+	}
+
+protected:
+	PSSL_CTX ctx;
+};
+
+PSSLServerFactory createSSLServer(const SSLConfig &cfg) {
+	return std::make_unique<SSLServerFactory>(cfg);
+}
+
 
 }
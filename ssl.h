@@ -12,7 +12,15 @@
 namespace userver {
 
 
-
+///Statistics of TLS session resumption
+struct SSLSessionStats {
+	///count of completed handshakes
+	std::size_t handshakes = 0;
+	///count of handshakes, which resumed cached session (hit rate = resumed/handshakes)
+	std::size_t resumed = 0;
+	///count of servers (host and port) which have a session in the cache
+	std::size_t cached = 0;
+};
 
 class AbstractSSLClientFactory {
 public:
@@ -20,6 +28,8 @@ public:
 
 	virtual PSocket makeSecure(Socket &sock, const std::string &host) = 0;
 
+	virtual SSLSessionStats getSessionStats() const {return {};}
+
 	virtual ~AbstractSSLClientFactory() {}
 
 };
@@ -31,8 +41,41 @@ public:
 	using std::unique_ptr<AbstractSSLClientFactory>::unique_ptr;
 
 	///makes connected socket as secure
-	/** after this, you need to call waitForConnect() to receive whether ssl has been successful */
+	/** after this, you need to call waitForConnect() to receive whether ssl has been successful
+	 *
+	 * @param sock connected socket
+	 * @param host name of the server, optionally followed by :port (443 if not specified). The name
+	 * is used to verify the certificate, the port separates cached sessions of different servers
+	 * on the same host
+	 */
 	PSocket makeSecure(Socket &sock, const std::string &host) {return get()->makeSecure(sock,host);}
+	///retrieves statistics of the session cache
+	/** If the factory is moved to sslConnectFn(), keep the pointer returned by get() to access statistics */
+	SSLSessionStats getSessionStats() const {return get()->getSessionStats();}
+};
+
+class AbstractSSLServerFactory {
+public:
+	using PSocket = std::unique_ptr<ISocket>;
+
+	virtual PSocket makeSecure(Socket &sock) = 0;
+
+	virtual SSLSessionStats getSessionStats() const {return {};}
+
+	virtual ~AbstractSSLServerFactory() {}
+};
+
+class PSSLServerFactory: public std::unique_ptr<AbstractSSLServerFactory> {
+public:
+	using PSocket = AbstractSSLServerFactory::PSocket;
+
+	using std::unique_ptr<AbstractSSLServerFactory>::unique_ptr;
+
+	///makes accepted socket as secure
+	/** after this, you need to call waitForConnect() to perform the handshake */
+	PSocket makeSecure(Socket &sock) {return get()->makeSecure(sock);}
+	///retrieves statistics of the session cache
+	SSLSessionStats getSessionStats() const {return get()->getSessionStats();}
 };
 
 struct SSLConfig {
@@ -40,11 +83,23 @@ struct SSLConfig {
 	std::string certStorageFile;
 	std::string certFile;
 	std::string privKeyFile;
+	///Maximum count of servers in the session cache. Set 0 to disable session resumption
+	/** The cache keeps one session (TLS 1.3 ticket or TLS 1.2 session ID) per host and port */
+	std::size_t sessionCacheSize = 256;
+	///Maximum lifetime of cached session in seconds. Server can specify shorter lifetime
+	unsigned int sessionLifetime = 3600;
 };
 
 
 PSSLClientFactory createSSLClient();
 PSSLClientFactory createSSLClient(const SSLConfig &cfg);
+///Creates factory for server side of TLS connections
+/**
+ * @param cfg configuration. The fields certFile (certificate chain) and privKeyFile are required.
+ * Fields sessionCacheSize and sessionLifetime configure server session cache and lifetime of
+ * session tickets. Set sessionCacheSize to 0 to disable session resumption
+ */
+PSSLServerFactory createSSLServer(const SSLConfig &cfg);
 
 static inline auto sslConnectFn(PSSLClientFactory &&ssl) {
 	return[ssl = std::move(ssl)](const userver::NetAddr &addr, const std::string_view &host){
@@ -13,6 +13,8 @@
 
 namespace userver {
 
+bool SSLSocket::enableKTLS = false;
+
 SSLSocket::SSLSocket(Socket &&s, const PSSL_CTX &ctx, Mode mode)
 		:s(std::move(s)),ctx(ctx),mode(mode)
 {
@@ -23,6 +25,10 @@ SSLSocket::SSLSocket(Socket &&s, const PSSL_CTX &ctx, Mode mode)
 		if (!SSL_set_fd(ssl.get(), this->s.getHandle())) {
 			throw SSLError();
 		}
+#ifdef SSL_OP_ENABLE_KTLS
+		//OpenSSL installs keys into the kernel after handshake, if it is possible
+		if (enableKTLS) SSL_set_options(ssl.get(), SSL_OP_ENABLE_KTLS);
+#endif
 
 /*		switch (mode) {
 		case Mode::connect: SSL_set_connect_state(ssl.get());break;
@@ -212,31 +218,43 @@ void SSLSocket::waitConnect(int tm, userver::CallbackT<void(bool)> &&cb) {
 			cb(ok);
 		}
 		else {
-			int r = 0;
 			{
 				std::lock_guard _(ssl_lock);
 				if (connState != ConnState::not_connected) {
 					cb(connState == ConnState::connected);
 					return;
 				}
-				switch (mode) {
-					case Mode::connect: r = SSL_connect(ssl.get());break;
-					case Mode::accept: r = SSL_accept(ssl.get());break;
-					default: cb(false);break;
-				};
-			}
-
-			if (r<0) {
-				handleStateAsync(r, tm, [cb = std::move(cb), tm, this](State st) mutable {
-					if (st == State::retry) waitConnect(tm, std::move(cb)); else cb(false);
-				});
-			} else {
-				cb(true);
 			}
+			handshakeAsync(tm, std::move(cb));
 		}
 	});
 }
 
+void SSLSocket::handshakeAsync(int tm, userver::CallbackT<void(bool)> &&cb) {
+	int r;
+	{
+		std::lock_guard _(ssl_lock);
+		switch (mode) {
+			case Mode::connect: r = SSL_connect(ssl.get());break;
+			default:
+			case Mode::accept: r = SSL_accept(ssl.get());break;
+		};
+	}
+	if (r<0) {
+		//continue until the handshake is complete, so it is not finished by the first read
+		handleStateAsync(r, tm, [cb = std::move(cb), tm, this](State st) mutable {
+			if (st == State::retry) handshakeAsync(tm, std::move(cb)); else cb(false);
+		});
+	} else {
+		{
+			//zero means, that handshake has been shut down
+			std::lock_guard _(ssl_lock);
+			connState = r > 0?ConnState::connected:ConnState::closed;
+		}
+		cb(r > 0);
+	}
+}
+
 
 bool SSLSocket::waitConnect(int tm) {
 	int r;
@@ -399,6 +417,59 @@ void SSLSocket::clearTimeout() {
 	s.clearTimeout();
 }
 
+bool SSLSocket::isKTLSSend() const {
+#ifdef SSL_OP_ENABLE_KTLS
+	return BIO_get_ktls_send(SSL_get_wbio(ssl.get()));
+#else
+	return false;
+#endif
+}
+
+bool SSLSocket::isKTLSRecv() const {
+#ifdef SSL_OP_ENABLE_KTLS
+	return BIO_get_ktls_recv(SSL_get_rbio(ssl.get()));
+#else
+	return false;
+#endif
+}
+
+bool SSLSocket::canSendFile() const {
+	return isKTLSSend();
+}
+
+void SSLSocket::sendFile(int fd, std::uint64_t offset, std::size_t size, userver::CallbackT<void(int)> &&fn) {
+#ifdef SSL_OP_ENABLE_KTLS
+	ossl_ssize_t r;
+	{
+		std::lock_guard _(ssl_lock);
+		if (connState == ConnState::closed)  {
+			fn(0);return;
+		}
+		//result must fit to int
+		r = SSL_sendfile(ssl.get(), fd, static_cast<off_t>(offset), std::min<std::size_t>(size, 0x40000000), 0);
+	}
+	if (r == 0) {
+		//end of file
+		fn(0);
+	} else if (r < 0) {
+		handleStateAsync(static_cast<int>(r), s.getWrTimeout(), [fn = std::move(fn), fd, offset, size, this](State st) mutable {
+			switch (st) {
+			case State::retry: sendFile(fd, offset, size, std::move(fn)); break;
+			case State::timeout: tm = true; fn(0); break;
+			default:
+			case State::eof: fn(0); break;
+			}
+		});
+	} else {
+		getCurrentAsyncProvider().runAsync([fn = std::move(fn),r]{
+			fn(static_cast<int>(r));
+		});
+	}
+#else
+	ISocket::sendFile(fd, offset, size, std::move(fn));
+#endif
+}
+
 bool SSLSocket::cancelAsyncRead(bool set_timeouted) {
     return s.cancelAsyncRead(set_timeouted);
 }
@@ -55,6 +55,24 @@ public:
     virtual bool cancelAsyncRead(bool set_timeouted = true) override;
     virtual bool cancelAsyncWrite(bool set_timeouted = true) override;
 
+	///Enables kernel TLS offload for sockets created later
+	/** When enabled, session keys are installed into the kernel after the handshake, so records are
+	 * encrypted and decrypted by the kernel. When OpenSSL, the kernel or the negotiated cipher doesn't
+	 * support the offload, the socket silently continues with encryption in user space. Files sent
+	 * by HttpServerRequest::sendFile() over an offloaded socket are passed to the kernel by
+	 * SSL_sendfile() without copying. Default is false */
+	static bool enableKTLS;
+
+	///Determines whether sending is offloaded to the kernel
+	bool isKTLSSend() const;
+	///Determines whether receiving is offloaded to the kernel
+	bool isKTLSRecv() const;
+
+	///Files can be sent when sending is offloaded to the kernel (see isKTLSSend())
+	virtual bool canSendFile() const override;
+	///Sends part of a file by SSL_sendfile(), file is encrypted by the kernel without copying
+	virtual void sendFile(int fd, std::uint64_t offset, std::size_t size, userver::CallbackT<void(int)> &&fn) override;
+
 protected:
 
 	enum class State {
@@ -85,6 +103,7 @@ protected:
 	void handleStateAsync(int r, int tm, Fn &&fn);
 
 	void shutdownAsync();
+	void handshakeAsync(int tm, userver::CallbackT<void(bool)> &&cb);
 	bool afterConnect();
 };
 
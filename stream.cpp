@@ -9,6 +9,10 @@
 
 #include "async_provider.h"
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
 namespace userver {
 
 std::string_view SocketStream::read() {
@@ -32,15 +36,108 @@ std::string_view SocketStream::read() {
 }
 
 std::size_t SocketStream::maxWrBufferSize = 65536;
+std::size_t SocketStream::highWatermark = 256*1024;
+std::size_t SocketStream::lowWatermark = 64*1024;
+std::size_t SocketStream::maxBufferLimit = 16*1024*1024;
+bool SocketStream::autoCork = true;
+
+///Shared between the stream and the scope which corked it
+struct SocketStream::CorkHandle {
+	///corked stream, nullptr when the stream was taken by the scope or released by the stream
+	std::atomic<SocketStream *> stream = nullptr;
+	///held by the scope while it flushes the stream, other thread waits on it
+	std::mutex flushLock;
+	///list of the thread, which corked the stream (accessed by the stream only)
+	const void *owner = nullptr;
+};
+
+static thread_local std::vector<std::shared_ptr<SocketStream::CorkHandle> > corkedStreams;
+static thread_local bool corkActive = false;
+
+SocketStream::~SocketStream() {
+	uncork();
+}
+
+SocketStream::AutoCork::AutoCork():owner(!corkActive) {
+	corkActive = true;
+}
+
+SocketStream::AutoCork::~AutoCork() {
+	if (!owner) return;
+	while (!corkedStreams.empty()) {
+		auto h = std::move(corkedStreams.back());
+		corkedStreams.pop_back();
+		//lock must be held before the stream is taken, so other thread can wait for it
+		std::lock_guard _(h->flushLock);
+		SocketStream *s = h->stream.exchange(nullptr);
+		if (s) {
+			try {
+				s->send_lk();
+			} catch (...) {
+				//error will be reported by next operation on the stream
+			}
+		}
+	}
+	corkActive = false;
+}
+
+bool SocketStream::cork() {
+	if (!autoCork || !corkActive) return false;
+	checkCork();
+	if (corkHandle == nullptr) corkHandle = std::make_shared<CorkHandle>();
+	else if (corkHandle->stream.load(std::memory_order_relaxed) == this) return true;
+	corkHandle->owner = &corkedStreams;
+	corkHandle->stream.store(this);
+	corkedStreams.push_back(corkHandle);
+	return true;
+}
+
+void SocketStream::uncork() const {
+	if (corkHandle == nullptr) return;
+	SocketStream *s = corkHandle->stream.exchange(nullptr);
+	if (corkHandle->owner == &corkedStreams) {
+		if (s) {
+			auto iter = std::find(corkedStreams.begin(), corkedStreams.end(), corkHandle);
+			if (iter != corkedStreams.end()) corkedStreams.erase(iter);
+		}
+	} else {
+		//stream was corked by other thread, wait if that thread is flushing it
+		if (s == nullptr) {
+			std::lock_guard _(corkHandle->flushLock);
+		}
+		//handle can still be in the list of the other thread, it can't be reused
+		corkHandle.reset();
+	}
+}
+
+void SocketStream::checkCork() const {
+	if (corkHandle != nullptr && corkHandle->owner != &corkedStreams) uncork();
+}
 
 void SocketStream::putBack(const std::string_view &pb) {
 	curbuff = pb;
 }
 
+std::string_view SocketStream::readBuffered() {
+	std::string_view out;
+	std::swap(out, curbuff);
+	return out;
+}
+
 
 void SocketStream::write(const std::string_view &data) {
-	wrbuff.append(data);
-	if (wrbuff.size() >= wrbufflimit) {
+	checkCork();
+	std::string_view d = data;
+	std::size_t maxbuff = std::max<std::size_t>(wrhigh, 1);
+	//large writes are sent in parts to keep the buffer below the high watermark
+	while (wrbuff.size() + d.size() > maxbuff) {
+		auto part = d.substr(0, maxbuff - std::min(maxbuff, wrbuff.size()));
+		wrbuff.append(part);
+		d = d.substr(part.size());
+		flush_lk();
+	}
+	wrbuff.append(d);
+	if (wrbuff.size() >= wrbufflimit && !cork()) {
 		flush_lk();
 	}
 }
@@ -69,16 +166,78 @@ ISocket& SocketStream::getSocket() const {
 }
 
 bool SocketStream::writeNB(const std::string_view &data) {
+	checkCork();
+	checkBufferLimit(data.size());
 	wrbuff.append(data);
 	return (wrbuff.size() >= wrbufflimit);
 }
 
+char *SocketStream::reserveNB(std::size_t size) {
+	checkCork();
+	checkBufferLimit(size);
+	wrreserved = wrbuff.size();
+	wrbuff.resize(wrreserved + size);
+	return wrbuff.data() + wrreserved;
+}
+
+bool SocketStream::commitNB(std::size_t size) {
+	wrbuff.resize(wrreserved + size);
+	return (wrbuff.size() >= wrbufflimit);
+}
+
+std::size_t SocketStream::getWriteWindow() const {
+	checkCork();
+	//wrbufflimit follows amount of data accepted by the socket during the last send
+	return wrbufflimit > wrbuff.size()?wrbufflimit - wrbuff.size():0;
+}
+
+void SocketStream::checkBufferLimit(std::size_t size) {
+	if (wrceiling && wrbuff.size() + size > wrceiling) {
+		throw std::system_error(ENOBUFS, std::generic_category(), "SocketStream: output buffer limit exceeded");
+	}
+}
+
+bool SocketStream::isWritable() const {
+	checkCork();
+	return wrbuff.size() < wrhigh;
+}
+
+void SocketStream::waitWritableAsync(CallbackT<void(bool)> &&fn) {
+	uncork();
+	if (wrbuff.size() < wrlow || wrbuff.empty()) {
+		getCurrentAsyncProvider().runAsync([fn = std::move(fn)] {
+			fn(true);
+		});
+	} else {
+		++sendCount;
+		sock->write(wrbuff.data(), wrbuff.size(), [this, fn = std::move(fn)](int r) mutable {
+			if (r <= 0) {
+				wrbuff.clear();
+				fn(false);
+			} else {
+				wrbuff.erase(0, r);
+				waitWritableAsync(std::move(fn));
+			}
+		});
+	}
+}
+
+void SocketStream::setWatermarks(std::size_t high, std::size_t low) {
+	wrhigh = high;
+	wrlow = std::min(low, high);
+}
+
+void SocketStream::setBufferLimit(std::size_t limit) {
+	wrceiling = limit;
+}
+
 void SocketStream::flushAsync(const std::string_view &data, bool firstCall, CallbackT<void(bool)> &&fn) {
 	if (data.empty()) {
 		getCurrentAsyncProvider().runAsync([fn = std::move(fn)] {
 			fn(true);
 		});
 	} else {
+		++sendCount;
 		sock->write(data.data(), data.size(), [this, data, firstCall, fn = std::move(fn)](int r) mutable {
 			if (r <= 0) {
 				wrbuff.clear();
@@ -96,6 +255,7 @@ void SocketStream::flushAsync(const std::string_view &data, bool firstCall, Call
 }
 
 void SocketStream::flushAsync(CallbackT<void(bool)> &&fn) {
+	uncork();
 	if (wrbuff.empty()) {
 		getCurrentAsyncProvider().runAsync([fn = std::move(fn)] {
 			fn(true);
@@ -110,12 +270,23 @@ void SocketStream::flushAsync(CallbackT<void(bool)> &&fn) {
 
 
 void SocketStream::flush_lk() {
+	uncork();
+	send_lk();
+}
+
+void SocketStream::send_lk() {
 	std::string_view s(wrbuff);
 	if (!s.empty())  {
+		++sendCount;
 		unsigned int wx = sock->write(s.data(),s.length());
 		bool rep = wx < s.length();
 		while (rep) {
+			if (wx == 0 && sock->timeouted()) {
+				wrbuff.clear();
+				return;
+			}
 			s = s.substr(wx);
+			++sendCount;
 			wx = sock->write(s.data(),s.length());
 			rep = wx < s.length();
 			if (rep && wx < wrbufflimit) {
@@ -150,6 +321,26 @@ void SocketStream::readAsync(CallbackT<void(const std::string_view &data)> &&fn)
 	}
 }
 
+std::size_t SocketStream::getSendCount() const {
+	return sendCount;
+}
+
+bool SocketStream::canSendFile() const {
+	return sock->canSendFile();
+}
+
+void SocketStream::sendFileAsync(int fd, std::uint64_t offset, std::size_t size, CallbackT<void(int)> &&fn) {
+	//buffered data must precede the file
+	flushAsync([this, fd, offset, size, fn = std::move(fn)](bool ok) mutable {
+		if (!ok) {
+			fn(0);
+		} else {
+			++sendCount;
+			sock->sendFile(fd, offset, size, std::move(fn));
+		}
+	});
+}
+
 std::size_t SocketStream::getOutputBufferSize() const {
 	return wrbufflimit;
 }
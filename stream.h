@@ -11,6 +11,7 @@
 #include <memory>
 #include <mutex>
 #include "isocket.h"
+#include "format.h"
 
 namespace userver {
 
@@ -31,6 +32,52 @@ public:
 	virtual void clearTimeout() = 0;
 	virtual ~AbstractStream() {};
 	virtual std::size_t getOutputBufferSize() const = 0;
+	///Reserves space at the end of the output buffer for direct writing
+	/**
+	 * @param size size of the space in bytes
+	 * @return pointer to the reserved space. Written data must be committed by commitNB() before
+	 * any other write operation. Function returns nullptr, when stream doesn't support
+	 * direct writing, then data must be written by writeNB().
+	 */
+	virtual char *reserveNB(std::size_t ) {return nullptr;}
+	///Commits data written to the space returned by reserveNB()
+	/**
+	 * @param size count of bytes actually written. Must not be above reserved size
+	 * @retval true required flush
+	 * @retval false no flush required yet
+	 */
+	virtual bool commitNB(std::size_t ) {return false;}
+	///Returns count of bytes, which can be written before the stream needs to send its output buffer
+	/** Writers can use this value to fit their data into the next send operation */
+	virtual std::size_t getWriteWindow() const {return getOutputBufferSize();}
+	///Determines whether stream can accept more data without exceeding its high watermark
+	virtual bool isWritable() const {return true;}
+	///Asynchronously waits until the stream drains its output buffer below its low watermark
+	/**
+	 * @param fn callback called with true when stream is writable, or false when error
+	 */
+	virtual void waitWritableAsync(CallbackT<void(bool)> &&fn) {flushAsync(std::move(fn));}
+	///Returns count of send operations performed on the underlying socket
+	virtual std::size_t getSendCount() const {return 0;}
+	///Returns data already received in the input buffer without reading from the source
+	/** Returned data are removed from the buffer, use putBack() to return unprocessed part.
+	 * Returns empty string when nothing is buffered or the stream doesn't support this */
+	virtual std::string_view readBuffered() {return std::string_view();}
+	///Determines whether the stream can send a file by sendFileAsync()
+	virtual bool canSendFile() const {return false;}
+	///Sends part of a file asynchronously, bypassing the output buffer
+	/**
+	 * Data in the output buffer are sent first.
+	 *
+	 * @param fd file descriptor
+	 * @param offset offset in the file
+	 * @param size count of bytes to send
+	 * @param fn callback receives count of bytes sent, which can be less than size. It
+	 * receives 0 when error, timeout or end of file
+	 *
+	 * @note supported only when canSendFile() returns true
+	 */
+	virtual void sendFileAsync(int , std::uint64_t , std::size_t , CallbackT<void(int)> &&fn) {fn(0);}
 
 };
 
@@ -204,6 +251,9 @@ public:
 	 * state of previous call.
 	 */
 	void putBack(const std::string_view &pb) {return ptr->putBack(pb);}
+	///Returns data already received in the input buffer without reading from the source
+	/** @copydetails AbstractStream::readBuffered */
+	std::string_view readBuffered() {return ptr->readBuffered();}
 	///Synchronous write
 	/**
 	 *
@@ -279,7 +329,9 @@ public:
 		template<typename Fn> auto flushAsync(Fn &&fn) -> decltype(std::declval<Fn>()(std::declval<Stream &>())) {
 			auto ptr = owner.ptr;
 			ptr->flushAsync([owner = std::move(owner), fn = std::forward<Fn>(fn)](bool ok) mutable {
-				fn(owner);
+				//stream is released before fn, which can hold the owner of the underlying stream
+				Stream s(std::move(owner));
+				fn(s);
 			});
 		}
 		template<typename Fn> auto flushAsync(Fn &&fn) -> decltype(std::declval<Fn>()(std::declval<Stream>(), std::declval<bool>())) {
@@ -291,7 +343,9 @@ public:
 		template<typename Fn> auto flushAsync(Fn &&fn) -> decltype(std::declval<Fn>()(std::declval<Stream &>(),std::declval<bool>())) {
 			auto ptr = owner.ptr;
 			ptr->flushAsync([owner = std::move(owner), fn = std::forward<Fn>(fn)](bool ok) mutable {
-				fn(owner, ok);
+				//stream is released before fn, which can hold the owner of the underlying stream
+				Stream s(std::move(owner));
+				fn(s, ok);
 			});
 		}
 	};
@@ -391,22 +445,95 @@ public:
 	 * @retval false unable to read line - stream read error
 	 */
 	bool getLine(std::string &ln, std::string_view sep = "\n") {
-		ln.clear();
+		std::string_view out;
+		bool found = readUntil(sep, ln, out);
+		if (out.data() != ln.data()) ln.assign(out);
+		return found || !ln.empty();
+	}
+	///Read data until separator is found (synchronously)
+	/**
+	 * The separator is searched directly in the buffer returned by the read(). If
+	 * the token is complete in the single buffer, no copying is involved and result
+	 * refers to the stream's read buffer. Otherwise the data are collected to the
+	 * supplied buffer.
+	 *
+	 * @param sep separator (extracted but not stored)
+	 * @param buffer buffer used when the token spans multiple reads
+	 * @param out receives the token. The view is valid until next read or
+	 * until the buffer is modified
+	 * @retval true success
+	 * @retval false separator was not found, end of stream reached. The variable out
+	 * contains rest of the stream
+	 */
+	bool readUntil(const std::string_view &sep, std::string &buffer, std::string_view &out) {
+		buffer.clear();
 		auto b = readSync();
-		int e = 0;
+		auto p = findSeparator(b, sep);
+		if (p != b.npos) {
+			out = b.substr(0, p);
+			putBack(b.substr(p + sep.length()));
+			return true;
+		}
+		buffer.append(b);
 		while (!b.empty()) {
-			ln.append(b);
-			auto p = ln.find(sep, e);
-			if (p != ln.npos) {
-				auto rm = ln.length() - p - sep.length();
+			auto from = buffer.length() < sep.length()?0:buffer.length() - sep.length() + 1;
+			b = readSync();
+			buffer.append(b);
+			p = findSeparator(buffer, sep, from);
+			if (p != buffer.npos) {
+				auto rm = buffer.length() - p - sep.length();
 				putBack(b.substr(b.length() - rm));
-				ln.resize(p);
+				buffer.resize(p);
+				out = buffer;
 				return true;
 			}
-			e = static_cast<int>(ln.length() - sep.length()+1);
-			b = read();
 		}
-		return !ln.empty();
+		out = buffer;
+		return false;
+	}
+	///Read exact count of bytes (synchronously)
+	/**
+	 * @param count count of bytes to read
+	 * @param buffer buffer used when the data spans multiple reads
+	 * @param out receives the data. If the data are available in the single buffer,
+	 * no copying is involved and the result refers to the stream's read buffer.
+	 * @retval true success
+	 * @retval false end of stream reached, variable out contains rest of the stream
+	 */
+	bool readExactly(std::size_t count, std::string &buffer, std::string_view &out) {
+		buffer.clear();
+		if (count == 0) {
+			out = std::string_view();
+			return true;
+		}
+		auto b = readSync();
+		if (b.length() >= count) {
+			out = b.substr(0, count);
+			putBack(b.substr(count));
+			return true;
+		}
+		while (!b.empty()) {
+			auto part = b.substr(0, count - buffer.length());
+			buffer.append(part);
+			if (buffer.length() == count) {
+				putBack(b.substr(part.length()));
+				out = buffer;
+				return true;
+			}
+			b = readSync();
+		}
+		out = buffer;
+		return false;
+	}
+	///Retrieves data available for reading without consuming them (synchronously)
+	/**
+	 * @return data which will be returned by next read. Function blocks when
+	 * there are no data available. Returns empty string at the end of stream
+	 */
+	std::string_view peek() {
+		auto b = readSync();
+		putBack(b);
+		return b;
 	}
 	///Send a char - synchronously
 	/**
@@ -451,47 +578,253 @@ public:
 	}
 	bool valid() const {return ptr != nullptr;}
 	bool owned() const {return owner;}
+	///Writes directly to the output buffer (non blocking)
+	/**
+	 * @tparam N maximum count of bytes written by the function
+	 * @param fn function which receives pointer to the buffer of N bytes. It must return pointer
+	 * after last written byte. When the stream supports direct writing, the data are written to
+	 * the output buffer of the stream, otherwise temporary buffer on stack is used
+	 * @retval true required flush
+	 * @retval false no flush required yet
+	 */
+	template<std::size_t N, typename Fn>
+	bool putDirectNB(Fn &&fn) {
+		char *p = ptr->reserveNB(N);
+		if (p) return ptr->commitNB(fn(p) - p);
+		char buff[N];
+		return writeNB(std::string_view(buff, fn(buff) - buff));
+	}
+	///Put unsigned number to the output buffer
+	/**
+	 * @param x number
+	 * @param base base (2-62)
+	 * @param lpad minimal count of digits, number is padded by zeroes (up to 64 digits)
+	 * @retval true required flush
+	 * @retval false no flush required yet
+	 */
 	template<typename T>
 	bool putUnsignedNB(const T &x, unsigned int base = 10, int lpad = 1) {
-		if (x == 0 && lpad < 0) return false;
-		putUnsignedNB(x/base, base, lpad-1);
-		unsigned int s = x%base;
-		if (s < 10) return putCharNB(s+'0');
-		else if (s < 36) return putCharNB(s+'A'-10);
-		else return putCharNB(s+'a'-36);
+		return putDirectNB<maxIntegerChars>([&](char *b){
+			return formatUnsigned(b, b+maxIntegerChars, x, base, clampDigits(lpad));
+		});
 	}
 	template<typename T>
 	void putUnsigned(const T &x, unsigned int base = 10, int lpad = 1) {
 		if (putUnsignedNB(x,base,lpad)) flush();
 	}
+	///Put signed number to the output buffer
+	/**
+	 * @copydetails putUnsignedNB
+	 */
 	template<typename T>
 	bool putSignedNB(const T &x, unsigned int base = 10, int lpad = 1) {
-		if (x < 0) {
-			putCharNB('-');
-			return putUnsignedNB(-x, base, lpad);
-		} else {
-			return putUnsignedNB(x, base, lpad);
-		}
+		return putDirectNB<maxIntegerChars>([&](char *b){
+			return formatSigned(b, b+maxIntegerChars, x, base, clampDigits(lpad));
+		});
 	}
 	template<typename T>
 	void putSigned(const T &x, unsigned int base = 10, int lpad = 1) {
 		if (putSignedNB(x,base,lpad)) flush();
 	}
+	///Put number in hexadecimal format to the output buffer
+	/**
+	 * @param x number
+	 * @param lpad minimal count of digits
+	 * @param upper true to use uppercase letters
+	 * @retval true required flush
+	 * @retval false no flush required yet
+	 */
+	template<typename T>
+	bool putHexNB(const T &x, int lpad = 1, bool upper = true) {
+		return putDirectNB<maxIntegerChars>([&](char *b){
+			return formatSigned(b, b+maxIntegerChars, x, 16, clampDigits(lpad), upper);
+		});
+	}
+	///Put floating point number to the output buffer
+	/**
+	 * @param x number
+	 * @param precision count of decimal places. Negative value selects shortest representation
+	 * @retval true required flush
+	 * @retval false no flush required yet
+	 */
+	bool putDoubleNB(double x, int precision = -1) {
+		return putDirectNB<maxDoubleChars>([&](char *b){
+			return formatDouble(b, b+maxDoubleChars, x, precision);
+		});
+	}
+	///Put escaped string to the output buffer
+	/**
+	 * @param text text to escape, see escapeString()
+	 * @retval true required flush
+	 * @retval false no flush required yet
+	 */
+	bool putEscapedNB(const std::string_view &text) {
+		bool r = false;
+		escapeString(text, [&](const std::string_view &s){r = writeNB(s);});
+		return r;
+	}
+	///Put formatted text to the output buffer
+	/**
+	 * @param fmt format string, see FormatString
+	 * @param args arguments
+	 * @retval true required flush
+	 * @retval false no flush required yet
+	 *
+	 * @code
+	 * stream.formatNB("%s %d %s\r\n", httpver, code, message);
+	 * @endcode
+	 */
+	template<typename ... Args>
+	bool formatNB(const FormatString<std::decay_t<Args>...> &fmt, const Args & ... args) {
+		std::string_view f = fmt.str;
+		bool r = false;
+		((r |= formatNextNB(f, args)),...);
+		r |= formatTailNB(f);
+		return r;
+	}
+	///Put formatted text to the output buffer, flush when needed
+	/**
+	 * @copydetails formatNB
+	 */
+	template<typename ... Args>
+	void format(const FormatString<std::decay_t<Args>...> &fmt, const Args & ... args) {
+		if (formatNB<Args...>(fmt, args...)) flush();
+	}
 
 	std::size_t getOutputBufferSize() const {return ptr->getOutputBufferSize();}
+	///Reserves space at the end of the output buffer for direct writing
+	/** @copydetails AbstractStream::reserveNB */
+	char *reserveNB(std::size_t size) {return ptr->reserveNB(size);}
+	///Commits data written to the space returned by reserveNB()
+	/** @copydetails AbstractStream::commitNB */
+	bool commitNB(std::size_t size) {return ptr->commitNB(size);}
+	///Returns count of bytes, which can be written before the stream needs to send its output buffer
+	std::size_t getWriteWindow() const {return ptr->getWriteWindow();}
+	///Determines whether stream can accept more data
+	/**
+	 * @retval true stream can accept more data
+	 * @retval false output buffer reached high watermark, writer should wait using waitWritable()
+	 */
+	bool isWritable() const {return ptr->isWritable();}
+	///Waits asynchronously until the stream is able to accept more data
+	/**
+	 * Sends data from the output buffer until amount of buffered data drops below
+	 * low watermark. This allows to stream large content without buffering it whole
+	 *
+	 * @param fn callback function, receives true when stream is writable, or false when error
+	 *
+	 * @code
+	 * if (!stream.isWritable()) {
+	 *     stream.waitWritable([=](bool ok){ if (ok) continueWriting(); });
+	 *     return;
+	 * }
+	 * @endcode
+	 */
+	template<typename Fn>
+	void waitWritable(Fn &&fn) {ptr->waitWritableAsync(std::forward<Fn>(fn));}
+	///Returns count of send operations performed on the underlying socket
+	/** Useful to measure how well the writes are coalesced */
+	std::size_t getSendCount() const {return ptr->getSendCount();}
+	///Determines whether the stream can send a file by sendFileAsync()
+	bool canSendFile() const {return ptr->canSendFile();}
+	///Sends part of a file asynchronously, bypassing the output buffer
+	/** @copydetails AbstractStream::sendFileAsync */
+	template<typename Fn>
+	void sendFileAsync(int fd, std::uint64_t offset, std::size_t size, Fn &&fn) {
+		ptr->sendFileAsync(fd, offset, size, std::forward<Fn>(fn));
+	}
 protected:
 	AbstractStream *ptr;
 	bool owner;
+
+	static unsigned int clampDigits(int lpad) {
+		return std::min<unsigned int>(std::max(lpad, 1), maxIntegerChars-1);
+	}
+
+	bool formatTextNB(std::string_view &f) {
+		bool r = false;
+		for(;;) {
+			auto p = f.find('%');
+			if (p == f.npos) {
+				if (!f.empty()) r = writeNB(f);
+				f = std::string_view();
+				return r;
+			}
+			if (p) r = writeNB(f.substr(0,p));
+			if (p+1 < f.length() && f[p+1] == '%') {
+				r = writeNB(f.substr(p,1));
+				f = f.substr(p+2);
+			} else {
+				f = f.substr(p+1);
+				return r;
+			}
+		}
+	}
+
+	///Writes rest of the format string after the last argument
+	/** Placeholders without an argument (format string is not checked in C++17 release build)
+	 * are written as they are, so no text is lost */
+	bool formatTailNB(std::string_view f) {
+		bool r = false;
+		for(;;) {
+			auto p = f.find("%%");
+			if (p == f.npos) {
+				if (!f.empty()) r = writeNB(f);
+				return r;
+			}
+			r = writeNB(f.substr(0,p+1));
+			f = f.substr(p+2);
+		}
+	}
+
+	template<typename T>
+	bool formatNextNB(std::string_view &f, const T &v) {
+		bool r = formatTextNB(f);
+		int width = -1;
+		std::size_t pos = 0;
+		while (pos < f.length() && f[pos] >= '0' && f[pos] <= '9') {
+			width = std::max(width,0) * 10 + (f[pos] - '0');
+			++pos;
+		}
+		char spec = pos < f.length()?f[pos++]:'s';
+		f = f.substr(pos);
+		return formatArgNB(spec, width, v) || r;
+	}
+
+	template<typename T>
+	bool formatArgNB(char spec, int width, const T &v) {
+		using U = std::decay_t<T>;
+		if constexpr(std::is_same_v<U, bool>) {
+			return writeNB(v?"true":"false");
+		} else if constexpr(std::is_same_v<U, char>) {
+			if (spec == 'q') return putEscapedNB(std::string_view(&v,1));
+			else return putCharNB(v);
+		} else if constexpr(std::is_integral_v<U>) {
+			switch (spec) {
+				case 'x': return putHexNB(v, width, false);
+				case 'X': return putHexNB(v, width, true);
+				case 'f': return putDoubleNB(static_cast<double>(v), width);
+				default: return putSignedNB(v, 10, width);
+			}
+		} else if constexpr(std::is_floating_point_v<U>) {
+			return putDoubleNB(static_cast<double>(v), width);
+		} else {
+			if (spec == 'q') return putEscapedNB(std::string_view(v));
+			else return writeNB(std::string_view(v));
+		}
+	}
 };
 
 ///Stream handles reads or writes from/to the socket
 class SocketStream: public AbstractStream {
 public:
 	SocketStream(std::unique_ptr<ISocket> sock):sock(std::move(sock)) {}
+	~SocketStream();
 
 	virtual std::string_view read() override;
 	virtual void readAsync(CallbackT<void(const std::string_view &data)> &&fn) override;
 	virtual void putBack(const std::string_view &pb) override;
+	virtual std::string_view readBuffered() override;
 	virtual void write(const std::string_view &data) override;
 	virtual bool writeNB(const std::string_view &data) override;
 	virtual void closeOutput() override;
@@ -501,9 +834,67 @@ public:
 	virtual bool timeouted() const override;
 	virtual std::size_t getOutputBufferSize() const override;
 	virtual void clearTimeout() override;
+	virtual char *reserveNB(std::size_t size) override;
+	virtual bool commitNB(std::size_t size) override;
+	virtual std::size_t getWriteWindow() const override;
+	virtual bool isWritable() const override;
+	virtual void waitWritableAsync(CallbackT<void(bool)> &&fn) override;
+	virtual std::size_t getSendCount() const override;
+	virtual bool canSendFile() const override;
+	virtual void sendFileAsync(int fd, std::uint64_t offset, std::size_t size, CallbackT<void(int)> &&fn) override;
 	ISocket &getSocket() const;
 
+	///Sets output buffer watermarks for this stream
+	/**
+	 * @param high when output buffer reaches this size, the stream is not writable
+	 * @param low waitWritable() waits until the output buffer drops below this size
+	 */
+	void setWatermarks(std::size_t high, std::size_t low);
+	///Sets maximum size of the output buffer for this stream
+	/**
+	 * @param limit maximum size of the output buffer. If non-blocking write exceeds this
+	 * size, an exception std::system_error(ENOBUFS) is thrown. Set 0 to unlimited
+	 */
+	void setBufferLimit(std::size_t limit);
+
 	static std::size_t maxWrBufferSize;
+	///Default high watermark for new streams
+	static std::size_t highWatermark;
+	///Default low watermark for new streams
+	static std::size_t lowWatermark;
+	///Default maximum size of output buffer for new streams
+	static std::size_t maxBufferLimit;
+	///Enables write coalescing inside of asynchronous tasks (default true)
+	/**
+	 * When enabled, write() called inside of an AutoCork scope doesn't send
+	 * the data when the output buffer becomes full, it defers the sending until the
+	 * scope ends, so all writes done by a single task are sent at once. Explicit
+	 * flush() is not affected. Output buffer is still limited by the high watermark
+	 */
+	static bool autoCork;
+
+	///Defines scope, where writes are coalesced
+	/**
+	 * AsyncProvider creates this scope for every task it executes. Streams written
+	 * inside of the scope are flushed when the scope ends. Nested scopes are
+	 * merged with the outer scope.
+	 *
+	 * The stream can be passed to other thread before the scope ends. The first
+	 * write operation in the other thread takes the stream back from the scope (it waits
+	 * if the scope is just flushing it). Destruction of the stream removes it from the scope
+	 * in any thread
+	 */
+	class AutoCork {
+	public:
+		AutoCork();
+		~AutoCork();
+		AutoCork(const AutoCork &) = delete;
+		AutoCork &operator=(const AutoCork &) = delete;
+	protected:
+		bool owner;
+	};
+
+	struct CorkHandle;
 
 protected:
 	std::unique_ptr<ISocket> sock;
@@ -512,9 +903,21 @@ protected:
 	std::string_view curbuff;
 	bool eof = false;
 	std::size_t wrbufflimit = 1000;
+	std::size_t wrreserved = 0;
+	std::size_t wrhigh = highWatermark;
+	std::size_t wrlow = lowWatermark;
+	std::size_t wrceiling = maxBufferLimit;
+	std::size_t sendCount = 0;
+	///handle shared with the scope, which corked the stream (nullptr if not corked)
+	mutable std::shared_ptr<CorkHandle> corkHandle;
 
 	void flush_lk();
+	void send_lk();
 	void flushAsync(const std::string_view &data, bool firstCall, CallbackT<void(bool)> &&fn);
+	void checkBufferLimit(std::size_t size);
+	bool cork();
+	void uncork() const;
+	void checkCork() const;
 };
 
 ///Stream handles reads or writes to other stream can limit how much bytes can be read or written
@@ -540,6 +943,34 @@ public:
 	virtual bool timeouted() const override;
 	virtual void clearTimeout() override;
 	virtual std::size_t getOutputBufferSize() const override;
+	///Reserves space in the source. Data above the write limit are discarded on commit
+	virtual char *reserveNB(std::size_t size) override;
+	virtual bool commitNB(std::size_t size) override;
+	virtual std::size_t getWriteWindow() const override;
+	virtual bool isWritable() const override;
+	virtual void waitWritableAsync(CallbackT<void(bool)> &&fn) override;
+	virtual std::size_t getSendCount() const override;
+	virtual bool canSendFile() const override;
+	///Sends part of a file. Data above the write limit are not sent
+	virtual void sendFileAsync(int fd, std::uint64_t offset, std::size_t size, CallbackT<void(int)> &&fn) override;
+
+	///Returns count of bytes remaining to read from the source
+	std::size_t getRemainingInput() const {return maxRead;}
+	///Transfers reading state to other stream, so it can continue reading the same data
+	/**
+	 * Data put back to this stream are discarded. This stream acts as fully read
+	 * @param target target stream
+	 */
+	void transferInput(LimitedStream &target) {
+		target.maxRead = maxRead;
+		target.curBuff = std::string_view();
+		abandonInput();
+	}
+	///Marks input as fully read without reading rest of data from the source
+	void abandonInput() {
+		maxRead = 0;
+		curBuff = std::string_view();
+	}
 protected:
 	SS source;
 	std::size_t maxRead;
@@ -554,13 +985,26 @@ protected:
  * The stream ends by terminating chunk. By closing output, terminating chunk
  * is written.
  *
+ * Reading is done by incremental decoder, which processes any data available
+ * and never waits for rest of the chunk header. Chunk extensions and trailers
+ * are accepted and ignored.
+ *
+ * Small writes are collected in an internal buffer. Once the collected data reach
+ * minDirectChunk (or maximum chunk size), they are written directly to the output buffer
+ * of the source, when the source supports reserveNB(). Space for the chunk header is
+ * reserved before the data and the size is written when the chunk is closed. The header
+ * uses fixed count of hex digits (leading zeroes are allowed by RFC). Size of the chunk
+ * follows write window of the source, so each chunk fits into single send operation.
+ * Every chunk is closed before the write operation returns, so the source never
+ * contains incomplete chunk
  */
 template<typename SS>
 class ChunkedStream: public AbstractStream {
 public:
 	ChunkedStream(SS &&source,bool writing, bool reading)
 		:source(std::forward<SS>(source)),eof(!reading),writing(writing),reading(reading),closed(!writing) {
-		maxChunkSize = std::max<decltype(maxChunkSize)>(source.getOutputBufferSize(),20)-20;
+		//source of a read-only stream can be still unbound (see HttpServerRequest::reuse_buffers)
+		maxChunkSize = writing?std::max<decltype(maxChunkSize)>(source.getOutputBufferSize(),20)-20:0;
 	}
 	~ChunkedStream();
 	virtual std::string_view read() override;
@@ -574,8 +1018,41 @@ public:
 	virtual void flushAsync(CallbackT<void(bool)> &&fn) override;
 	virtual bool timeouted() const override;
 	virtual void clearTimeout()  override;
+	virtual char *reserveNB(std::size_t size) override;
+	virtual bool commitNB(std::size_t size) override;
+	virtual bool isWritable() const override;
+	virtual void waitWritableAsync(CallbackT<void(bool)> &&fn) override;
+	virtual std::size_t getSendCount() const override;
 
 	virtual std::size_t getOutputBufferSize() const override;
+
+	///Determines whether there are still data to read from the source
+	bool hasRemainingInput() const {return reading && !eof;}
+	///Determines whether reading failed
+	/**
+	 * @retval true body has invalid format or the source ended before the terminating chunk.
+	 * The stream reports end of data, however the body is incomplete and position in the source
+	 * is undefined, so the source can't be used to read further data
+	 */
+	bool hasError() const {return rdState == ReadState::error;}
+	///Transfers state of the decoder to other stream, so it can continue reading the same data
+	/**
+	 * Data put back to this stream are discarded. This stream acts as fully read
+	 * @param target target stream
+	 */
+	void transferInput(ChunkedStream &target) {
+		target.rdState = rdState;
+		target.readRemain = readRemain;
+		target.reading = reading;
+		target.eof = eof;
+		target.curBuff = std::string_view();
+		abandonInput();
+	}
+	///Marks input as fully read without reading rest of data from the source
+	void abandonInput() {
+		eof = true;
+		curBuff = std::string_view();
+	}
 protected:
 	SS source;
 	std::size_t maxChunkSize;
@@ -584,12 +1061,67 @@ protected:
 	bool reading = false;
 	bool closed  =false;
 	std::size_t readRemain = 0;
+	std::size_t reservedPos = 0;
+	///chunk open in the output buffer of the source (nullptr if none). It is open
+	///only during write operation, or between reserveNB() and commitNB()
+	char *wrChunk = nullptr;
+	///count of bytes written to the open chunk
+	std::size_t wrChunkUsed = 0;
+	///capacity of the open chunk
+	std::size_t wrChunkSize = 0;
+	///source doesn't support direct writing, curChunk is used
+	bool wrIndirect = false;
+	///closed chunk filled output buffer of the source, source should be flushed
+	bool wrFlush = false;
 	std::string curChunk;
-	std::string ln;
 	std::string_view curBuff;
 
-	void putHex(std::size_t sz);
+	enum class ReadState: unsigned char {
+		///expecting first digit of chunk size
+		size_start,
+		///reading chunk size
+		size,
+		///skipping chunk extension
+		ext,
+		///expecting LF after chunk size
+		size_lf,
+		///reading chunk data
+		data,
+		///expecting CR after chunk data
+		data_cr,
+		///expecting LF after chunk data
+		data_lf,
+		///at beginning of trailer line
+		trailer,
+		///skipping trailer line
+		trailer_line,
+		///expecting LF after trailer line
+		trailer_lf,
+		///expecting final LF
+		end_lf,
+		///whole body has been read
+		done,
+		///invalid format
+		error
+	};
+
+	ReadState rdState = ReadState::size_start;
+
+	///count of hex digits of the chunk size written directly to the source
+	static constexpr std::size_t chunkSizeDigits = 8;
+	///size of the chunk header (size + CRLF)
+	static constexpr std::size_t chunkHdrSize = chunkSizeDigits + 2;
+	///minimal payload of the chunk written directly to the source
+	static constexpr std::size_t minDirectChunk = 4096;
+
 	bool flushNB();
+	void writePending();
+	bool writeData(std::string_view data);
+	bool openChunk(std::size_t minSize);
+	bool closeChunk();
+	bool writeChunk(std::string_view &data);
+	std::string_view decode(std::string_view &data);
+	static int hexDigit(char c);
 };
 
 
@@ -634,7 +1166,9 @@ inline void LimitedStream<SS>::closeOutput() {
 
 template<typename SS>
 inline void LimitedStream<SS>::closeInput() {
-	while (maxRead) read();
+	while (maxRead) {
+		if (read().empty()) break;
+	}
 }
 
 template<typename SS>
@@ -701,25 +1235,18 @@ inline ChunkedStream<SS>::~ChunkedStream() {
 template<typename SS>
 inline std::string_view ChunkedStream<SS>::read() {
 	if (curBuff.empty()) {
-		if (!reading)
-			return std::string_view();
-		if (eof) return std::string_view();
-		if (readRemain == 0) {
-			ln.clear();
-			if (!source.getLine(ln,"\r\n")) return std::string_view();
-			while (ln.empty()) {
-				if (!source.getLine(ln,"\r\n")) return std::string_view();
-			}
-			readRemain = std::strtoul(ln.c_str(), 0, 16);
-			if (readRemain == 0) {
-				eof = true;return std::string_view();
+		while (!eof) {
+			auto rd = source.readSync();
+			if (rd.empty()) {
+				eof = true;
+				rdState = ReadState::error;
+				break;
 			}
+			auto out = decode(rd);
+			source.putBack(rd);
+			if (!out.empty()) return out;
 		}
-		auto rd = source.readSync();
-		auto out = rd.substr(0,readRemain);
-		source.putBack(rd.substr(out.length()));
-		readRemain -= out.length();
-		return out;
+		return std::string_view();
 	} else {
 		std::string_view res;
 		std::swap(res, curBuff);
@@ -733,17 +1260,109 @@ inline void ChunkedStream<SS>::putBack(const std::string_view &pb) {
 }
 
 template<typename SS>
-inline void ChunkedStream<SS>::write(const std::string_view &data) {
+inline bool ChunkedStream<SS>::openChunk(std::size_t minSize) {
+	if (wrChunk) {
+		if (wrChunkSize - wrChunkUsed >= minSize) return true;
+		closeChunk();
+	}
+	if (wrIndirect) return false;
+	std::size_t sz = source.getWriteWindow();
+	//rest of the window is too small (or the source is corked), size the chunk for the next send
+	if (sz < chunkHdrSize + 2 + minDirectChunk) sz = source.getOutputBufferSize();
+	sz = sz > chunkHdrSize + 2?sz - chunkHdrSize - 2:0;
+	sz = std::min<std::size_t>(std::max({sz, minSize, minDirectChunk}), 0xFFFFFFFF);
+	wrChunk = source.reserveNB(chunkHdrSize + sz + 2);
+	if (!wrChunk) {
+		wrIndirect = true;
+		return false;
+	}
+	wrChunkUsed = 0;
+	wrChunkSize = sz;
+	return true;
+}
+
+template<typename SS>
+inline bool ChunkedStream<SS>::closeChunk() {
+	if (!wrChunk) return false;
+	char *p = wrChunk;
+	wrChunk = nullptr;
+	if (wrChunkUsed == 0) return wrFlush = source.commitNB(0) || wrFlush;
+	formatUnsigned(p, p + chunkSizeDigits, wrChunkUsed, 16, chunkSizeDigits);
+	p[chunkSizeDigits] = '\r';
+	p[chunkSizeDigits+1] = '\n';
+	p += chunkHdrSize + wrChunkUsed;
+	p[0] = '\r';
+	p[1] = '\n';
+	return wrFlush = source.commitNB(chunkHdrSize + wrChunkUsed + 2) || wrFlush;
+}
+
+///Writes data to open chunk
+/**
+ * @param data data to write, receives part which did not fit into the chunk
+ * @retval true source should be flushed
+ * @retval false no flush required yet
+ */
+template<typename SS>
+inline bool ChunkedStream<SS>::writeChunk(std::string_view &data) {
+	std::size_t n = std::min(data.size(), wrChunkSize - wrChunkUsed);
+	std::copy(data.begin(), data.begin()+n, wrChunk + chunkHdrSize + wrChunkUsed);
+	wrChunkUsed += n;
+	data = data.substr(n);
+	if (wrChunkUsed == wrChunkSize) closeChunk();
+	return wrFlush;
+}
+
+///Writes data as chunks
+/**
+ * Data are collected in curChunk until they reach size of a direct chunk. Then
+ * the collected data and the new data are written to chunks opened directly in the output buffer of
+ * the source. All chunks are closed before the function returns, the rest which
+ * is too small for a direct chunk stays in curChunk
+ *
+ * @param data data to write
+ * @retval true source should be flushed
+ * @retval false no flush required yet
+ */
+template<typename SS>
+inline bool ChunkedStream<SS>::writeData(std::string_view data) {
+	std::size_t minSize = std::min(minDirectChunk, maxChunkSize);
+	if (!wrIndirect && curChunk.length() + data.length() >= minSize) {
+		std::string_view pend(curChunk);
+		if (openChunk(pend.length() + std::min(data.length(), minSize))) {
+			//collected data are written at the beginning of the first chunk
+			writeChunk(pend);
+			curChunk.clear();
+			do {
+				writeChunk(data);
+			} while (data.length() >= minSize && openChunk(minSize));
+			closeChunk();
+		}
+	}
 	curChunk.append(data);
-	if (curChunk.length() >= maxChunkSize) flush();
+	bool r = wrFlush;
+	wrFlush = false;
+	return r;
+}
 
+template<typename SS>
+inline void ChunkedStream<SS>::write(const std::string_view &data) {
+	if (closed) return;
+	bool fl = writeData(data);
+	if (curChunk.length() >= maxChunkSize) {
+		writePending();
+		wrFlush = false;
+		maxChunkSize = std::max<decltype(maxChunkSize)>(source.getOutputBufferSize(),20)-20;
+		fl = true;
+	}
+	//let the source decide whether the chunks are sent now or coalesced with further writes
+	if (fl) source.write(std::string_view());
 }
 
 template<typename SS>
 inline void ChunkedStream<SS>::closeOutput() {
 	if (!closed) {
-		flush();
-		source.write("0\r\n\r\n");
+		flushNB();
+		source.writeNB("0\r\n\r\n");
 		source.flush();
 		closed = true;
 	}
@@ -776,20 +1395,27 @@ inline void ChunkedStream<SS>::clearTimeout()  {
 	source.clearTimeout();
 }
 
+///Writes collected data as a chunk to the source
 template<typename SS>
-inline bool ChunkedStream<SS>::flushNB() {
+inline void ChunkedStream<SS>::writePending() {
 	if (!curChunk.empty()) {
-		putHex(curChunk.length());
+		source.putHexNB(curChunk.length());
 		source.writeNB("\r\n");
 		source.writeNB(curChunk);
-		bool ret = source.writeNB("\r\n");
+		wrFlush = source.writeNB("\r\n") || wrFlush;
 		curChunk.clear();
-		return ret;
-	} else {
-		return false;
 	}
 }
 
+template<typename SS>
+inline bool ChunkedStream<SS>::flushNB() {
+	closeChunk();
+	writePending();
+	bool r = wrFlush;
+	wrFlush = false;
+	return r;
+}
+
 template<typename SS>
 inline bool ChunkedStream<SS>::timeouted() const {
 	return source.timeouted();
@@ -798,9 +1424,22 @@ inline bool ChunkedStream<SS>::timeouted() const {
 template<typename SS>
 inline void ChunkedStream<SS>::readAsync(CallbackT<void(const std::string_view &data)> &&fn) {
 	if (curBuff.empty()) {
-		source.read() >> [fn = std::move(fn),this](const std::string_view &data) {
-			source.putBack(data);
-			fn(read());
+		if (eof) {
+			fn(std::string_view());
+			return;
+		}
+		source.read() >> [fn = std::move(fn),this](const std::string_view &data) mutable {
+			if (data.empty()) {
+				eof = true;
+				rdState = ReadState::error;
+				fn(data);
+			} else {
+				std::string_view rd = data;
+				auto out = decode(rd);
+				source.putBack(rd);
+				if (out.empty() && !eof) readAsync(std::move(fn));
+				else fn(out);
+			}
 		};
 	} else {
 		std::string_view out;
@@ -811,8 +1450,8 @@ inline void ChunkedStream<SS>::readAsync(CallbackT<void(const std::string_view &
 
 template<typename SS>
 inline bool ChunkedStream<SS>::writeNB(const std::string_view &data) {
-	curChunk.append(data);
-	return (curChunk.length() >= maxChunkSize);
+	if (closed) return false;
+	return writeData(data) || curChunk.length() >= maxChunkSize;
 }
 
 template<typename SS>
@@ -826,12 +1465,139 @@ inline void ChunkedStream<SS>::flushAsync(CallbackT<void(bool)> &&fn) {
 }
 
 template<typename SS>
-inline void ChunkedStream<SS>::putHex(std::size_t sz) {
-	if (sz != 0) {
-		putHex(sz>>4);
-		char chars[] = "0123456789ABCDEF";
-		source.putCharNB(chars[sz & 0xF]);
+inline char *ChunkedStream<SS>::reserveNB(std::size_t size) {
+	//large space is reserved in the source, the chunk is closed by commitNB()
+	if (size >= minDirectChunk && !wrIndirect) {
+		writePending();
+		if (openChunk(size)) return wrChunk + chunkHdrSize;
+	}
+	reservedPos = curChunk.length();
+	curChunk.resize(reservedPos + size);
+	return curChunk.data() + reservedPos;
+}
+
+template<typename SS>
+inline bool ChunkedStream<SS>::commitNB(std::size_t size) {
+	if (wrChunk) {
+		wrChunkUsed += size;
+		closeChunk();
+		bool r = wrFlush;
+		wrFlush = false;
+		return r;
+	}
+	curChunk.resize(reservedPos + size);
+	return (curChunk.length() >= maxChunkSize);
+}
+
+template<typename SS>
+inline bool ChunkedStream<SS>::isWritable() const {
+	return source.isWritable();
+}
+
+template<typename SS>
+inline void ChunkedStream<SS>::waitWritableAsync(CallbackT<void(bool)> &&fn) {
+	flushNB();
+	source.waitWritable(std::move(fn));
+}
+
+template<typename SS>
+inline std::size_t ChunkedStream<SS>::getSendCount() const {
+	return source.getSendCount();
+}
+
+template<typename SS>
+inline int ChunkedStream<SS>::hexDigit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	else if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	else if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	else return -1;
+}
+
+///Decodes data
+/**
+ * @param data input data, receives unprocessed part of the input
+ * @return decoded data (refers to the input). Returns empty string, when more input is needed
+ * or when end of body has been reached (eof is set). In case of invalid format, eof is
+ * set, the state stays in error and the input is consumed
+ */
+template<typename SS>
+inline std::string_view ChunkedStream<SS>::decode(std::string_view &data) {
+	std::size_t pos = 0, len = data.length();
+	while (pos < len) {
+		char c = data[pos];
+		switch (rdState) {
+			case ReadState::data: {
+				auto out = data.substr(pos, readRemain);
+				readRemain -= out.length();
+				if (readRemain == 0) rdState = ReadState::data_cr;
+				data = data.substr(pos + out.length());
+				return out;
+			}
+			case ReadState::size_start:
+			case ReadState::size: {
+				int v = hexDigit(c);
+				if (v >= 0) {
+					if (readRemain >> (sizeof(readRemain) * 8 - 4)) rdState = ReadState::error;
+					else {
+						readRemain = (readRemain << 4) | v;
+						rdState = ReadState::size;
+					}
+				} else if (rdState == ReadState::size_start) rdState = ReadState::error;
+				else if (c == '\r') rdState = ReadState::size_lf;
+				else if (c == ';' || c == ' ' || c == '\t') rdState = ReadState::ext;
+				else rdState = ReadState::error;
+			}break;
+			case ReadState::ext:
+				//lines must end by CRLF, bare LF is rejected (it is interpreted differently by proxies)
+				if (c == '\r') rdState = ReadState::size_lf;
+				else if (c == '\n') rdState = ReadState::error;
+				break;
+			case ReadState::size_lf:
+				if (c == '\n') rdState = readRemain?ReadState::data:ReadState::trailer;
+				else rdState = ReadState::error;
+				break;
+			case ReadState::data_cr:
+				if (c == '\r') rdState = ReadState::data_lf;
+				else rdState = ReadState::error;
+				break;
+			case ReadState::data_lf:
+				if (c == '\n') rdState = ReadState::size_start;
+				else rdState = ReadState::error;
+				break;
+			case ReadState::trailer:
+				if (c == '\r') rdState = ReadState::end_lf;
+				else if (c == '\n') rdState = ReadState::error;
+				else rdState = ReadState::trailer_line;
+				break;
+			case ReadState::trailer_line:
+				if (c == '\r') rdState = ReadState::trailer_lf;
+				else if (c == '\n') rdState = ReadState::error;
+				break;
+			case ReadState::trailer_lf:
+				if (c == '\n') rdState = ReadState::trailer;
+				else rdState = ReadState::error;
+				break;
+			case ReadState::end_lf:
+				if (c == '\n') rdState = ReadState::done;
+				else rdState = ReadState::error;
+				break;
+			default:
+				break;
+		}
+		if (rdState == ReadState::done) {
+			eof = true;
+			data = data.substr(pos+1);
+			return std::string_view();
+		}
+		if (rdState == ReadState::error) {
+			eof = true;
+			data = std::string_view();
+			return std::string_view();
+		}
+		++pos;
 	}
+	data = std::string_view();
+	return std::string_view();
 }
 
 template<typename SS>
@@ -844,6 +1610,56 @@ inline std::size_t LimitedStream<SS>::getOutputBufferSize() const {
 	return source.getOutputBufferSize();
 }
 
+template<typename SS>
+inline bool LimitedStream<SS>::isWritable() const {
+	return source.isWritable();
+}
+
+template<typename SS>
+inline void LimitedStream<SS>::waitWritableAsync(CallbackT<void(bool)> &&fn) {
+	source.waitWritable(std::move(fn));
+}
+
+template<typename SS>
+inline std::size_t LimitedStream<SS>::getSendCount() const {
+	return source.getSendCount();
+}
+
+template<typename SS>
+inline bool LimitedStream<SS>::canSendFile() const {
+	return source.canSendFile();
+}
+
+template<typename SS>
+inline void LimitedStream<SS>::sendFileAsync(int fd, std::uint64_t offset, std::size_t size, CallbackT<void(int)> &&fn) {
+	size = std::min(size, maxWrite);
+	if (size == 0) {
+		fn(0);
+		return;
+	}
+	source.sendFileAsync(fd, offset, size, [this, fn = std::move(fn)](int r) mutable {
+		if (r > 0) maxWrite -= r;
+		fn(r);
+	});
+}
+
+template<typename SS>
+inline std::size_t LimitedStream<SS>::getWriteWindow() const {
+	return source.getWriteWindow();
+}
+
+template<typename SS>
+inline char *LimitedStream<SS>::reserveNB(std::size_t size) {
+	return source.reserveNB(size);
+}
+
+template<typename SS>
+inline bool LimitedStream<SS>::commitNB(std::size_t size) {
+	size = std::min(size, maxWrite);
+	maxWrite -= size;
+	return source.commitNB(size);
+}
+
 
 template<typename Buffer, typename Fn, typename >
 inline void Stream::readToStringAsync(Buffer &&buffer, std::size_t maxSize, Fn &&fn) {
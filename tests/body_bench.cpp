@@ -0,0 +1,123 @@
+/*
+ * body_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <variant>
+
+#include "../http_server.h"
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Benchmark of request body decoders
+/**
+ * Compares decoders allocated on the heap for every request (previous getBody())
+ * with decoders stored inline in a variant, as HttpServerRequest stores them now.
+ * Then it parses whole requests with bodies by HttpServerRequest and reports
+ * time and count of allocations per request.
+ *
+ * Usage: body_bench [count of requests]
+ */
+
+static std::atomic<std::size_t> allocations = 0;
+
+void *operator new(std::size_t sz) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(sz?sz:1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+static std::size_t readAll(Stream &s) {
+	std::size_t n = 0;
+	for (auto b = s.readSync(); !b.empty(); b = s.readSync()) n += b.size();
+	return n;
+}
+
+int main(int argc, char **argv) {
+	std::size_t count = argc > 1?std::strtoul(argv[1], nullptr, 10):200000;
+	const std::string body(200, 'x');
+	const std::string chunkedBody = "64\r\n" + body.substr(0,100) + "\r\n64\r\n" + body.substr(100) + "\r\n0\r\n\r\n";
+
+	std::string bodies, chunkedBodies, requests;
+	for (std::size_t i = 0; i < count; i++) {
+		bodies.append(body);
+		chunkedBodies.append(chunkedBody);
+		if (i & 1) {
+			requests.append("POST /upload HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n").append(chunkedBody);
+		} else {
+			requests.append("POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Length: 200\r\n\r\n").append(body);
+		}
+	}
+
+	int failed = 0;
+	auto report = [&](const char *name, std::size_t bytes, std::size_t allocs, double ns) {
+		std::cout << name << " " << ns / count << " ns/request "
+				<< static_cast<double>(allocs) / count << " allocations/request" << std::endl;
+		if (bytes != count * body.size()) {
+			std::cerr << name << ": read " << bytes << " bytes, expected " << count * body.size() << std::endl;
+			failed++;
+		}
+	};
+
+	auto runDecoders = [&](const char *name, const std::string &input, auto &&makeBody) {
+		Stream conn(std::make_unique<MemoryStream>(input));
+		std::size_t bytes = 0;
+		std::size_t allocs = allocations;
+		double ns = measureNs([&]{
+			for (std::size_t i = 0; i < count; i++) {
+				Stream b = makeBody(conn);
+				bytes += readAll(b);
+			}
+		});
+		report(name, bytes, allocations - allocs, ns);
+	};
+
+	runDecoders("limited, heap   ", bodies, [&](Stream &conn) {
+		return Stream(std::make_unique<LimitedStream<Stream &> >(conn, body.size(), 0));
+	});
+	std::variant<std::monostate, LimitedStream<Stream &>, ChunkedStream<Stream &> > inlineBody;
+	runDecoders("limited, inline ", bodies, [&](Stream &conn) {
+		return Stream(&inlineBody.emplace<LimitedStream<Stream &> >(conn, body.size(), 0), false);
+	});
+	runDecoders("chunked, heap   ", chunkedBodies, [&](Stream &conn) {
+		return Stream(std::make_unique<ChunkedStream<Stream &> >(conn, false, true));
+	});
+	runDecoders("chunked, inline ", chunkedBodies, [&](Stream &conn) {
+		return Stream(&inlineBody.emplace<ChunkedStream<Stream &> >(conn, false, true), false);
+	});
+	inlineBody.emplace<std::monostate>();
+
+	//whole requests, empty responses are collected by the memory stream
+	Stream conn(std::make_unique<MemoryStream>(requests));
+	std::size_t bytes = 0;
+	std::size_t allocs = allocations;
+	double ns = measureNs([&]{
+		for (std::size_t i = 0; i < count; i++) {
+			auto req = std::make_unique<HttpServerRequest>();
+			if (!req->init(conn.makeReference())) break;
+			Stream b = req->getBody();
+			bytes += readAll(b);
+			req->setStatus(204);
+			req->send();
+		}
+	});
+	report("request         ", bytes, allocations - allocs, ns);
+
+	return failed?1:0;
+}
@@ -0,0 +1,112 @@
+/*
+ * chunked_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Benchmark of the chunked decoder
+/**
+ * Decodes bodies with chunks of various sizes by ChunkedStream and by the previous
+ * decoder, which read each chunk header by getLine() (appending reads to a string) and
+ * parsed it by strtoul().
+ *
+ * Usage: chunked_bench [read size]
+ */
+
+///Previous implementation of Stream::getLine()
+static bool referenceGetLine(Stream &s, std::string &ln) {
+	ln.clear();
+	auto b = s.readSync();
+	std::size_t e = 0;
+	while (!b.empty()) {
+		ln.append(b);
+		auto p = ln.find("\r\n", e);
+		if (p != ln.npos) {
+			auto rm = ln.length() - p - 2;
+			s.putBack(b.substr(b.length() - rm));
+			ln.resize(p);
+			return true;
+		}
+		e = ln.length() - 1;
+		b = s.readSync();
+	}
+	return !ln.empty();
+}
+
+///Previous implementation of ChunkedStream::read(), returns count of decoded bytes
+static std::size_t referenceDecode(Stream &source) {
+	std::string ln;
+	std::size_t readRemain = 0;
+	std::size_t total = 0;
+	for(;;) {
+		if (readRemain == 0) {
+			if (!referenceGetLine(source, ln)) return total;
+			while (ln.empty()) {
+				if (!referenceGetLine(source, ln)) return total;
+			}
+			readRemain = std::strtoul(ln.c_str(), 0, 16);
+			if (readRemain == 0) return total;
+		}
+		auto rd = source.readSync();
+		auto out = rd.substr(0, readRemain);
+		source.putBack(rd.substr(out.length()));
+		readRemain -= out.length();
+		total += out.length();
+	}
+}
+
+static std::size_t decode(Stream &source) {
+	ChunkedStream<Stream &> body(source, false, true);
+	std::size_t total = 0;
+	for (auto b = body.read(); !b.empty(); b = body.read()) total += b.size();
+	return body.hasError()?0:total;
+}
+
+int main(int argc, char **argv) {
+	std::size_t readSize = argc > 1?std::strtoul(argv[1], nullptr, 10):16384;
+	constexpr std::size_t bodySize = 4*1024*1024;
+	constexpr int repeat = 10;
+	int failed = 0;
+
+	for (std::size_t chunkSize: {16, 256, 4096, 65536}) {
+		std::string body;
+		char hdr[32];
+		for (std::size_t pos = 0; pos < bodySize; pos += chunkSize) {
+			std::snprintf(hdr, sizeof(hdr), "%zx\r\n", chunkSize);
+			body.append(hdr).append(chunkSize, 'x').append("\r\n");
+		}
+		body.append("0\r\n\r\n");
+
+		std::size_t prevBytes = 0, curBytes = 0;
+		double prevNs = measureNs([&]{
+			for (int i = 0; i < repeat; i++) {
+				Stream s(std::make_unique<MemoryStream>(body, readSize));
+				prevBytes += referenceDecode(s);
+			}
+		});
+		double curNs = measureNs([&]{
+			for (int i = 0; i < repeat; i++) {
+				Stream s(std::make_unique<MemoryStream>(body, readSize));
+				curBytes += decode(s);
+			}
+		});
+		std::cout << "chunk=" << chunkSize
+				<< " previous " << prevBytes / prevNs * 1000.0 << " MB/s"
+				<< " current " << curBytes / curNs * 1000.0 << " MB/s" << std::endl;
+		if (prevBytes != curBytes || curBytes != bodySize * repeat) {
+			std::cerr << "Decoded " << curBytes << " bytes, previous decoder " << prevBytes << std::endl;
+			failed++;
+		}
+	}
+	return failed?1:0;
+}
@@ -0,0 +1,97 @@
+/*
+ * chunked_cork_test.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../socket.h"
+#include "../stream.h"
+
+using namespace userver;
+
+///Decodes chunked body, returns false when the framing is invalid or incomplete
+static bool decodeChunked(const std::string &enc, std::string &out) {
+	std::size_t pos = 0;
+	for(;;) {
+		std::size_t eol = enc.find("\r\n", pos);
+		if (eol == enc.npos) return false;
+		char *end;
+		std::size_t sz = std::strtoul(enc.c_str()+pos, &end, 16);
+		if (end != enc.c_str() + eol) return false;
+		pos = eol + 2;
+		if (sz == 0) return enc.compare(pos, std::string::npos, "\r\n") == 0;
+		if (pos + sz + 2 > enc.size() || enc.compare(pos + sz, 2, "\r\n") != 0) return false;
+		out.append(enc, pos, sz);
+		pos += sz + 2;
+	}
+}
+
+static std::string pattern(std::size_t sz, char c) {
+	std::string s;
+	for (std::size_t i = 0; i < sz; i++) s.push_back(static_cast<char>(c + i % 23));
+	return s;
+}
+
+///Writes parts to chunked stream inside of a cork scope, checks what arrives to the peer
+/**
+ * @param parts sizes of writes
+ * @param closeInScope close the stream inside of the scope
+ */
+static bool testCorked(std::initializer_list<std::size_t> parts, bool closeInScope) {
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) return false;
+	std::string wire;
+	std::thread rd([&]{
+		char buff[65536];
+		int r;
+		while ((r = ::read(fds[1], buff, sizeof(buff))) > 0) wire.append(buff, r);
+		::close(fds[1]);
+	});
+	std::string expected;
+	{
+		SocketStream sock(std::make_unique<Socket>(fds[0]));
+		Stream s(&sock, false);
+		{
+			Stream cs(std::make_unique<ChunkedStream<Stream &> >(s, true, false));
+			{
+				SocketStream::AutoCork cork;
+				char c = 'A';
+				for (auto sz: parts) {
+					std::string d = pattern(sz, c++);
+					cs.write(d);
+					expected.append(d);
+				}
+				if (closeInScope) cs.closeOutput();
+			}
+			cs.closeOutput();
+		}
+		s.closeOutput();
+	}
+	rd.join();
+	std::string body;
+	if (!decodeChunked(wire, body) || body != expected) {
+		std::cerr << "Corked chunked write failed: wire " << wire.size() << " bytes, decoded "
+				<< body.size() << " of " << expected.size() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	bool ok = true;
+	ok = testCorked({5000, 3000, 4}, false) && ok;
+	ok = testCorked({5000, 3000, 4}, true) && ok;
+	ok = testCorked({1, 2, 3, 100}, false) && ok;
+	ok = testCorked({4096, 1, 8192, 70000, 10}, false) && ok;
+	ok = testCorked({300000}, false) && ok;
+	return ok?EXIT_SUCCESS:EXIT_FAILURE;
+}
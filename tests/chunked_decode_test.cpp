@@ -0,0 +1,141 @@
+/*
+ * chunked_decode_test.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Test of the chunked decoder
+/**
+ * Valid bodies are decoded through read() and readAsync() with input split randomly,
+ * data following the body must stay in the source. Malformed framing must be reported by
+ * hasError() regardless of the splits. Random mutations of valid bodies must never
+ * produce more data than the input contains
+ */
+
+static const std::string after("GET /next HTTP/1.1\r\n\r\n");
+
+struct Result {
+	std::string data;
+	bool error;
+	std::string rest;
+};
+
+static Result decode(const std::string &input, std::vector<std::size_t> splits, bool async) {
+	MemoryStream *ms = new MemoryStream(input, std::move(splits));
+	Stream src(ms);
+	Result r;
+	{
+		ChunkedStream<Stream &> body(src, false, true);
+		if (async) {
+			bool done = false;
+			while (!done) {
+				body.readAsync([&](const std::string_view &data) {
+					if (data.empty()) done = true; else r.data.append(data);
+				});
+			}
+		} else {
+			for (auto b = body.read(); !b.empty(); b = body.read()) r.data.append(b);
+		}
+		r.error = body.hasError();
+	}
+	if (!r.error) {
+		for (auto b = src.readSync(); !b.empty(); b = src.readSync()) r.rest.append(b);
+	}
+	return r;
+}
+
+static std::vector<std::size_t> randomSplits(std::mt19937 &rng) {
+	std::vector<std::size_t> splits;
+	std::size_t maxSplit = rng() % 4 == 0?1:1 + rng() % 64;
+	for (int i = 0; i < 32; i++) splits.push_back(1 + rng() % maxSplit);
+	return splits;
+}
+
+static std::string encode(std::mt19937 &rng, const std::string &data) {
+	static const char *hex = "0123456789abcdef";
+	std::string out;
+	std::size_t pos = 0;
+	while (pos < data.size()) {
+		std::size_t sz = std::min<std::size_t>(data.size() - pos, 1 + rng() % 300);
+		std::string szhex;
+		for (std::size_t v = sz; v; v >>= 4) szhex.insert(szhex.begin(), hex[v & 0xF]);
+		if (rng() % 5 == 0) szhex.insert(0, "00");
+		out.append(szhex);
+		if (rng() % 6 == 0) out.append(";name=value");
+		out.append("\r\n").append(data, pos, sz).append("\r\n");
+		pos += sz;
+	}
+	out.append("0");
+	if (rng() % 6 == 0) out.append(" ;last");
+	out.append("\r\n");
+	if (rng() % 4 == 0) out.append("X-Checksum: 1234\r\n");
+	out.append("\r\n");
+	return out;
+}
+
+int main() {
+	std::mt19937 rng(1);
+	int failed = 0;
+	auto fail = [&](const char *what, const std::string &input) {
+		if (failed++ < 10) std::cerr << what << ": " << input.substr(0, 200) << std::endl;
+	};
+
+	for (int iter = 0; iter < 2000; iter++) {
+		std::string data;
+		std::size_t len = rng() % 2000;
+		for (std::size_t i = 0; i < len; i++) data.push_back(static_cast<char>(rng()));
+		std::string input = encode(rng, data);
+		auto r = decode(input + after, randomSplits(rng), iter & 1);
+		if (r.error || r.data != data || r.rest != after) fail("valid body", input);
+
+		//random mutation must not read beyond the input
+		std::string m = input;
+		m[rng() % m.size()] = "\r\n;0Zx "[rng() % 7];
+		r = decode(m, randomSplits(rng), iter & 1);
+		if (r.data.size() + r.rest.size() > m.size()) fail("mutated body", m);
+
+		//truncated body is an error
+		r = decode(input.substr(0, rng() % input.size()), randomSplits(rng), iter & 1);
+		if (!r.error) fail("truncated body", input);
+	}
+
+	const char *malformed[] = {
+			"5\nhello\r\n0\r\n\r\n",				//bare LF after size
+			"5;ext\nhello\r\n0\r\n\r\n",			//bare LF after extension
+			"5\r\nhello\n0\r\n\r\n",				//bare LF after data
+			"5\r\nhello\r\n0\r\n\n",				//bare LF at end
+			"5\r\nhello\r\n0\n\r\n",				//bare LF after last size
+			"5\r\nhello\r\n0\r\nX: 1\n\r\n",		//bare LF after trailer
+			"5\r\nhello\r\r\n0\r\n\r\n",			//extra CR
+			"5\r\nhelloXX\r\n0\r\n\r\n",			//data longer than size
+			"5\r\nhel\r\n0\r\n\r\n",				//data shorter than size
+			"\r\n5\r\nhello\r\n0\r\n\r\n",			//empty size line
+			"g\r\nhello\r\n0\r\n\r\n",				//invalid digit
+			"-5\r\nhello\r\n0\r\n\r\n",				//negative size
+			"10000000000000000\r\nhello\r\n0\r\n\r\n",	//size overflow
+			"5\rhello\r\n0\r\n\r\n",				//CR without LF
+	};
+	for (const char *m: malformed) {
+		for (int i = 0; i < 20; i++) {
+			auto r = decode(m, randomSplits(rng), i & 1);
+			if (!r.error) fail("malformed body accepted", m);
+		}
+	}
+
+	if (failed) {
+		std::cerr << failed << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "OK" << std::endl;
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * compress_headers_test.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <iostream>
+#include <string>
+
+#include "../http_server.h"
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Test of headers of compressed responses
+/**
+ * Strong ETag of a compressed response must be sent as weak, because the compressed
+ * content is not byte-identical with the content tagged by the handler. Response to HEAD
+ * must contain the same Content-Encoding, Vary and Content-Length as the response to GET,
+ * but no body
+ */
+
+struct Response {
+	std::string header;
+	std::string body;
+
+	bool has(const std::string &line) const {
+		return header.find("\r\n" + line + "\r\n") != header.npos;
+	}
+};
+
+///Processes the request, the handler sets ETag and sends the content
+static Response process(const std::string &method, const std::string &etag, bool stream) {
+	const std::string content(10000, 'x');
+	const std::string input = method + " /a HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n";
+	MemoryStream *ms = new MemoryStream(input);
+	Stream conn(ms);
+	{
+		HttpServerRequest req;
+		if (req.init(conn.makeReference())) {
+			req.setCompression(true);
+			req.setContentType("text/plain");
+			if (!etag.empty()) req.set("ETag", etag);
+			if (stream) {
+				Stream s = req.send();
+				s.write(content);
+				s.closeOutput();
+			} else {
+				req.send(content);
+			}
+		}
+	}
+	Response r;
+	auto sep = ms->output.find("\r\n\r\n");
+	if (sep != ms->output.npos) {
+		r.header = ms->output.substr(0, sep + 2);
+		r.body = ms->output.substr(sep + 4);
+	}
+	return r;
+}
+
+int main() {
+	int failed = 0;
+	auto check = [&](const char *name, bool cond) {
+		if (!cond) {
+			std::cerr << "Failed: " << name << std::endl;
+			failed++;
+		}
+	};
+
+	for (bool stream: {false, true}) {
+		Response r = process("GET", "\"abc\"", stream);
+		check(stream?"stream: strong ETag weakened":"strong ETag weakened",
+				r.has("Content-Encoding: gzip") && r.has("ETag: W/\"abc\"") && !r.body.empty());
+
+		r = process("GET", "W/\"abc\"", stream);
+		check(stream?"stream: weak ETag kept":"weak ETag kept", r.has("ETag: W/\"abc\"") && r.header.find("W/W/") == r.header.npos);
+
+		r = process("GET", "", stream);
+		check(stream?"stream: no ETag":"no ETag", r.has("Content-Encoding: gzip") && r.header.find("ETag") == r.header.npos);
+
+		Response get = process("GET", "\"abc\"", stream);
+		Response head = process("HEAD", "\"abc\"", stream);
+		check(stream?"stream: HEAD negotiated":"HEAD negotiated", head.has("Content-Encoding: gzip") && head.has("Vary: Accept-Encoding")
+				&& head.has("ETag: W/\"abc\"") && head.body.empty());
+		if (!stream) {
+			auto pos = get.header.find("Content-Length: ");
+			std::string getLength = get.header.substr(pos, get.header.find("\r\n", pos) - pos);
+			check("HEAD has length of GET", pos != get.header.npos && head.has(getLength));
+		}
+	}
+
+	if (failed) {
+		std::cerr << failed << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "OK" << std::endl;
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * dgram_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "../dgramsocket.h"
+#include "../netaddr.h"
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Benchmark of sending datagrams
+/**
+ * Sends datagrams over loopback by send() (one system call per datagram), by
+ * queue() and flushQueue() (sendmmsg) and by flushQueue() with GSO enabled. Received
+ * datagrams are read by recvBatch() in the same thread after each batch. Reports
+ * datagrams per second.
+ *
+ * Usage: dgram_bench [count of datagrams] [size of datagram]
+ */
+
+int main(int argc, char **argv) {
+	std::size_t count = argc > 1?std::strtoul(argv[1], nullptr, 10):200000;
+	std::size_t size = argc > 2?std::strtoul(argv[2], nullptr, 10):1200;
+	constexpr unsigned int batch = 64;
+
+	NetAddr target = NetAddr::fromString("127.0.0.1", std::to_string(20000 + getpid() % 20000))[0];
+	DGramSocket rx(target);
+	rx.setRecvBatch(batch, std::max<std::size_t>(size, 2048), true);
+
+	const std::string data(size, 'x');
+	int failed = 0;
+
+	auto run = [&](const char *name, auto &&sendBatch) {
+		DGramSocket tx(NetAddr::fromString("127.0.0.1", "0")[0]);
+		std::size_t sent = 0, received = 0;
+		double ns = measureNs([&]{
+			while (sent < count) {
+				sent += sendBatch(tx, std::min<std::size_t>(batch, count - sent));
+				for (unsigned int c = rx.recvBatch(0); c; c = rx.recvBatch(0)) received += c;
+			}
+			for (unsigned int c = rx.recvBatch(100); c; c = rx.recvBatch(100)) received += c;
+		});
+		std::cout << name << " " << sent / ns * 1e9 << " pps, sent " << sent << " received " << received << std::endl;
+		if (sent != count) {
+			std::cerr << name << ": sent " << sent << " datagrams, expected " << count
+					<< ", error " << tx.getLastError() << std::endl;
+			failed++;
+		}
+	};
+
+	run("send()        ", [&](DGramSocket &tx, std::size_t n) {
+		for (std::size_t i = 0; i < n; i++) tx.send(data, target);
+		return n;
+	});
+	run("flushQueue()  ", [&](DGramSocket &tx, std::size_t n) {
+		for (std::size_t i = 0; i < n; i++) tx.queue(data, target);
+		return tx.flushQueue();
+	});
+	run("flushQueue+GSO", [&](DGramSocket &tx, std::size_t n) {
+		tx.enableGSO();
+		for (std::size_t i = 0; i < n; i++) tx.queue(data, target);
+		return tx.flushQueue();
+	});
+	return failed?1:0;
+}
@@ -0,0 +1,215 @@
+/*
+ * header_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../http_server.h"
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Benchmark of the request header parser
+/**
+ * Reads and parses header blocks of pipelined requests by HttpServerRequest and by
+ * the previous parser, which scanned the input byte by byte, copied the first line
+ * to a separate buffer and looked up all headers in a sorted vector. Input is returned
+ * by parts of given size, as the socket would return it.
+ *
+ * Usage: header_bench [read size] [count of requests]
+ */
+
+///Previous parser of the request header
+struct ReferenceParser {
+	std::vector<char> inHeaderData;
+	std::vector<char> firstLine;
+	std::vector<std::pair<std::string_view, std::string_view> > inHeader;
+	std::string_view method, path, httpver;
+
+	bool readHeader(std::string_view &buff, int &m) {
+		int pos = 0;
+		for (char c: buff) {
+			switch (m) {
+			case 0: if (c == '\r') {
+						++m;
+					} else {
+						inHeaderData.push_back(c);
+					} break;
+			case 1: if (c == '\n') {
+						++m;
+					} else {
+						inHeaderData.push_back('\r');
+						if (c == '\r') {
+							m = 1;
+						} else {
+							m = 0;
+							inHeaderData.push_back(c);
+						}
+					} break;
+			case 2: if (c == '\r') {
+						++m;
+					} else  {
+						inHeaderData.push_back('\r');
+						inHeaderData.push_back('\n');
+						inHeaderData.push_back(c);
+						m = 0;
+					} break;
+			case 3: if (c == '\n') {
+						pos++;
+						buff = buff.substr(pos);
+						return true;
+					} else {
+						inHeaderData.push_back('\r');
+						inHeaderData.push_back('\n');
+						inHeaderData.push_back('\r');
+						if (c == '\r') {
+							m = 1;
+						} else {
+							m = 0;
+							inHeaderData.push_back(c);
+						}
+					} break;
+			}
+			pos++;
+		}
+		return false;
+	}
+
+	bool readHeader(Stream &s) {
+		int m = 0;
+		std::string_view buf = s.readSync();
+		while (!buf.empty()) {
+			if (readHeader(buf, m)) {
+				s.putBack(buf);
+				return true;
+			}
+			buf = s.readSync();
+		}
+		return false;
+	}
+
+	bool parseFirstLine(std::string_view &v) {
+		std::string_view fl;
+		do {
+			if (v.empty()) return false;
+			fl = splitAt("\r\n", v);
+		} while (fl.empty());
+		auto x = fl.find(' ');
+		if (x == fl.npos) return false;
+		auto y = fl.find(' ',x+1);
+		if (y == fl.npos) return false;
+		std::copy(fl.begin(), fl.end(), std::back_inserter(firstLine));
+		for (std::size_t i = 0; i < x; i++) firstLine[i] = std::toupper(firstLine[i]);
+		for (std::size_t i = y, cnt = firstLine.size(); i < cnt; i++) firstLine[i] = std::toupper(firstLine[i]);
+		method = std::string_view(firstLine.data(), x);
+		path = std::string_view(firstLine.data()+x+1, y - x - 1);
+		httpver = std::string_view(firstLine.data()+y+1, firstLine.size() - y - 1);
+		return true;
+	}
+
+	bool parseHeaders(std::string_view &dt) {
+		while (!dt.empty()) {
+			auto ln = splitAt("\r\n", dt);
+			auto key = splitAt(":", ln);
+			auto value = ln;
+			trim(key);
+			trim(value);
+			inHeader.push_back(std::pair(key,value));
+		}
+		std::sort(inHeader.begin(), inHeader.end(), HeaderValue::lessHeader);
+		return true;
+	}
+
+	bool parse(Stream &s) {
+		inHeaderData.clear();
+		firstLine.clear();
+		inHeader.clear();
+		if (!readHeader(s)) return false;
+		std::string_view v(inHeaderData.data(), inHeaderData.size());
+		return parseFirstLine(v) && parseHeaders(v);
+	}
+};
+
+///Runs the header parser of HttpServerRequest without processing the request
+class ParsedRequest: public HttpServerRequest {
+public:
+	bool parse(Stream &s) {
+		stream = s.makeReference();
+		bool r = readHeader() && HttpServerRequest::parse();
+		//no response is sent
+		stream = Stream();
+		return r;
+	}
+	std::size_t countHeaders() const {
+		std::size_t n = 0;
+		forEachHeader([&](std::string_view, std::string_view) {n++;});
+		return n;
+	}
+};
+
+int main(int argc, char **argv) {
+	std::size_t readSize = argc > 1?std::strtoul(argv[1], nullptr, 10):16384;
+	std::size_t count = argc > 2?std::strtoul(argv[2], nullptr, 10):200000;
+	const std::string request =
+			"GET /api/v1/items?id=12345&sort=desc HTTP/1.1\r\n"
+			"Host: example.com\r\n"
+			"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+			"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+			"Accept-Language: en-US,en;q=0.5\r\n"
+			"Accept-Encoding: gzip, deflate, br\r\n"
+			"Connection: keep-alive\r\n"
+			"Cookie: session=abcdef0123456789; theme=dark\r\n"
+			"Cache-Control: max-age=0\r\n"
+			"X-Request-Id: 9f2c4d1e-0a7b-4c55-8e3a-1f2b3c4d5e6f\r\n"
+			"\r\n";
+	constexpr std::size_t headers = 9;
+	std::string input;
+	for (std::size_t i = 0; i < count; i++) input.append(request);
+
+	auto report = [&](const char *name, double ns) {
+		std::cout << name << " " << ns / count << " ns/request "
+				<< count * headers / ns * 1000.0 << " Mheaders/s "
+				<< input.size() / ns * 1000.0 << " MB/s" << std::endl;
+	};
+
+	int failed = 0;
+	std::size_t parsed = 0, found = 0;
+	double ns = measureNs([&]{
+		Stream s(std::make_unique<MemoryStream>(input, readSize));
+		ReferenceParser p;
+		while (p.parse(s)) {
+			parsed++;
+			found += p.inHeader.size();
+		}
+	});
+	report("previous", ns);
+	if (parsed != count || found != count * headers) {
+		std::cerr << "Previous parser: " << parsed << " requests " << found << " headers" << std::endl;
+		failed++;
+	}
+
+	parsed = found = 0;
+	ns = measureNs([&]{
+		Stream s(std::make_unique<MemoryStream>(input, readSize));
+		for (;;) {
+			ParsedRequest req;
+			if (!req.parse(s)) break;
+			parsed++;
+			found += req.countHeaders();
+		}
+	});
+	report("current ", ns);
+	if (parsed != count || found != count * headers) {
+		std::cerr << "Current parser: " << parsed << " requests " << found << " headers" << std::endl;
+		failed++;
+	}
+	return failed?1:0;
+}
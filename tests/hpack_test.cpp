@@ -0,0 +1,231 @@
+/*
+ * hpack_test.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../hpack.h"
+
+using namespace userver;
+
+///Test of the HPACK decoder and encoder
+/**
+ * Decodes examples of RFC 7541 Appendix C and checks the decoded headers and the
+ * content of the dynamic table after each block. Checks Huffman padding and EOS
+ * rejection, dynamic table size updates and round trip of the encoder
+ */
+
+///Decoder with access to the dynamic table
+class TableDecoder: public HPackDecoder {
+public:
+	using HPackDecoder::HPackDecoder;
+	using Table = std::vector<std::pair<std::string, std::string> >;
+
+	Table table() const {return Table(dynTable.begin(), dynTable.end());}
+	std::size_t tableSize() const {return dynSize;}
+};
+
+using HeaderList = HPackDecoder::HeaderList;
+using Table = TableDecoder::Table;
+
+static std::string fromHex(std::string_view hex) {
+	std::string out;
+	int acc = -1;
+	for (char c: hex) {
+		int v;
+		if (c >= '0' && c <= '9') v = c - '0';
+		else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+		else continue;
+		if (acc < 0) {
+			acc = v;
+		} else {
+			out.push_back(static_cast<char>(acc << 4 | v));
+			acc = -1;
+		}
+	}
+	return out;
+}
+
+static int failed = 0;
+
+static void check(const char *name, bool cond) {
+	if (!cond) {
+		std::cerr << "Failed: " << name << std::endl;
+		failed++;
+	}
+}
+
+///Decodes the block and compares headers and the dynamic table
+static void checkBlock(const char *name, TableDecoder &d, std::string_view hex, const HeaderList &expected,
+		const Table &table, std::size_t tableSize) {
+	HeaderList out;
+	bool ok = d.decode(fromHex(hex), out);
+	check(name, ok && out == expected && d.table() == table && d.tableSize() == tableSize);
+	if (ok && out != expected) {
+		for (const auto &[n, v]: out) std::cerr << "  " << n << ": " << v << std::endl;
+	}
+}
+
+static bool decodes(TableDecoder &d, std::string_view hex, HeaderList &out) {
+	return d.decode(fromHex(hex), out);
+}
+
+static bool huffman(std::string_view hex, std::string &out) {
+	out.clear();
+	return huffmanDecode(fromHex(hex), out);
+}
+
+int main() {
+	const std::pair<std::string, std::string> authority(":authority", "www.example.com");
+	const std::pair<std::string, std::string> cacheControl("cache-control", "no-cache");
+	const std::pair<std::string, std::string> customKey("custom-key", "custom-value");
+	const HeaderList req1 = {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, authority};
+	const HeaderList req2 = {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, authority, cacheControl};
+	const HeaderList req3 = {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, authority, customKey};
+
+	//C.2 header field representations
+	{
+		TableDecoder d;
+		checkBlock("C.2.1 literal with indexing", d, "400a637573746f6d2d6b65790d637573746f6d2d686561646572",
+				{{"custom-key", "custom-header"}}, {{"custom-key", "custom-header"}}, 55);
+	}
+	{
+		TableDecoder d;
+		checkBlock("C.2.2 literal without indexing", d, "040c2f73616d706c652f70617468",
+				{{":path", "/sample/path"}}, {}, 0);
+	}
+	{
+		TableDecoder d;
+		checkBlock("C.2.3 literal never indexed", d, "100870617373776f726406736563726574",
+				{{"password", "secret"}}, {}, 0);
+	}
+	{
+		TableDecoder d;
+		checkBlock("C.2.4 indexed", d, "82", {{":method", "GET"}}, {}, 0);
+	}
+
+	//C.3 requests without Huffman, C.4 the same requests with Huffman
+	for (bool huff: {false, true}) {
+		TableDecoder d;
+		checkBlock(huff?"C.4.1":"C.3.1", d,
+				huff?"828684418cf1e3c2e5f23a6ba0ab90f4ff":"828684410f7777772e6578616d706c652e636f6d",
+				req1, {authority}, 57);
+		checkBlock(huff?"C.4.2":"C.3.2", d,
+				huff?"828684be5886a8eb10649cbf":"828684be58086e6f2d6361636865",
+				req2, {cacheControl, authority}, 110);
+		checkBlock(huff?"C.4.3":"C.3.3", d,
+				huff?"828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"
+					:"828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565",
+				req3, {customKey, cacheControl, authority}, 164);
+
+		//size update evicts the oldest entry
+		HeaderList out;
+		checkBlock("size update evicts", d, "3f4fbf", {cacheControl}, {customKey, cacheControl}, 107);
+		check("evicted entry not available", !decodes(d, "c0", out));
+	}
+
+	//C.5 responses without Huffman, C.6 the same responses with Huffman, entries are evicted
+	const std::pair<std::string, std::string> cacheControlPrivate("cache-control", "private");
+	const std::pair<std::string, std::string> date1("date", "Mon, 21 Oct 2013 20:13:21 GMT");
+	const std::pair<std::string, std::string> date2("date", "Mon, 21 Oct 2013 20:13:22 GMT");
+	const std::pair<std::string, std::string> location("location", "https://www.example.com");
+	const std::pair<std::string, std::string> gzip("content-encoding", "gzip");
+	const std::pair<std::string, std::string> cookie("set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1");
+	for (bool huff: {false, true}) {
+		TableDecoder d(256);
+		checkBlock(huff?"C.6.1":"C.5.1", d,
+				huff?"488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e919d29ad171863c78f0b97c8e9ae82ae43d3"
+					:"4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d546e1768747470733a2f2f7777772e6578616d706c652e636f6d",
+				{{":status", "302"}, cacheControlPrivate, date1, location},
+				{location, date1, cacheControlPrivate, {":status", "302"}}, 222);
+		checkBlock(huff?"C.6.2":"C.5.2", d,
+				huff?"4883640effc1c0bf":"4803333037c1c0bf",
+				{{":status", "307"}, cacheControlPrivate, date1, location},
+				{{":status", "307"}, location, date1, cacheControlPrivate}, 222);
+		checkBlock(huff?"C.6.3":"C.5.3", d,
+				huff?"88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065c003ed4ee5b1063d5007"
+					:"88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a69707738666f6f3d4153444a4b48514b425a584f5157454f50495541585157454f49553b206d61782d6167653d333630303b2076657273696f6e3d31",
+				{{":status", "200"}, cacheControlPrivate, date2, location, gzip, cookie},
+				{cookie, gzip, date2}, 215);
+	}
+
+	//dynamic table size updates
+	{
+		TableDecoder d;
+		HeaderList out;
+		check("size update to limit", decodes(d, "3fe11f", out) && out.empty());
+		check("size update above limit rejected", !decodes(d, "3fe21f", out));
+	}
+	{
+		TableDecoder d;
+		HeaderList out;
+		check("size update after field rejected", !decodes(d, "8220", out));
+	}
+	{
+		TableDecoder d;
+		HeaderList out;
+		decodes(d, "400a637573746f6d2d6b65790d637573746f6d2d686561646572", out);
+		check("size update to zero empties table", decodes(d, "20", out) && d.table().empty() && d.tableSize() == 0);
+		check("entry not inserted to empty table", decodes(d, "400a637573746f6d2d6b65790d637573746f6d2d686561646572", out)
+				&& out.size() == 1 && d.table().empty());
+		check("size update can increase up to limit", decodes(d, "3f4d", out) && d.table().empty());
+		check("entry inserted after increase", decodes(d, "400a637573746f6d2d6b65790d637573746f6d2d686561646572", out)
+				&& d.tableSize() == 55);
+		check("entry larger than table evicts all", decodes(d, "3f15", out)
+				&& decodes(d, "400a637573746f6d2d6b65790d637573746f6d2d686561646572", out) && d.table().empty());
+	}
+	{
+		TableDecoder d;
+		HeaderList out;
+		check("invalid index rejected", !decodes(d, "be", out));
+		check("zero index rejected", !decodes(d, "80", out));
+		check("truncated string rejected", !decodes(d, "400a637573746f6d", out));
+		check("truncated integer rejected", !decodes(d, "3fe1", out));
+		check("header list limit", !d.decode(fromHex("828684"), out, 80) && d.decode(fromHex("828684"), out, 200));
+	}
+
+	//Huffman padding and EOS
+	std::string s;
+	check("huffman valid", huffman("f1e3c2e5f23a6ba0ab90f4ff", s) && s == "www.example.com");
+	check("huffman padding by ones", huffman("1f", s) && s == "a");
+	check("huffman padding by zeros rejected", !huffman("18", s));
+	check("huffman padding of 8 bits rejected", !huffman("1fff", s));
+	check("huffman padding longer than 7 bits rejected", !huffman("f1e3c2e5f23a6ba0ab90f4ffff", s));
+	check("huffman EOS rejected", !huffman("ffffffff", s));
+	check("huffman EOS after symbol rejected", !huffman("1fffffffff", s));
+	check("huffman empty", huffman("", s) && s.empty());
+	{
+		TableDecoder d;
+		HeaderList out;
+		check("huffman literal with invalid padding rejected", !decodes(d, "0481f0", out));
+		check("huffman literal with EOS rejected", !decodes(d, "0484ffffffff", out));
+	}
+
+	//encoder round trip
+	{
+		std::vector<char> block;
+		HPackEncoder::encodeStatus(200, block);
+		HPackEncoder::encodeStatus(302, block);
+		HPackEncoder::encodeHeader("content-type", "text/plain", block);
+		HPackEncoder::encodeHeader("x-custom", std::string(300, 'a'), block);
+		TableDecoder d;
+		HeaderList out;
+		check("encoder round trip", d.decode(std::string_view(block.data(), block.size()), out)
+				&& out == HeaderList{{":status", "200"}, {":status", "302"}, {"content-type", "text/plain"},
+					{"x-custom", std::string(300, 'a')}}
+				&& d.table().empty());
+	}
+
+	if (failed) {
+		std::cerr << failed << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "OK" << std::endl;
+	return 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * http2_frame_test.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../http2_server.h"
+#include "../init.h"
+#include "../socket.h"
+
+using namespace userver;
+
+///Frame level test of Http2Connection
+/**
+ * The connection runs over a socketpair, the test acts as the client and sends raw frames.
+ * Checks the connection preface, header blocks split by CONTINUATION and interleaved with
+ * other frames, overflow of the flow control window and refusing of streams above
+ * the limit of concurrent streams
+ */
+
+namespace frame {
+	constexpr unsigned int data = 0;
+	constexpr unsigned int headers = 1;
+	constexpr unsigned int rst_stream = 3;
+	constexpr unsigned int settings = 4;
+	constexpr unsigned int ping = 6;
+	constexpr unsigned int goaway = 7;
+	constexpr unsigned int window_update = 8;
+	constexpr unsigned int continuation = 9;
+}
+
+namespace flag {
+	constexpr unsigned int end_stream = 0x1;
+	constexpr unsigned int ack = 0x1;
+	constexpr unsigned int end_headers = 0x4;
+}
+
+static const std::string preface("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+
+static std::uint32_t getU32(const char *p) {
+	const unsigned char *c = reinterpret_cast<const unsigned char *>(p);
+	return (static_cast<std::uint32_t>(c[0]) << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+}
+
+static std::string u32(std::uint32_t v) {
+	char buff[4] = {static_cast<char>(v >> 24), static_cast<char>(v >> 16), static_cast<char>(v >> 8), static_cast<char>(v)};
+	return std::string(buff, 4);
+}
+
+struct Frame {
+	unsigned int type = 0;
+	unsigned int flags = 0;
+	std::uint32_t id = 0;
+	std::string payload;
+
+	///Error code of RST_STREAM or GOAWAY
+	Http2Error error() const {
+		std::size_t ofs = type == frame::goaway?4:0;
+		return payload.size() >= ofs + 4?static_cast<Http2Error>(getU32(payload.data() + ofs)):Http2Error::no_error;
+	}
+};
+
+///Streams dispatched by the connection
+struct Dispatched {
+	std::mutex mx;
+	std::condition_variable cond;
+	std::deque<Stream> streams;
+
+	///Waits for a new stream
+	bool wait(std::size_t count) {
+		std::unique_lock lk(mx);
+		return cond.wait_for(lk, std::chrono::seconds(2), [&]{return streams.size() >= count;});
+	}
+	std::size_t count() {
+		std::lock_guard _(mx);
+		return streams.size();
+	}
+};
+
+///Client side of the connection
+class Client {
+public:
+	Client(AsyncProvider provider):dispatched(std::make_shared<Dispatched>()) {
+		int sv[2];
+		socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+		fd = sv[1];
+		fcntl(sv[0], F_SETFL, O_NONBLOCK);
+		conn = std::make_shared<Http2Connection>(Stream(std::make_unique<SocketStream>(std::make_unique<Socket>(sv[0]))),
+				provider, 5000, [d = dispatched](Stream &&s) {
+			std::lock_guard _(d->mx);
+			d->streams.push_back(std::move(s));
+			d->cond.notify_all();
+		});
+		provider.runAsync([conn = conn]{
+			Http2Connection::start(conn);
+		});
+	}
+	~Client() {
+		close(fd);
+		conn = nullptr;
+		//streams can be destroyed once the connection is closed
+		std::lock_guard _(dispatched->mx);
+		dispatched->streams.clear();
+	}
+
+	void sendRaw(const std::string &data) {
+		::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+	}
+
+	void send(unsigned int type, unsigned int flags, std::uint32_t id, const std::string &payload) {
+		std::string f = u32(static_cast<std::uint32_t>(payload.size() << 8 | type));
+		f.push_back(static_cast<char>(flags));
+		f.append(u32(id)).append(payload);
+		sendRaw(f);
+	}
+
+	///Reads next frame
+	/**
+	 * @retval false connection closed or timeout
+	 */
+	bool read(Frame &f) {
+		while (inbuff.size() < 9 || inbuff.size() < 9 + (getU32(inbuff.data()) >> 8)) {
+			pollfd pfd = {fd, POLLIN, 0};
+			if (poll(&pfd, 1, 2000) <= 0) return false;
+			char buff[16384];
+			auto r = ::recv(fd, buff, sizeof(buff), 0);
+			if (r <= 0) return false;
+			inbuff.append(buff, r);
+		}
+		std::uint32_t len = getU32(inbuff.data()) >> 8;
+		f.type = static_cast<unsigned char>(inbuff[3]);
+		f.flags = static_cast<unsigned char>(inbuff[4]);
+		f.id = getU32(inbuff.data() + 5) & 0x7FFFFFFF;
+		f.payload = inbuff.substr(9, len);
+		inbuff.erase(0, 9 + len);
+		return true;
+	}
+
+	///Reads frames until frame of given type is received
+	bool waitFor(unsigned int type, Frame &f) {
+		while (read(f)) {
+			if (f.type == type) return true;
+		}
+		return false;
+	}
+
+	///Determines whether the connection is closed by the server (frames before end are skipped)
+	bool closed() {
+		Frame f;
+		while (read(f)) {}
+		pollfd pfd = {fd, POLLIN, 0};
+		char c;
+		return poll(&pfd, 1, 0) == 1 && ::recv(fd, &c, 1, 0) == 0;
+	}
+
+	///Sends preface and empty SETTINGS, waits for SETTINGS of the server and for the ACK
+	bool handshake(Frame &settings) {
+		sendRaw(preface);
+		send(frame::settings, 0, 0, std::string());
+		bool hasSettings = false;
+		Frame f;
+		while (read(f)) {
+			if (f.type == frame::settings) {
+				if (f.flags & flag::ack) return hasSettings;
+				settings = f;
+				hasSettings = true;
+				send(frame::settings, flag::ack, 0, std::string());
+			}
+		}
+		return false;
+	}
+	bool handshake() {
+		Frame f;
+		return handshake(f);
+	}
+
+	///Sends PING and waits for the ACK (connection is alive)
+	bool ping() {
+		send(frame::ping, 0, 0, "12345678");
+		Frame f;
+		while (waitFor(frame::ping, f)) {
+			if (f.flags & flag::ack) return f.payload == "12345678";
+		}
+		return false;
+	}
+
+	std::shared_ptr<Http2Connection> conn;
+	std::shared_ptr<Dispatched> dispatched;
+	int fd;
+	std::string inbuff;
+};
+
+static std::string requestBlock(std::string_view path) {
+	std::vector<char> block;
+	HPackEncoder::encodeHeader(":method", "GET", block);
+	HPackEncoder::encodeHeader(":scheme", "http", block);
+	HPackEncoder::encodeHeader(":path", path, block);
+	HPackEncoder::encodeHeader(":authority", "localhost", block);
+	return std::string(block.data(), block.size());
+}
+
+///Reads the request header from the dispatched stream
+static std::string readRequest(Stream &s) {
+	std::string req;
+	while (req.find("\r\n\r\n") == req.npos) {
+		std::string_view d = s.readSync();
+		if (d.empty()) break;
+		req.append(d);
+	}
+	return req.substr(0, req.find("\r\n"));
+}
+
+int main() {
+	initNetwork();
+	AsyncProvider provider = createAsyncProvider({1,2});
+	setCurrentAsyncProvider(provider);
+	int failed = 0;
+	auto check = [&](const char *name, bool cond) {
+		if (!cond) {
+			std::cerr << "Failed: " << name << std::endl;
+			failed++;
+		}
+	};
+	Frame f;
+
+	{
+		Client c(provider);
+		Frame settings;
+		bool ok = c.handshake(settings);
+		bool hasLimit = false;
+		for (std::size_t i = 0; i + 6 <= settings.payload.size(); i += 6) {
+			if (settings.payload[i+1] == 3) hasLimit = getU32(settings.payload.data() + i + 2) == Http2Connection::maxConcurrentStreams;
+		}
+		check("preface and settings", ok && hasLimit);
+		check("ping", c.ping());
+	}
+	{
+		Client c(provider);
+		c.sendRaw("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+		check("invalid preface", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error && c.closed());
+	}
+	{
+		Client c(provider);
+		c.sendRaw(preface);
+		c.send(frame::ping, 0, 0, "12345678");
+		check("first frame not settings", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error && c.closed());
+	}
+
+	//header block split to CONTINUATION frames
+	{
+		Client c(provider);
+		c.handshake();
+		std::string block = requestBlock("/split");
+		c.send(frame::headers, flag::end_stream, 1, block.substr(0, 5));
+		c.send(frame::continuation, 0, 1, block.substr(5, 5));
+		c.send(frame::continuation, flag::end_headers, 1, block.substr(10));
+		bool ok = c.dispatched->wait(1);
+		check("continuation dispatched", ok);
+		if (ok) {
+			Stream &s = c.dispatched->streams[0];
+			check("continuation request", readRequest(s) == "GET /split HTTP/1.1");
+			s.write("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+			s.flush();
+			check("response headers", c.waitFor(frame::headers, f) && f.id == 1);
+			check("response data", c.waitFor(frame::data, f) && f.id == 1 && f.payload == "ok" && (f.flags & flag::end_stream));
+		}
+	}
+	{
+		Client c(provider);
+		c.handshake();
+		std::string block = requestBlock("/a");
+		c.send(frame::headers, flag::end_stream, 1, block.substr(0, 5));
+		c.send(frame::headers, flag::end_stream | flag::end_headers, 3, block);
+		check("headers interleaved in header block", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error
+				&& c.closed() && c.dispatched->count() == 0);
+	}
+	{
+		Client c(provider);
+		c.handshake();
+		std::string block = requestBlock("/a");
+		c.send(frame::headers, flag::end_stream, 1, block.substr(0, 5));
+		c.send(frame::continuation, flag::end_headers, 3, block.substr(5));
+		check("continuation of other stream", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error && c.closed());
+	}
+	{
+		Client c(provider);
+		c.handshake();
+		std::string block = requestBlock("/a");
+		c.send(frame::headers, flag::end_stream, 1, block.substr(0, 5));
+		c.send(frame::ping, 0, 0, "12345678");
+		c.send(frame::continuation, flag::end_headers, 1, block.substr(5));
+		check("ping interleaved in header block", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error && c.closed());
+	}
+	{
+		Client c(provider);
+		c.handshake();
+		c.send(frame::continuation, flag::end_headers, 1, requestBlock("/a"));
+		check("continuation without headers", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error && c.closed());
+	}
+
+	//flow control window overflow
+	{
+		Client c(provider);
+		c.handshake();
+		c.send(frame::window_update, 0, 0, u32(0x7FFFFFFF));
+		check("connection window overflow", c.waitFor(frame::goaway, f) && f.error() == Http2Error::flow_control_error && c.closed());
+	}
+	{
+		Client c(provider);
+		c.handshake();
+		c.send(frame::window_update, 0, 0, u32(0));
+		check("connection window zero increment", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error);
+	}
+	{
+		Client c(provider);
+		c.handshake();
+		c.send(frame::headers, flag::end_stream | flag::end_headers, 1, requestBlock("/a"));
+		c.send(frame::headers, flag::end_stream | flag::end_headers, 3, requestBlock("/b"));
+		check("streams dispatched", c.dispatched->wait(2));
+		c.send(frame::window_update, 0, 1, u32(0x7FFFFFFF));
+		check("stream window overflow", c.waitFor(frame::rst_stream, f) && f.id == 1 && f.error() == Http2Error::flow_control_error);
+		c.send(frame::window_update, 0, 3, u32(0));
+		check("stream window zero increment", c.waitFor(frame::rst_stream, f) && f.id == 3 && f.error() == Http2Error::protocol_error);
+		check("connection alive after stream errors", c.ping());
+	}
+
+	//limit of concurrent streams
+	{
+		std::uint32_t prevLimit = Http2Connection::maxConcurrentStreams;
+		Http2Connection::maxConcurrentStreams = 2;
+		Client c(provider);
+		c.handshake();
+		c.send(frame::headers, flag::end_stream | flag::end_headers, 1, requestBlock("/a"));
+		c.send(frame::headers, flag::end_stream | flag::end_headers, 3, requestBlock("/b"));
+		check("streams below limit dispatched", c.dispatched->wait(2));
+		c.send(frame::headers, flag::end_stream | flag::end_headers, 5, requestBlock("/c"));
+		check("stream above limit refused", c.waitFor(frame::rst_stream, f) && f.id == 5 && f.error() == Http2Error::refused_stream
+				&& c.dispatched->count() == 2);
+		//client cancels the stream 1, the handler finishes it
+		c.send(frame::rst_stream, 0, 1, u32(static_cast<std::uint32_t>(Http2Error::cancel)));
+		check("connection alive after reset", c.ping());
+		{
+			std::lock_guard _(c.dispatched->mx);
+			c.dispatched->streams.pop_front();
+		}
+		c.send(frame::headers, flag::end_stream | flag::end_headers, 7, requestBlock("/d"));
+		check("stream accepted after reset", c.dispatched->wait(2) && readRequest(c.dispatched->streams[1]) == "GET /d HTTP/1.1");
+		c.send(frame::rst_stream, 0, 11, u32(static_cast<std::uint32_t>(Http2Error::cancel)));
+		check("reset of idle stream", c.waitFor(frame::goaway, f) && f.error() == Http2Error::protocol_error);
+		Http2Connection::maxConcurrentStreams = prevLimit;
+	}
+
+	provider.stop();
+	if (failed) {
+		std::cerr << failed << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "OK" << std::endl;
+	return 0;
+}
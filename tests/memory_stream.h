@@ -0,0 +1,77 @@
+/*
+ * memory_stream.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_USERVER_TESTS_MEMORY_STREAM_H_
+#define SRC_USERVER_TESTS_MEMORY_STREAM_H_
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../stream.h"
+
+namespace userver {
+
+///Stream which reads prepared data and collects written data, used by tests and benchmarks
+/**
+ * Input is returned by parts as a socket would return it. Parts have size given by
+ * the list of splits (repeated cyclically), or chunkSize when the list is empty
+ */
+class MemoryStream: public AbstractStream {
+public:
+	MemoryStream(std::string_view input, std::size_t chunkSize = 16384)
+		:input(input),chunkSize(chunkSize) {}
+	MemoryStream(std::string_view input, std::vector<std::size_t> splits)
+		:input(input),chunkSize(0),splits(std::move(splits)) {}
+
+	virtual std::string_view read() override {
+		if (!pb.empty()) return std::exchange(pb, std::string_view());
+		std::size_t sz = splits.empty()?chunkSize:splits[splitIndex++ % splits.size()];
+		std::string_view r = input.substr(0, std::max<std::size_t>(sz, 1));
+		input = input.substr(r.size());
+		return r;
+	}
+	virtual void readAsync(CallbackT<void(const std::string_view &data)> &&fn) override {fn(read());}
+	virtual void putBack(const std::string_view &data) override {pb = data;}
+	virtual void write(const std::string_view &data) override {output.append(data);}
+	virtual bool writeNB(const std::string_view &data) override {output.append(data);return false;}
+	virtual void closeOutput() override {outputClosed = true;}
+	virtual void closeInput() override {}
+	virtual void flush() override {}
+	virtual void flushAsync(CallbackT<void(bool)> &&fn) override {fn(true);}
+	virtual bool timeouted() const override {return false;}
+	virtual void clearTimeout() override {}
+	virtual std::size_t getOutputBufferSize() const override {return 16384;}
+
+	///Unread input
+	std::string_view rest() const {return input;}
+
+	std::string output;
+	bool outputClosed = false;
+
+protected:
+	std::string_view input;
+	std::string_view pb;
+	std::size_t chunkSize;
+	std::vector<std::size_t> splits;
+	std::size_t splitIndex = 0;
+};
+
+///Measures time of a benchmark in nanoseconds
+template<typename Fn>
+inline double measureNs(Fn &&fn) {
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+#endif /* SRC_USERVER_TESTS_MEMORY_STREAM_H_ */
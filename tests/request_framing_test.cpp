@@ -0,0 +1,125 @@
+/*
+ * request_framing_test.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <iostream>
+#include <string>
+
+#include "../http_server.h"
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Test of delimiting request bodies
+/**
+ * Requests with ambiguous framing (both Transfer-Encoding and Content-Length, chunked
+ * not being the final or being applied twice) must be rejected, because a proxy on the
+ * way could delimit the body differently. The body of a valid request must never be
+ * processed as the next request on the connection
+ */
+
+struct Result {
+	bool valid = false;
+	std::string status;
+	std::string body;
+	std::string nextPath;
+};
+
+///Processes the first request on the connection, then reads the next request
+static Result process(const std::string &input) {
+	MemoryStream *ms = new MemoryStream(input, 7);
+	Stream conn(ms);
+	Result r;
+	bool keepAlive = false;
+	{
+		auto req = std::make_unique<HttpServerRequest>();
+		req->setKeepAliveCallback([&](Stream &, HttpServerRequest &) {keepAlive = true;});
+		r.valid = req->init(conn.makeReference());
+		if (r.valid) {
+			Stream b = req->getBody();
+			for (auto d = b.readSync(); !d.empty(); d = b.readSync()) r.body.append(d);
+			req->setStatus(204);
+			req->send();
+		}
+	}
+	r.status = ms->output.substr(0, ms->output.find("\r\n"));
+	if (keepAlive) {
+		HttpServerRequest next;
+		if (next.init(conn.makeReference())) r.nextPath = next.getPath();
+		next.setStatus(204);
+		next.send();
+	}
+	return r;
+}
+
+int main() {
+	int failed = 0;
+	auto check = [&](const char *name, bool cond) {
+		if (!cond) {
+			std::cerr << "Failed: " << name << std::endl;
+			failed++;
+		}
+	};
+	const std::string chunkedSmuggled = "\r\n\r\n1a\r\nGET /smuggled HTTP/1.1\r\n\r\n\r\n0\r\n\r\n";
+	const std::string next = "GET /next HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+	//folded repeated Transfer-Encoding with Content-Length
+	Result r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n"
+			"Transfer-Encoding: chunked\r\nContent-Length: 0" + chunkedSmuggled + next);
+	check("TE twice and CL rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request" && r.nextPath.empty());
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\nContent-Length: 32"
+			+ chunkedSmuggled + next);
+	check("TE and CL rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request" && r.nextPath.empty());
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nContent-Length: 32\r\nTransfer-Encoding: chunked"
+			+ chunkedSmuggled + next);
+	check("CL and TE rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked, chunked" + chunkedSmuggled + next);
+	check("chunked twice rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked, gzip" + chunkedSmuggled + next);
+	check("chunked not final rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: gzip" + chunkedSmuggled + next);
+	check("missing chunked rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: gzip, chunked" + chunkedSmuggled + next);
+	check("unsupported coding rejected", !r.valid && r.status == "HTTP/1.1 501 Not Implemented");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nContent-Length: 1e2" + chunkedSmuggled + next);
+	check("invalid CL rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\nhello!" + next);
+	check("different CL rejected", !r.valid && r.status == "HTTP/1.1 400 Bad Request");
+
+	//valid requests, body is consumed and the next request follows
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: Chunked" + chunkedSmuggled + next);
+	check("chunked body", r.valid && r.body == "GET /smuggled HTTP/1.1\r\n\r\n" && r.nextPath == "/next");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: ,chunked ," + chunkedSmuggled + next);
+	check("chunked in list with empty elements", r.valid && r.nextPath == "/next");
+
+	r = process("GET /a HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked" + chunkedSmuggled + next);
+	check("chunked body of GET", r.valid && r.nextPath == "/next");
+
+	r = process("GET /a HTTP/1.1\r\nHost: localhost\r\nContent-Length: 26\r\n\r\nGET /smuggled HTTP/1.1\r\n\r\n" + next);
+	check("body of GET", r.valid && r.body == "GET /smuggled HTTP/1.1\r\n\r\n" && r.nextPath == "/next");
+
+	r = process("POST /a HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nhello" + next);
+	check("content length", r.valid && r.body == "hello" && r.nextPath == "/next");
+
+	r = process("GET /a HTTP/1.1\r\nHost: localhost\r\n\r\n" + next);
+	check("no body", r.valid && r.body.empty() && r.nextPath == "/next");
+
+	if (failed) {
+		std::cerr << failed << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "OK" << std::endl;
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * route_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../http_server.h"
+
+using namespace userver;
+
+///Benchmark of HttpServerMapper with a large routing table
+/**
+ * Registers 2000 random paths, then compares results of lookups with a reference
+ * implementation (longest prefix searched by removing path segments) and measures
+ * time of a lookup from one and from multiple threads.
+ *
+ * Usage: route_bench [threads]
+ */
+
+static thread_local std::vector<int> calls;
+static thread_local bool accept = false;
+
+///Reference implementation, every candidate prefix is looked up in a map
+static bool referenceExec(const std::map<std::string, int, std::less<> > &routes, std::string_view vpath, std::vector<int> &out) {
+	std::string_view cur = vpath.substr(0, vpath.find('?'));
+	for(;;) {
+		auto iter = routes.find(cur);
+		if (iter != routes.end()) out.push_back(iter->second);
+		auto sep = cur.rfind('/');
+		if (sep == cur.npos) return false;
+		cur = cur.substr(0, sep);
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned int threads = argc > 1?std::atoi(argv[1]):std::max(std::thread::hardware_concurrency(), 2U);
+	std::mt19937 rng(1);
+	const std::vector<std::string> words = {"api","v1","v2","users","items","orders","static","img","css","js",
+			"admin","a","ab","abc","b","x","","login","logout","search"};
+	auto randPath = [&](int maxSeg) {
+		std::string p;
+		int n = 1 + rng() % maxSeg;
+		for (int i = 0; i < n; i++) {
+			p.append("/").append(words[rng() % words.size()]);
+			if (rng() % 4 == 0) p.append(std::to_string(rng() % 50));
+		}
+		return p;
+	};
+	auto makeHandler = [](int id) {
+		return [id](PHttpServerRequest &, std::string_view) {
+			calls.push_back(id);
+			return accept;
+		};
+	};
+
+	HttpServerMapper mapper;
+	std::map<std::string, int, std::less<> > reference;
+	std::vector<std::string> registered;
+	int id = 0;
+	while (registered.size() < 2000) {
+		std::string p = rng() % 30 == 0?std::string("/"):randPath(5);
+		mapper.addPath(p, makeHandler(id));
+		reference.emplace(p, id);
+		registered.push_back(p);
+		id++;
+	}
+	//removed paths and paths registered again (existing path keeps its handler)
+	for (int i = 0; i < 100; i++) {
+		const std::string &p = registered[rng() % registered.size()];
+		mapper.addPath(p, nullptr);
+		reference.erase(p);
+	}
+	for (int i = 0; i < 100; i++) {
+		const std::string &p = registered[rng() % registered.size()];
+		mapper.addPath(p, makeHandler(id));
+		reference.emplace(p, id);
+		id++;
+	}
+
+	std::vector<std::string> queries;
+	for (int i = 0; i < 200000; i++) {
+		std::string q = rng() % 2?registered[rng() % registered.size()]:randPath(7);
+		if (rng() % 3 == 0) q.append("/").append(words[rng() % words.size()]);
+		if (rng() % 5 == 0) q.append("?x=/a/b");
+		if (rng() % 7 == 0) q.append("/");
+		queries.push_back(q);
+	}
+
+	PHttpServerRequest req = std::make_unique<HttpServerRequest>();
+	std::vector<int> expected;
+	std::size_t mismatch = 0;
+	for (const auto &q: queries) {
+		calls.clear();
+		expected.clear();
+		mapper.execHandler(req, q);
+		referenceExec(reference, q, expected);
+		if (calls != expected && mismatch++ < 5) {
+			std::cerr << "Mismatch: " << q << " handlers " << calls.size() << " expected " << expected.size() << std::endl;
+		}
+	}
+	if (mismatch) {
+		std::cerr << "Routing differs from reference in " << mismatch << " lookups" << std::endl;
+		return 1;
+	}
+
+	constexpr int repeat = 5;
+	for (unsigned int thrcnt: {1U, threads}) {
+		std::atomic<long> found = 0;
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> thr;
+		for (unsigned int t = 0; t < thrcnt; t++) thr.emplace_back([&, t]{
+			PHttpServerRequest rq = std::make_unique<HttpServerRequest>();
+			accept = true;
+			long n = 0;
+			for (int r = 0; r < repeat; r++) {
+				for (std::size_t i = t; i < queries.size(); i += thrcnt) {
+					calls.clear();
+					n += mapper.execHandler(rq, queries[i]);
+				}
+			}
+			found += n;
+		});
+		for (auto &t: thr) t.join();
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "threads=" << thrcnt << " routes=" << reference.size()
+				<< " lookups=" << queries.size() * repeat << " found=" << found
+				<< " " << ns / (queries.size() * repeat) << " ns/lookup" << std::endl;
+	}
+	return 0;
+}
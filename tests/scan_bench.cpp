@@ -0,0 +1,186 @@
+/*
+ * scan_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Benchmark of the delimiter scanning API of Stream
+/**
+ * Reads the same input through getLine(), readUntil(), readExactly() and peek() and
+ * compares them with the previous implementation of getLine(), which appended every
+ * read to the line and searched it again. Input is returned by parts of given size, as
+ * the socket would return it.
+ *
+ * Usage: scan_bench [read size]
+ */
+
+///Previous implementation of Stream::getLine()
+static bool referenceGetLine(Stream &s, std::string &ln, std::string_view sep) {
+	ln.clear();
+	auto b = s.readSync();
+	std::size_t e = 0;
+	while (!b.empty()) {
+		ln.append(b);
+		auto p = ln.find(sep, e);
+		if (p != ln.npos) {
+			auto rm = ln.length() - p - sep.length();
+			s.putBack(b.substr(b.length() - rm));
+			ln.resize(p);
+			return true;
+		}
+		e = ln.length() - sep.length() + 1;
+		b = s.readSync();
+	}
+	return !ln.empty();
+}
+
+///Reads fixed size records by read() and putBack(), as the code did without readExactly()
+static bool referenceReadExactly(Stream &s, std::size_t count, std::string &buffer) {
+	buffer.clear();
+	while (buffer.length() < count) {
+		auto b = s.readSync();
+		if (b.empty()) return false;
+		auto part = b.substr(0, count - buffer.length());
+		buffer.append(part);
+		s.putBack(b.substr(part.length()));
+	}
+	return true;
+}
+
+struct Result {
+	std::size_t tokens = 0;
+	std::size_t bytes = 0;
+};
+
+static void report(const char *name, std::size_t inputSize, const Result &r, double ns) {
+	std::cout << name << " tokens=" << r.tokens << " " << ns / r.tokens << " ns/token "
+			<< inputSize / ns * 1000.0 << " MB/s" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	std::size_t readSize = argc > 1?std::strtoul(argv[1], nullptr, 10):16384;
+	constexpr std::size_t recordSize = 64;
+	constexpr int repeat = 10;
+	std::mt19937 rng(1);
+	std::string text;
+	std::size_t lines = 0;
+	while (text.size() < 8*1024*1024) {
+		std::size_t len = 8 + rng() % 120;
+		for (std::size_t i = 0; i < len; i++) text.push_back(static_cast<char>('a' + rng() % 26));
+		text.append("\r\n");
+		lines++;
+	}
+
+	auto runLines = [&](auto &&fn) {
+		Result r;
+		for (int i = 0; i < repeat; i++) {
+			Stream s(std::make_unique<MemoryStream>(text, readSize));
+			std::string buffer;
+			std::string_view out;
+			while (fn(s, buffer, out)) {
+				r.tokens++;
+				r.bytes += out.size();
+			}
+		}
+		return r;
+	};
+
+	Result expect;
+	double ns = measureNs([&]{
+		expect = runLines([](Stream &s, std::string &buffer, std::string_view &out) {
+			bool ok = referenceGetLine(s, buffer, "\r\n");
+			out = buffer;
+			return ok;
+		});
+	});
+	report("getLine (previous)", text.size() * repeat, expect, ns);
+	if (expect.tokens != lines * repeat) {
+		std::cerr << "Reference read " << expect.tokens << " lines, expected " << lines * repeat << std::endl;
+		return 1;
+	}
+
+	int failed = 0;
+	auto check = [&](const char *name, const Result &r, const Result &e, double ns) {
+		report(name, text.size() * repeat, r, ns);
+		if (r.tokens != e.tokens || r.bytes != e.bytes) {
+			std::cerr << name << ": tokens=" << r.tokens << " bytes=" << r.bytes
+					<< " expected tokens=" << e.tokens << " bytes=" << e.bytes << std::endl;
+			failed++;
+		}
+	};
+
+	Result r;
+	ns = measureNs([&]{
+		r = runLines([](Stream &s, std::string &buffer, std::string_view &out) {
+			bool ok = s.getLine(buffer, "\r\n");
+			out = buffer;
+			return ok;
+		});
+	});
+	check("getLine           ", r, expect, ns);
+
+	ns = measureNs([&]{
+		r = runLines([](Stream &s, std::string &buffer, std::string_view &out) {
+			return s.readUntil("\r\n", buffer, out);
+		});
+	});
+	check("readUntil         ", r, expect, ns);
+
+	ns = measureNs([&]{
+		r = runLines([](Stream &s, std::string &buffer, std::string_view &out) {
+			//scans the buffer returned by peek(), consumes the line by readExactly()
+			std::string_view b = s.peek();
+			if (b.empty()) return false;
+			auto p = b.find('\n');
+			if (p == b.npos) return s.readUntil("\r\n", buffer, out);
+			s.readExactly(p + 1, buffer, out);
+			out = out.substr(0, p - 1);
+			return true;
+		});
+	});
+	check("peek+readExactly  ", r, expect, ns);
+
+	//fixed size records
+	std::size_t records = text.size() / recordSize;
+	Result expectRec;
+	expectRec.tokens = records * repeat;
+	expectRec.bytes = records * recordSize * repeat;
+	ns = measureNs([&]{
+		r = Result();
+		for (int i = 0; i < repeat; i++) {
+			Stream s(std::make_unique<MemoryStream>(text, readSize));
+			std::string buffer;
+			while (referenceReadExactly(s, recordSize, buffer)) {
+				r.tokens++;
+				r.bytes += buffer.size();
+			}
+		}
+	});
+	check("read+putBack      ", r, expectRec, ns);
+
+	ns = measureNs([&]{
+		r = Result();
+		for (int i = 0; i < repeat; i++) {
+			Stream s(std::make_unique<MemoryStream>(text, readSize));
+			std::string buffer;
+			std::string_view out;
+			while (s.readExactly(recordSize, buffer, out)) {
+				r.tokens++;
+				r.bytes += out.size();
+			}
+		}
+	});
+	check("readExactly       ", r, expectRec, ns);
+
+	return failed?1:0;
+}
@@ -0,0 +1,180 @@
+/*
+ * tls_file_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include "../async_provider.h"
+#include "../ssl_socket.h"
+
+using namespace userver;
+
+///Benchmark of sending a file over TLS
+/**
+ * Sends a file over a loopback TCP connection secured by TLS. The file is sent by
+ * reading blocks and writing them to SSL (path used without kernel TLS) and by
+ * SSLSocket::sendFile() when the kernel TLS offload is active. Reports CPU time
+ * consumed by the sending process per GB. The client runs in a separate process
+ * and discards received data.
+ *
+ * Usage: tls_file_bench [size of file in MB] [repeat]
+ */
+
+static PSSL_CTX createServerContext() {
+	EVP_PKEY *key = EVP_EC_gen("P-256");
+	X509 *cert = X509_new();
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+	X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+	X509_NAME *name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+	X509_set_issuer_name(cert, name);
+	X509_set_pubkey(cert, key);
+	X509_sign(cert, key, EVP_sha256());
+	PSSL_CTX ctx(SSL_CTX_new(TLS_server_method()), SSL_CTX_Free());
+	SSL_CTX_use_certificate(ctx.get(), cert);
+	SSL_CTX_use_PrivateKey(ctx.get(), key);
+	X509_free(cert);
+	EVP_PKEY_free(key);
+	return ctx;
+}
+
+static double cpuSeconds() {
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+///Reads and discards everything, runs in the child process
+static void runClient(int port) {
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in a{};
+	a.sin_family = AF_INET;
+	a.sin_port = htons(port);
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(s, reinterpret_cast<sockaddr *>(&a), sizeof(a))) _exit(1);
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	PSSL_CTX ctx(SSL_CTX_new(TLS_client_method()), SSL_CTX_Free());
+	SSLSocket cs(Socket(s), ctx, SSLSocket::Mode::connect);
+	//certificate is self-signed, so verification result is ignored
+	cs.waitConnect(5000);
+	std::vector<char> buff(256*1024);
+	while (cs.read(buff.data(), buff.size()) > 0) {}
+	_exit(0);
+}
+
+static std::size_t sendByWrite(SSLSocket &ss, int fd, std::size_t size) {
+	std::vector<char> buff(64*1024);
+	std::size_t pos = 0;
+	while (pos < size) {
+		auto rd = ::pread(fd, buff.data(), std::min(buff.size(), size - pos), pos);
+		if (rd <= 0) break;
+		std::size_t wr = 0;
+		while (wr < static_cast<std::size_t>(rd)) {
+			int r = ss.write(buff.data() + wr, rd - wr);
+			if (r <= 0) return pos + wr;
+			wr += r;
+		}
+		pos += rd;
+	}
+	return pos;
+}
+
+static std::size_t sendBySendFile(SSLSocket &ss, int fd, std::size_t size) {
+	std::size_t pos = 0;
+	while (pos < size) {
+		std::promise<int> res;
+		ss.sendFile(fd, pos, size - pos, [&](int r) {res.set_value(r);});
+		int r = res.get_future().get();
+		if (r <= 0) break;
+		pos += r;
+	}
+	return pos;
+}
+
+int main(int argc, char **argv) {
+	std::size_t sizeMB = argc > 1?std::strtoul(argv[1], nullptr, 10):64;
+	int repeat = argc > 2?std::atoi(argv[2]):8;
+	std::size_t size = sizeMB * 1024 * 1024;
+
+	char tmpl[] = "/tmp/tls_file_benchXXXXXX";
+	int fd = mkstemp(tmpl);
+	if (fd < 0) return 1;
+	unlink(tmpl);
+	{
+		std::string block(1024*1024, 'x');
+		for (std::size_t i = 0; i < sizeMB; i++) {
+			if (::write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size())) return 1;
+		}
+	}
+
+	AsyncProvider provider = createAsyncProvider({1,1});
+	setCurrentAsyncProvider(provider);
+	PSSL_CTX ctx = createServerContext();
+
+	int l = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in a{};
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t al = sizeof(a);
+	if (bind(l, reinterpret_cast<sockaddr *>(&a), al) || listen(l, 1)
+			|| getsockname(l, reinterpret_cast<sockaddr *>(&a), &al)) return 1;
+
+	int failed = 0;
+	for (bool ktls: {false, true}) {
+		SSLSocket::enableKTLS = ktls;
+		pid_t child = fork();
+		if (child == 0) runClient(ntohs(a.sin_port));
+		int s = accept(l, nullptr, nullptr);
+		fcntl(s, F_SETFL, O_NONBLOCK);
+		std::size_t sent = 0;
+		double cpu = 0;
+		{
+			SSLSocket ss(Socket(s), ctx, SSLSocket::Mode::accept);
+			if (!ss.waitConnect(5000)) {
+				std::cerr << "Handshake failed" << std::endl;
+				return 1;
+			}
+			if (ktls && !ss.isKTLSSend()) {
+				std::cout << "sendFile: kernel TLS is not available, skipped" << std::endl;
+			} else {
+				double start = cpuSeconds();
+				for (int i = 0; i < repeat; i++) {
+					sent += ktls?sendBySendFile(ss, fd, size):sendByWrite(ss, fd, size);
+				}
+				cpu = cpuSeconds() - start;
+				double gb = static_cast<double>(sent) / (1024.0*1024.0*1024.0);
+				std::cout << (ktls?"sendFile (kTLS)  ":"read+SSL_write   ") << cpu / gb << " CPU s/GB" << std::endl;
+				if (sent != size * repeat) {
+					std::cerr << "Sent " << sent << " bytes, expected " << size * repeat << std::endl;
+					failed++;
+				}
+			}
+		}
+		int status;
+		waitpid(child, &status, 0);
+	}
+	provider.stop();
+	close(l);
+	close(fd);
+	return failed?1:0;
+}
@@ -0,0 +1,104 @@
+/*
+ * unix_bench.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "../http_server.h"
+#include "../socket.h"
+#include "memory_stream.h"
+
+using namespace userver;
+
+///Benchmark of the server listening on unix sockets and on loopback TCP
+/**
+ * Starts the server on a unix socket in the filesystem, on a unix socket in the
+ * abstract namespace and on loopback TCP. For each address it measures latency of
+ * small requests on a keep-alive connection and throughput of large responses.
+ *
+ * Usage: unix_bench [count of requests] [size of large response in KB]
+ */
+
+///Sends the request and reads the response until the body of given size is received
+static bool request(Socket &s, const std::string &req, std::size_t bodySize, std::string &buffer) {
+	if (s.write(req.data(), req.size()) != static_cast<int>(req.size())) return false;
+	buffer.clear();
+	char b[65536];
+	std::size_t hdrEnd = std::string::npos;
+	while (hdrEnd == std::string::npos || buffer.size() < hdrEnd + 4 + bodySize) {
+		int r = s.read(b, sizeof(b));
+		if (r <= 0) return false;
+		buffer.append(b, r);
+		if (hdrEnd == std::string::npos) hdrEnd = buffer.find("\r\n\r\n");
+	}
+	return true;
+}
+
+///Server without access log
+class QuietServer: public HttpServer {
+public:
+	virtual void log(ReqEvent, const HttpServerRequest &) noexcept override {}
+};
+
+int main(int argc, char **argv) {
+	std::size_t count = argc > 1?std::strtoul(argv[1], nullptr, 10):20000;
+	std::size_t largeSize = (argc > 2?std::strtoul(argv[2], nullptr, 10):1024) * 1024;
+	std::string pid = std::to_string(getpid());
+	const std::string small = "Hello world";
+	const std::string large(largeSize, 'x');
+
+	QuietServer server;
+	server.addPath("/small", [&](PHttpServerRequest &req, std::string_view) {
+		req->send(small);
+		return true;
+	});
+	server.addPath("/large", [&](PHttpServerRequest &req, std::string_view) {
+		req->send(large);
+		return true;
+	});
+
+	std::string path = "/tmp/unix_bench_" + pid + ".sock";
+	NetAddrList addrs;
+	addrs.push_back(NetAddr::fromString("unix:" + path)[0]);
+	addrs.push_back(NetAddr::fromString("unix:@unix_bench_" + pid)[0]);
+	addrs.push_back(NetAddr::fromString("127.0.0.1", std::to_string(20000 + getpid() % 20000))[0]);
+	server.start(addrs, AsyncProviderConfig{1, 2});
+
+	int failed = 0;
+	const char *names[] = {"unix     ", "abstract ", "tcp      "};
+	std::string buffer;
+	for (int i = 0; i < 3; i++) {
+		Socket s = Socket::connect(addrs[i]);
+		if (!s.waitConnect(5000)) {
+			std::cerr << names[i] << ": unable to connect" << std::endl;
+			failed++;
+			continue;
+		}
+		s.setIOTimeout(5000);
+		std::size_t done = 0;
+		double latNs = measureNs([&]{
+			while (done < count && request(s, "GET /small HTTP/1.1\r\nHost: localhost\r\n\r\n", small.size(), buffer)) done++;
+		});
+		std::size_t largeCount = std::max<std::size_t>(1, count / 50);
+		std::size_t largeDone = 0;
+		double thrNs = measureNs([&]{
+			while (largeDone < largeCount && request(s, "GET /large HTTP/1.1\r\nHost: localhost\r\n\r\n", large.size(), buffer)) largeDone++;
+		});
+		std::cout << names[i] << latNs / 1000.0 / done << " us/request "
+				<< largeDone * large.size() / thrNs * 1000.0 << " MB/s" << std::endl;
+		if (done != count || largeDone != largeCount) {
+			std::cerr << names[i] << ": requests failed" << std::endl;
+			failed++;
+		}
+	}
+	server.stop();
+	unlink(path.c_str());
+	return failed?1:0;
+}
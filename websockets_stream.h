@@ -99,11 +99,16 @@ public:
      * @param type type of message
      * @param data message payload
      * @retval true message sent or queued to be sent
-     * @retval false message was not send, because stream is closed
+     * @retval false message was not send, because stream is closed. The stream is also
+     * closed for sending, when the write queue exceeds maxWriteQueueSize
      *
      * @note MT safety is satisfied. Multiple threads can write messages without need to lock
      */
     bool send(WSFrameType type, std::string_view data);
+    ///Maximum size of write queue while the stream is flushing
+    /** When the queue exceeds this size, the peer is considered too slow and the stream is closed
+     * for sending. Set 0 to unlimited */
+    inline static std::size_t maxWriteQueueSize = 4*1024*1024;
     ///Request to close
     /**
      * Sends close request to the other side. This can cause, that stream will be closed
@@ -215,6 +220,11 @@ inline bool WSStream::send(WSFrameType type, std::string_view data){
 inline bool WSStream::State::write(std::shared_ptr<State> state, std::string_view data) {
     auto &st = *state;
     if (st.flushing) {
+        if (maxWriteQueueSize && st.wrqueue.size() + data.size() > maxWriteQueueSize) {
+            st.send_closed = true;
+            st.wrqueue.clear();
+            return false;
+        }
         st.wrqueue.append(data);
         return true;
     } else {
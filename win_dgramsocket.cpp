@@ -81,11 +81,14 @@ namespace userver {
 				pfd.fd = s;
 				pfd.events = POLLOUT;
 				pfd.revents = 0;
-				r = WSAPoll(&pfd, 1, -1);
+				r = WSAPoll(&pfd, 1, writetm);
 				if (r < 0) {
 					if (err == WSAEINTR) return send(data, target);
 					throw std::system_error(WSAGetLastError(), win32_error_category());
 				}
+				else if (r == 0) {
+					throw std::system_error(WSAETIMEDOUT, win32_error_category(), "DGramSocket::send()");
+				}
 				else {
 					return send(data, target);
 				}
@@ -103,6 +106,7 @@ namespace userver {
 		, inputBuffer(std::move(other.inputBuffer))
 		, addrBuffer(std::move(other.addrBuffer))
 		, rcvsize(other.rcvsize)
+		, writetm(other.writetm)
 	{
 		other.s = -1;
 	}
@@ -116,6 +120,7 @@ namespace userver {
 		inputBuffer = std::move(other.inputBuffer);
 		addrBuffer = std::move(other.addrBuffer);
 		rcvsize = other.rcvsize;
+		writetm = other.writetm;
 		other.s = -1;
 		return *this;
 
@@ -46,22 +46,26 @@ namespace userver {
 	}
 
 	std::optional<Socket> SocketServer::waitAccept() {
-		sockaddr_storage stor;
+		PeerAddr stor;
 		SocketHandle z = waitForSocket(stor);
 		if (z < 0) return std::optional<Socket>();
 		else return Socket(z);
 	}
 
 	std::optional<SocketServer::AcceptInfo> SocketServer::waitAcceptGetPeer() {
-		sockaddr_storage stor;
+		PeerAddr stor;
 		SocketHandle z = waitForSocket(stor);
 		if (z < 0) return std::optional<SocketServer::AcceptInfo>();
-		else return SocketServer::AcceptInfo{
-			Socket(z), NetAddr::fromSockAddr(reinterpret_cast<sockaddr&>(stor))
-		};
+		else return SocketServer::AcceptInfo{Socket(z), stor};
 	}
 
-	SocketHandle SocketServer::waitForSocket(sockaddr_storage& sin) {
+	unsigned int SocketServer::maxAcceptBatch = 1;
+
+	NetAddr SocketServer::PeerAddr::get() const {
+		return NetAddr::fromSockAddr(*reinterpret_cast<const sockaddr*>(addr));
+	}
+
+	SocketHandle SocketServer::waitForSocket(PeerAddr& sin) {
 		pollfd* pfds = reinterpret_cast<pollfd*>(alloca(sizeof(pollfd) * fds.size()));
 		{
 			unsigned int idx = 0;
@@ -80,8 +84,8 @@ namespace userver {
 		}
 		for (std::size_t i = 0, cnt = fds.size(); i < cnt; i++) {
 			if (pfds[i].revents & POLLIN) {
-				socklen_t slen = sizeof(sin);
-				SocketHandle s = accept(pfds[i].fd, reinterpret_cast<sockaddr*>(&sin), &slen);
+				sin.len = sizeof(sin.addr);
+				SocketHandle s = accept(pfds[i].fd, reinterpret_cast<sockaddr*>(sin.addr), &sin.len);
 				if (s == SOCKET_ERROR) {
 					if (exit) return -1;
 					throw std::system_error(WSAGetLastError(), win32_error_category(), "accept()");
@@ -121,17 +125,14 @@ namespace userver {
 					std::unique_lock _(me->lk);
 					me->uncharge(i);
 
-					sockaddr_storage sin;
-					socklen_t slen = sizeof(sin);
-					SocketHandle s = accept(i, reinterpret_cast<sockaddr*>(&sin), &slen);
+					PeerAddr sin;
+					SocketHandle s = accept(i, reinterpret_cast<sockaddr*>(sin.addr), &sin.len);
 					if (s != SOCKET_ERROR) {
 						u_long one = 1;
 						ioctlsocket(s, FIONBIO, &one);
 						AsyncCallback cb(std::move(me->curCallback));
 						if (cb != nullptr) {
-							std::optional<SocketServer::AcceptInfo> ainfo({
-									Socket(s), NetAddr::fromSockAddr(reinterpret_cast<sockaddr&>(sin))
-								});
+							std::optional<SocketServer::AcceptInfo> ainfo({Socket(s), sin});
 							_.unlock();
 							cb(ainfo);
 						}